@@ -163,9 +163,49 @@ struct ext2_super_block {
 	__u32	s_feature_compat; 	/* compatible feature set */
 	__u32	s_feature_incompat; 	/* incompatible feature set */
 	__u32	s_feature_ro_compat; 	/* readonly-compatible feature set */
-	__u32	s_reserved[230];	/* Padding to the end of the block */
+	__u8	s_uuid[16];		/* 128-bit uuid for volume */
+	char	s_volume_name[16]; 	/* volume name */
+	char	s_last_mounted[64]; 	/* directory where last mounted */
+	__u32	s_algorithm_usage_bitmap; /* For compression */
+	__u8	s_prealloc_blocks;	/* Nr of blocks to try to preallocate*/
+	__u8	s_prealloc_dir_blocks;	/* Nr to preallocate for dirs */
+	__u16	s_reserved_gdt_blocks;	/* Per group table for online growth */
+	__u8	s_journal_uuid[16];	/* uuid of journal superblock */
+	__u32	s_journal_inum;		/* inode number of journal file */
+	__u32	s_journal_dev;		/* device number of journal file */
+	__u32	s_last_orphan;		/* start of list of inodes to delete */
+	__u32	s_hash_seed[4];		/* HTREE hash seed */
+	__u8	s_def_hash_version;	/* Default hash version to use */
+	__u8	s_jnl_backup_type;
+	__u16	s_desc_size;
+	__u32	s_default_mount_opts;
+	__u32	s_first_meta_bg;	/* First metablock block group */
+	__u32	s_mkfs_time;		/* When the filesystem was created */
+	__u32	s_jnl_blocks[17];	/* Backup of the journal inode */
+	__u32	s_blocks_count_hi;
+	__u32	s_r_blocks_count_hi;
+	__u32	s_free_blocks_hi;
+	__u16	s_min_extra_isize;
+	__u16	s_want_extra_isize;
+	__u32	s_flags;		/* Miscellaneous flags */
+	__u32	s_reserved[167];	/* Padding to the end of the block */
 };
 
+/*
+ * Feature and flag bits used for indexed (htree) directories
+ */
+#define EXT2_FEATURE_COMPAT_DIR_INDEX	0x0020
+#define EXT2_FLAGS_UNSIGNED_HASH	0x0002	/* s_flags: names hash as unsigned chars */
+#define EXT2_INDEX_FL			0x00001000 /* i_flags: hash-indexed directory */
+#define EXT2_HASH_LEGACY		0
+#define EXT2_HASH_HALF_MD4		1
+#define EXT2_HASH_TEA			2
+
+/*
+ * Read-only compatible feature for regular files of 2 GB and more, whose size goes on in i_dir_acl
+ */
+#define EXT2_FEATURE_RO_COMPAT_LARGE_FILE	0x0002
+
 /*
  * Structure of a directory entry
  */
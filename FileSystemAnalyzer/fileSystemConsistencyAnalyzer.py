@@ -1,32 +1,45 @@
 #!/usr/local/cs/bin/python3                                                                                                         
 
 import csv
+import gc
+import io
+import os
 import sys
 from collections import defaultdict
 
+# Every audit works off indexes built once from the summary (sets for membership, dicts of blocks and dirents
+# keyed by inode), so each is a single pass over its lines. The summary is only split into its line types up
+# front; the inode, block and directory audits then run at the same time in forked processes, each turning just
+# the fields it uses into numbers and printing into its own buffer, and the buffers are written out in the same
+# order as the audits always ran, so the output is the same as running them one after another.
+
 exitCode=0
 def setExit(exitVal):
     global exitCode
     exitCode=exitVal
 
-def getInodeBlocks(inodeNum, indirectLines, inodeLines, blockSize): # return all (indlucding data, indirection) blocks referred by inodeNumber
+def getInodeBlocks(inodeLines, indirectLines, blockSize): # return all (including data, indirection) blocks referred by each inodeNumber
 
-    inodeNumBlocks = []
-    offset=0
+    inodeBlocks = defaultdict(list) # key is inodeNum, val is a list of (blocknum, offset, indirectionLevel)
+    offsets = defaultdict(int) # offset carries over between i_block slots, as a running value per inode
+    offsetOf = { 13: int((blockSize/4) - 1), 14: int(blockSize/4 - 2 + (blockSize*blockSize)/16) } #255, 254 + 256*256
     for inodeLine in inodeLines:
-        if inodeLine[1]==inodeNum and len(inodeLine)>12:
-            for i in range(15): # 0-14
-                if i>11 and inodeLine[i+12]!=0:
-                    if i==13: offset = int((blockSize/4) - 1) #255
-                    if i==14: offset = int(blockSize/4 - 2 + (blockSize*blockSize)/16) #254 + 256*256
-                    inodeNumBlocks.append( [ inodeLine[i+12], i+offset , i-10 ] ) # format is blocknum, offset, indirectionLevel
-                elif inodeLine[i+12]!=0:
-                    inodeNumBlocks.append( [ inodeLine[i+12], i , 1 ] )
+        if len(inodeLine)>12:
+            inodeNum = inodeLine[1]
+            for i in [ i for i, block in enumerate(inodeLine[12:27]) if block!='0' ]: # 0-14, skipping the many zeros as text
+                block = int(inodeLine[i+12])
+                if block==0:
+                    continue
+                if i>11:
+                    if i>12: offsets[inodeNum] = offsetOf[i]
+                    inodeBlocks[inodeNum].append( (block, i+offsets[inodeNum], i-10) ) # format is blocknum, offset, indirectionLevel
+                else:
+                    inodeBlocks[inodeNum].append( (block, i, 1) )
 
     for indirectLine in indirectLines:
-        if indirectLine[1]==inodeNum and indirectLine[5]!=0:
-            inodeNumBlocks.append( [ indirectLine[5], indirectLine[3], indirectLine[2] ] ) # format is blocknum, offset ,indirectionLevel
-    return inodeNumBlocks    
+        if indirectLine[5]!=0:
+            inodeBlocks[indirectLine[1]].append( (indirectLine[5], indirectLine[3], indirectLine[2]) ) # format is blocknum, offset ,indirectionLevel
+    return inodeBlocks
 
 def printBlockErrors(block, inodeNum, offset, indirection): # prints out if error with a block, called in multiple different places
     setExit(2)
@@ -39,11 +52,16 @@ def printBlockErrors(block, inodeNum, offset, indirection): # prints out if erro
     elif indirection==4:
          print("TRIPLE INDIRECT BLOCK",block, "IN INODE",inodeNum, "AT OFFSET",offset)
 
+def toInts(lines, fields): # turn these fields of every line into numbers, in place
+    for line in lines:
+        for i in fields:
+            if i < len(line):
+                line[i]=int(line[i])
+
 def getInodeErrors(inodeLines, freeInodeNumbers, totalInodeCount): # find errors related to inodes (2nd portion in spec)
-    allocatedInodeNumbers = []
-    for inode in inodeLines:
-        if inode[2]!=0:
-            allocatedInodeNumbers.append(inode[1])
+    toInts(inodeLines, [1])
+    freeInodeNumbers = set(map(int, freeInodeNumbers))
+    allocatedInodeNumbers = { inode[1] for inode in inodeLines if inode[2]!=0 }
 
     for i in range(totalInodeCount): 
         if ((i+1)>10) and (i+1 not in allocatedInodeNumbers) and (i+1 not in freeInodeNumbers):
@@ -53,65 +71,102 @@ def getInodeErrors(inodeLines, freeInodeNumbers, totalInodeCount): # find errors
 
 def getBlockErrors(inodeLines, freeInodeNumbers, indirectLines, totalBlockCount, lowerBlockBound, freeBlockNumbers, blockSize): 
 # find errors related to blocks (1st portion of spec)
+        toInts(inodeLines, [1])
+        for indirectLine in indirectLines:
+            indirectLine[1:] = map(int, indirectLine[1:])
+        freeBlockNumbers = set(map(int, freeBlockNumbers))
         trackDuplicates = defaultdict(list) # initialize all lists to empty
-        blocksInFile = []
+        inodeBlocks = getInodeBlocks(inodeLines, indirectLines, blockSize)
         for inodeLine in inodeLines:
-            inodeBlocks = getInodeBlocks(inodeLine[1], indirectLines, inodeLines, blockSize)
-            for block in inodeBlocks:
-                if ( block[0]<0 or block[0]>totalBlockCount ):
+            inodeNum = inodeLine[1]
+            for block, offset, indirection in inodeBlocks.get(inodeNum, ()):
+                if ( block<0 or block>totalBlockCount ):
                     print("INVALID",end=" "); 
-                    printBlockErrors(block[0], inodeLine[1], block[1], block[2]) 
-                if ( block[0] < lowerBlockBound and block[0] >= 0 ):
+                    printBlockErrors(block, inodeNum, offset, indirection) 
+                if ( block < lowerBlockBound and block >= 0 ):
                     print("RESERVED",end=" ")
-                    printBlockErrors(block[0], inodeLine[1], block[1], block[2])
-                if ( block[0] in freeBlockNumbers ):
-                    print("ALLOCATED BLOCK", block[0], "ON FREELIST"); setExit(2)
-                trackDuplicates[block[0]].append( [block[0], inodeLine[1], block[1], block[2]] ) # key is blockNum, val is inodeNum, offset, indirection
-
-        for block in trackDuplicates:
-            if len(trackDuplicates[block])>1:
-                for i in range(len(trackDuplicates[block])):
+                    printBlockErrors(block, inodeNum, offset, indirection)
+                if ( block in freeBlockNumbers ):
+                    print("ALLOCATED BLOCK", block, "ON FREELIST"); setExit(2)
+                trackDuplicates[block].append( (inodeNum, offset, indirection) ) # key is blockNum, val is inodeNum, offset, indirection
+
+        for block, references in trackDuplicates.items():
+            if len(references)>1:
+                for inodeNum, offset, indirection in references:
                     print("DUPLICATE",end=" ")
-                    printBlockErrors(trackDuplicates[block][i][0], trackDuplicates[block][i][1], trackDuplicates[block][i][2], trackDuplicates[block][i][3])
+                    printBlockErrors(block, inodeNum, offset, indirection)
         
         for i in range(lowerBlockBound,totalBlockCount): # total block count is 
            if i not in trackDuplicates and i not in freeBlockNumbers: # by default, dict name is a list of keys
                print("UNREFERENCED BLOCK", i); setExit(2)
 
-def parentInodeOf(child, directoryLines): # obtain directory entry whose child reference is 'child'
-    for dirent in directoryLines:
-        if (dirent[3]==child) and (dirent[6]!="'.'") and (dirent[6]!="'..'"):
-            return dirent[1]
-    return 2 # special case where at root whose parent is itself...
-
 def getDirErrors(inodeLines, directoryLines, totalInodeCount, freeInodeNumbers): # find errors related to dirents, (3rd portion spec)
-    allocatedInodeNumbers = []
-    for inodeLine in inodeLines:
-        if inodeLine[2]!=0:
-            allocatedInodeNumbers.append(inodeLine[1])
+    toInts(inodeLines, [1,6])
+    for dirent in directoryLines:
+        dirent[1:-1] = map(int, dirent[1:-1])
+    allocatedInodeNumbers = { inodeLine[1] for inodeLine in inodeLines if inodeLine[2]!=0 }
     
+    direntsTo = defaultdict(list) # key is the inode a dirent links to, val is those dirents in summary order
+    parentInodeOf = {} # key is a directory, val is the directory holding its first entry other than '.' and '..'
     for dirent in directoryLines:
         if (dirent[3]<1) or (dirent[3]>totalInodeCount):
             print("DIRECTORY INODE", dirent[1], "NAME", dirent[6], "INVALID INODE", dirent[3]); setExit(2)
         elif (dirent[3] not in allocatedInodeNumbers):
             print("DIRECTORY INODE", dirent[1], "NAME", dirent[6], "UNALLOCATED INODE", dirent[3]); setExit(2)
+        direntsTo[dirent[3]].append(dirent)
+        if (dirent[6]!="'.'") and (dirent[6]!="'..'") and dirent[3] not in parentInodeOf:
+            parentInodeOf[dirent[3]] = dirent[1]
   
     for inodeLine in inodeLines: # allocated list is inode lines which are allocated.                                                               
         if inodeLine[1] not in allocatedInodeNumbers:
             continue
-        count=0
-        for dirent in directoryLines:
-            if dirent[3]==inodeLine[1]:
-                count+=1
-                if (dirent[6]=="'.'" and dirent[3]!=dirent[1]):
-                    print("DIRECTORY INODE", dirent[1], "NAME '.' LINK TO INODE", dirent[3], "SHOULD BE", dirent[1]); setExit(2)
-                if (dirent[6]=="'..'"):
-                    x = parentInodeOf(dirent[1], directoryLines)
-                    if x!=dirent[3]:                                                      
-                        print("DIRECTORY INODE", dirent[1], "NAME '..' LINK TO INODE", dirent[3], "SHOULD BE", x); setExit(2)
-        if count!=inodeLine[6]:
-            print("INODE", inodeLine[1], "HAS", count, "LINKS BUT LINKCOUNT IS", inodeLine[6]); setExit(2)
-
+        links = direntsTo.get(inodeLine[1], [])
+        for dirent in links:
+            if (dirent[6]=="'.'" and dirent[3]!=dirent[1]):
+                print("DIRECTORY INODE", dirent[1], "NAME '.' LINK TO INODE", dirent[3], "SHOULD BE", dirent[1]); setExit(2)
+            if (dirent[6]=="'..'"):
+                x = parentInodeOf.get(dirent[1], 2) # special case where at root whose parent is itself...
+                if x!=dirent[3]:                                                      
+                    print("DIRECTORY INODE", dirent[1], "NAME '..' LINK TO INODE", dirent[3], "SHOULD BE", x); setExit(2)
+        if len(links)!=inodeLine[6]:
+            print("INODE", inodeLine[1], "HAS", len(links), "LINKS BUT LINKCOUNT IS", inodeLine[6]); setExit(2)
+
+def runAudits(audits): # run each audit in its own process, print their output in order, return the worst exit code
+    if not hasattr(os, "fork"):
+        for audit in audits:
+            audit()
+        return exitCode
+    children = []
+    gc.freeze() # so that collections in the children don't write to (and copy) every page of the parent's rows
+    for audit in audits:
+        r, w = os.pipe()
+        pid = os.fork()
+        if pid == 0: # child: audit into a buffer, then hand it over
+            os.close(r)
+            sys.stdout = io.StringIO()
+            try:
+                audit()
+                output = sys.stdout.getvalue().encode()
+                while output:
+                    output = output[os.write(w, output):]
+            except BaseException:
+                import traceback
+                traceback.print_exc()
+                os._exit(1)
+            os._exit(exitCode)
+        os.close(w)
+        children.append((pid, r))
+
+    worst = 0
+    sys.stdout.flush()
+    for pid, r in children: # in order, whichever finishes first
+        with os.fdopen(r, 'rb') as output:
+            sys.stdout.buffer.write(output.read())
+        status = os.waitpid(pid, 0)[1]
+        code = os.WEXITSTATUS(status) if os.WIFEXITED(status) else 1
+        worst = code if code==1 or worst==1 else max(worst, code)
+    sys.stdout.flush()
+    return worst
 
 if __name__ == '__main__':
 
@@ -124,17 +179,12 @@ if __name__ == '__main__':
         print("File error", file=sys.stderr)
         exit(1)
     fileText = csv.reader(inpt)
+    gc.disable() # millions of rows and no cycles among them, the collector would only keep rescanning them
     
-    freeInodeNumbers, freeBlockNumbers, inodeLines, indirectLines, directoryLines = ( [] for j in range(5) ) # parse in all the different line type
+    lines = defaultdict(list) # parse in all the different line type, as text until an audit needs their numbers
     totalBlockCount = lowerBlockBound  = blockSize = inodeSize = groupInodeCount = groupInodeTable = totalInodeCount = 0
     for row in fileText:
-        if row[0] == "IFREE": 
-            freeInodeNumbers.append(int(row[1]))
-        if row[0] == "INODE":
-            for i in range(len(row)):
-                if i not in [0,2,7,8,9]: 
-                    row[i]=int(row[i])
-            inodeLines.append(row)
+        lines[row[0]].append(row)
         if row[0] == "SUPERBLOCK":
             totalInodeCount = int(row[2])
             totalBlockCount = int(row[1])
@@ -143,21 +193,13 @@ if __name__ == '__main__':
         if row[0] == "GROUP":
             groupInodeCount = int(row[3])
             groupInodeTable = int(row[8])
-        if row[0] == "BFREE":
-            freeBlockNumbers.append(int(row[1]))
-        if row[0] == "INDIRECT":
-            for i in range(1, len(row)):
-                row[i]=int(row[i])
-            indirectLines.append(row)
-        if row[0] == "DIRENT":
-            for i in range(1,len(row)-1):
-                row[i]=int(row[i])
-            directoryLines.append(row)
+    inodeLines, indirectLines, directoryLines = lines["INODE"], lines["INDIRECT"], lines["DIRENT"]
+    freeInodeNumbers = [ row[1] for row in lines["IFREE"] ]
+    freeBlockNumbers = [ row[1] for row in lines["BFREE"] ]
 
     lowerBlockBound = int(groupInodeTable + ( (groupInodeCount*inodeSize) / blockSize ) )
 
-    getInodeErrors(inodeLines, freeInodeNumbers, totalInodeCount) # INODE ERRORS
-    getBlockErrors(inodeLines, freeInodeNumbers, indirectLines, totalBlockCount, lowerBlockBound, freeBlockNumbers, blockSize) # BLOCK ERRORS
-    getDirErrors(inodeLines, directoryLines, totalInodeCount, freeInodeNumbers) # directory 
-
-    exit(exitCode)
+    exit( runAudits([
+        lambda: getInodeErrors(inodeLines, freeInodeNumbers, totalInodeCount), # INODE ERRORS
+        lambda: getBlockErrors(inodeLines, freeInodeNumbers, indirectLines, totalBlockCount, lowerBlockBound, freeBlockNumbers, blockSize), # BLOCK ERRORS
+        lambda: getDirErrors(inodeLines, directoryLines, totalInodeCount, freeInodeNumbers) ]) ) # directory 
@@ -1,14 +1,22 @@
 //NAME: Mihir Arya
 
+#define _GNU_SOURCE // copy_file_range()
+
 
 // Source file (lab3a.c) for project 3a, cs111!
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
 #include "ext2_fs.h"
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
 #include <fcntl.h>
 #include <time.h>
 #include <math.h>
@@ -20,27 +28,37 @@ struct ext2_group_desc groupInfoData;
 struct ext2_inode* inodeSummaryData;
 int groupBlockCount=0, groupInodeCount=0;
 
-int computeOffset(int in)
+off_t computeOffset(__u32 in)
 { // compute the byte offset from the start of the file image, of the inputted block number
-  return 1024+blockSize*(in-1); // blockNumber of superblock is 1
+  return (off_t)blockSize*in; // block 0 starts the image, whatever the block size (the superblock is block 1 only with 1 KB blocks)
 }
 
-void computeDirectory(int parentInode, int blockNum)
+int nextDirEntry(const char* block, int counter, struct ext2_dir_entry** entry)
 {
-  struct ext2_dir_entry dEntry;
-  int counter=0;
+  // the entry at counter in a directory block held in memory, returning where the next one starts, or blockSize
+  // once the block is done (also when a corrupt rec_len would take us out of it, or nowhere)
+  *entry = (struct ext2_dir_entry*)(block+counter);
+  if ( counter+8 > blockSize || (*entry)->rec_len < 8 || counter+(*entry)->rec_len > blockSize || (*entry)->name_len+8 > (*entry)->rec_len )
+    { *entry = NULL; return blockSize; }
+  return counter+(*entry)->rec_len;
+}
 
-  do
+void computeDirectory(int parentInode, int blockNum)
+{
+  // print the entries of one directory block, which is read once and walked by rec_len. entries with inode 0 are
+  // deleted (or are the fake ones covering the blocks of an htree index), but live ones may still follow them
+  char block [blockSize];
+  if (blockNum == 0) // a hole
+    return;
+  if ( pread(fd, block, blockSize, computeOffset(blockNum)) == -1 ) // the whole block, once
+    { fprintf(stderr,"Error with pread in directory check\n"); exit(2); }
+  struct ext2_dir_entry* dEntry;
+  for (int counter=0, next; counter<blockSize; counter=next)
     {
-      if ( pread(fd, &dEntry, sizeof(dEntry), computeOffset(blockNum)+counter) == -1 )	// data on dir entry
-	{ fprintf(stderr,"Error with pread in directory check\n"); exit(2); }
-      if (dEntry.inode==0)
-	break;
-      printf("DIRENT,%d,%d,%d,%d,%d,'%s'\n", parentInode, counter, dEntry.inode, dEntry.rec_len, dEntry.name_len, dEntry.name);
-      counter+=dEntry.rec_len;
+      next = nextDirEntry(block, counter, &dEntry);
+      if (dEntry != NULL && dEntry->inode != 0)
+	printf("DIRENT,%d,%d,%d,%d,%d,'%.*s'\n", parentInode, counter, dEntry->inode, dEntry->rec_len, dEntry->name_len, dEntry->name_len, dEntry->name);
     }
-  while(counter<blockSize);
-
 }
 
 void computeIndirection(int parentInode, int blockNum,int indirectionLevel, int directoryCheck, int offset)
@@ -73,6 +91,8 @@ void computeIndirection(int parentInode, int blockNum,int indirectionLevel, int
 void computeIndirectionWrapper(int parentInode, int blockNum, int indirectionLevel, int directoryCheck)
 {
   int offset; // starting position of first data block for indirection type
+  if (blockNum==0) // no such indirect block
+    return;
   if (indirectionLevel==1)
     offset=12;
   else
@@ -94,7 +114,7 @@ void inodeSummary()
   inodeSummaryData = (struct ext2_inode*)malloc( sizeof(struct ext2_inode)*groupInodeCount );
   if (inodeSummaryData==NULL)
     { fprintf(stderr,"Memory allocation issue!\n"); exit(2); }
-  int offset = computeOffset(groupInfoData.bg_inode_table);
+  off_t offset = computeOffset(groupInfoData.bg_inode_table);
   char ftype;
   int mask = 0xF000;
   
@@ -160,37 +180,45 @@ void freeEntries(int groupCount, unsigned int bitmap)
 	  }
 }
 
-void groupInfo()
+void readGroup()
 {
-  // function to obtain various group metadata for given group in the filesystem
-  if ( pread(fd, &groupInfoData, sizeof(groupInfoData), computeOffset(2)) == -1 ) // read group info into groupInfoData struct
+  if ( pread(fd, &groupInfoData, sizeof(groupInfoData), computeOffset(sb.s_first_data_block+1)) == -1 ) // read group info into groupInfoData struct, from the block after the superblock's (2 with 1 KB blocks, 1 otherwise)
     { fprintf(stderr,"Error reading group summary!\n"); exit(2); }
 
   groupBlockCount= sb.s_blocks_count; // number of blocks in group
   groupInodeCount= sb.s_inodes_count; // number of inodes in group
-  
+}
+
+void groupInfo()
+{
+  // function to obtain various group metadata for given group in the filesystem
+  readGroup();
   printf("GROUP,%d,%d,%d,%d,%d,%d,%d,%d\n", 0, groupBlockCount, groupInodeCount, groupInfoData.bg_free_blocks_count, groupInfoData.bg_free_inodes_count, groupInfoData.bg_block_bitmap, groupInfoData.bg_inode_bitmap, groupInfoData.bg_inode_table );
 						// print all group metadata desired
 }
 
-void superblockInfo()
-{ 
-  // function to obtain superblock information from the file system image
-  if ( pread(fd, &sb, sizeof(sb), computeOffset(1)) == -1 )
+void readSuperblock()
+{
+  if ( pread(fd, &sb, sizeof(sb), EXT2_MIN_BLOCK_SIZE) == -1 ) // 1024 bytes in, before the block size is known
     { fprintf(stderr,"Error reading superblock!\n"); exit(2); }
   if ( sb.s_magic != EXT2_SUPER_MAGIC ) // expected value to be stored in suberblock.s_magic is EXT2_SUPER_MAGIC, else didn't read superblock correctly
     { fprintf(stderr,"Did not correctly read superblock!\n"); exit(2); }
 
   blockSize = EXT2_MIN_BLOCK_SIZE << sb.s_log_block_size;
+}
+
+void superblockInfo()
+{ 
+  // function to obtain superblock information from the file system image
+  readSuperblock();
   printf( "SUPERBLOCK,%d,%d,%d,%d,%d,%d,%d\n", sb.s_blocks_count, sb.s_inodes_count, blockSize, sb.s_inode_size, sb.s_blocks_per_group, sb.s_inodes_per_group, sb.s_first_ino  );
 	                                      // above print statement contains all the superblock metadata desired
 }
 
-int main(int argc,  char *argv[] )
+void interpretImage(const char* path)
 {
-  if ( argc!=2 || argv[1]==NULL ) // we want exactly one input argument, and that should be the name of the file containing the file system image
-    { fprintf(stderr,"Invalid input arguments!\n"); exit(1); }
-  fd = open(argv[1], O_RDONLY); // open file descriptor for file system image
+  // print the summary of the image at path to stdout
+  fd = open(path, O_RDONLY); // open file descriptor for file system image
   if ( fd == -1 )
     { fprintf(stderr,"Unable to open specified file\n"); exit(1); }
   
@@ -201,5 +229,897 @@ int main(int argc,  char *argv[] )
   inodeSummary();
   
   free(inodeSummaryData);
+}
+
+/* Name lookups (--lookup=PATH), resolving a path from the root directory the way the kernel does. A directory
+   with an htree index (EXT2_INDEX_FL) is searched through it: the name's hash picks one leaf block, found by a
+   binary search of the root's index entries (and of one index node per further level), so a lookup in a huge
+   directory reads a handful of blocks rather than all of them. Other directories, and those whose index doesn't
+   look right, are scanned a block at a time. */
+
+#define DX_ROOT_INFO 24 // where dx_root_info starts in block 0 of an indexed directory, after the '.' and '..' entries
+#define DX_NODE_ENTRIES 8 // where the entries start in an index node, after its fake empty dirent
+#define DX_MAX_LEVELS 3
+#define TEA_DELTA 0x9E3779B9
+#define MD4_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MD4_G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define MD4_H(x, y, z) ((x) ^ (y) ^ (z))
+#define MD4_ROUND(f, a, b, c, d, x, s) (a += f(b, c, d) + (x), a = (a << (s)) | (a >> (32-(s))))
+#define MD4_K2 013240474631UL
+#define MD4_K3 015666365641UL
+
+void teaTransform(__u32 buf[4], const __u32 in[4])
+{
+  __u32 sum=0, b0=buf[0], b1=buf[1];
+  for (int n=0; n<16; n++)
+    {
+      sum += TEA_DELTA;
+      b0 += ((b1 << 4)+in[0]) ^ (b1+sum) ^ ((b1 >> 5)+in[1]);
+      b1 += ((b0 << 4)+in[2]) ^ (b0+sum) ^ ((b0 >> 5)+in[3]);
+    }
+  buf[0] += b0;
+  buf[1] += b1;
+}
+
+void halfMD4Transform(__u32 buf[4], const __u32 in[8])
+{
+  __u32 a=buf[0], b=buf[1], c=buf[2], d=buf[3];
+  MD4_ROUND(MD4_F, a, b, c, d, in[0], 3); MD4_ROUND(MD4_F, d, a, b, c, in[1], 7);
+  MD4_ROUND(MD4_F, c, d, a, b, in[2], 11); MD4_ROUND(MD4_F, b, c, d, a, in[3], 19);
+  MD4_ROUND(MD4_F, a, b, c, d, in[4], 3); MD4_ROUND(MD4_F, d, a, b, c, in[5], 7);
+  MD4_ROUND(MD4_F, c, d, a, b, in[6], 11); MD4_ROUND(MD4_F, b, c, d, a, in[7], 19);
+  MD4_ROUND(MD4_G, a, b, c, d, in[1] + MD4_K2, 3); MD4_ROUND(MD4_G, d, a, b, c, in[3] + MD4_K2, 5);
+  MD4_ROUND(MD4_G, c, d, a, b, in[5] + MD4_K2, 9); MD4_ROUND(MD4_G, b, c, d, a, in[7] + MD4_K2, 13);
+  MD4_ROUND(MD4_G, a, b, c, d, in[0] + MD4_K2, 3); MD4_ROUND(MD4_G, d, a, b, c, in[2] + MD4_K2, 5);
+  MD4_ROUND(MD4_G, c, d, a, b, in[4] + MD4_K2, 9); MD4_ROUND(MD4_G, b, c, d, a, in[6] + MD4_K2, 13);
+  MD4_ROUND(MD4_H, a, b, c, d, in[3] + MD4_K3, 3); MD4_ROUND(MD4_H, d, a, b, c, in[7] + MD4_K3, 9);
+  MD4_ROUND(MD4_H, c, d, a, b, in[2] + MD4_K3, 11); MD4_ROUND(MD4_H, b, c, d, a, in[6] + MD4_K3, 15);
+  MD4_ROUND(MD4_H, a, b, c, d, in[1] + MD4_K3, 3); MD4_ROUND(MD4_H, d, a, b, c, in[5] + MD4_K3, 9);
+  MD4_ROUND(MD4_H, c, d, a, b, in[0] + MD4_K3, 11); MD4_ROUND(MD4_H, b, c, d, a, in[4] + MD4_K3, 15);
+  buf[0] += a; buf[1] += b; buf[2] += c; buf[3] += d;
+}
+
+int hashChar(const char* name, int i, int unsignedChars)
+{
+  return unsignedChars ? (int)((const unsigned char*)name)[i] : (int)((const signed char*)name)[i];
+}
+
+void nameToHashBuffer(const char* name, int len, __u32* buf, int num, int unsignedChars)
+{
+  // pack up to num words of the name, padded with its length, as the hash functions take it
+  __u32 pad = (__u32)len | ((__u32)len << 8);
+  pad |= pad << 16;
+  __u32 val = pad;
+  if (len > num*4)
+    len = num*4;
+  for (int i=0; i<len; i++)
+    {
+      val = hashChar(name, i, unsignedChars) + (val << 8);
+      if (i % 4 == 3)
+	{
+	  *buf++ = val;
+	  val = pad;
+	  num--;
+	}
+    }
+  if (--num >= 0)
+    *buf++ = val;
+  while (--num >= 0)
+    *buf++ = pad;
+}
+
+__u32 directoryHash(int version, const char* name, int len)
+{
+  // the htree hash of a name, with the filesystem's seed; -1 (never a real hash, they are even) for unknown versions
+  int unsignedChars = (sb.s_flags & EXT2_FLAGS_UNSIGNED_HASH) != 0;
+  __u32 buf[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 }, in[8], hash;
+  if ( sb.s_hash_seed[0] || sb.s_hash_seed[1] || sb.s_hash_seed[2] || sb.s_hash_seed[3] )
+    memcpy(buf, sb.s_hash_seed, sizeof(buf));
+  if (version == EXT2_HASH_LEGACY)
+    {
+      __u32 hash0=0x12a3fe2d, hash1=0x37abe8f9;
+      for (int i=0; i<len; i++)
+	{
+	  hash = hash1 + (hash0 ^ (hashChar(name, i, unsignedChars) * 7152373));
+	  if (hash & 0x80000000)
+	    hash -= 0x7fffffff;
+	  hash1 = hash0;
+	  hash0 = hash;
+	}
+      hash = hash0 << 1;
+    }
+  else if (version == EXT2_HASH_HALF_MD4)
+    {
+      for (int done=0; done<len; done+=32)
+	{
+	  nameToHashBuffer(name+done, len-done, in, 8, unsignedChars);
+	  halfMD4Transform(buf, in);
+	}
+      hash = buf[1];
+    }
+  else if (version == EXT2_HASH_TEA)
+    {
+      for (int done=0; done<len; done+=16)
+	{
+	  nameToHashBuffer(name+done, len-done, in, 4, unsignedChars);
+	  teaTransform(buf, in);
+	}
+      hash = buf[0];
+    }
+  else
+    return (__u32)-1;
+  return hash & ~1;
+}
+
+int lookupReads=0; // blocks read by the current lookup, index and indirect blocks included
+
+void readLookupBlock(int blockNum, char* buf)
+{
+  if ( pread(fd, buf, blockSize, computeOffset(blockNum)) == -1 )
+    { fprintf(stderr,"Error with pread in lookup\n"); exit(2); }
+  lookupReads++;
+}
+
+void readInode(int inodeNum, struct ext2_inode* inode)
+{
+  // unlike the summary, lookups follow paths into any group, through that group's descriptor
+  struct ext2_group_desc group;
+  int groupNum = (inodeNum-1)/sb.s_inodes_per_group, index = (inodeNum-1)%sb.s_inodes_per_group;
+  if ( pread(fd, &group, sizeof(group), computeOffset(sb.s_first_data_block+1)+groupNum*sizeof(group)) == -1 )
+    { fprintf(stderr,"Error reading group summary!\n"); exit(2); }
+  if ( pread(fd, inode, sizeof(*inode), computeOffset(group.bg_inode_table)+index*sb.s_inode_size) == -1 )
+    { fprintf(stderr,"Error reading inode from inode table!\n"); exit(2); }
+}
+
+int logicalToPhysical(const struct ext2_inode* inode, __u32 logical)
+{
+  // the block holding block number logical of the file, going through its indirect blocks; 0 for a hole
+  __u32 perBlock = blockSize/4, span = 1, blockNum;
+  int level = 0;
+  if (logical < 12)
+    return inode->i_block[logical];
+  logical -= 12;
+  for (level=1; level<=3; level++)
+    {
+      span *= perBlock;
+      if (logical < span)
+	break;
+      logical -= span;
+    }
+  if (level > 3)
+    return 0;
+  blockNum = inode->i_block[11+level];
+  __u32 readIn [perBlock];
+  for (; level>0 && blockNum!=0; level--)
+    {
+      span /= perBlock;
+      readLookupBlock(blockNum, (char*)readIn);
+      blockNum = readIn[(logical/span)%perBlock];
+    }
+  return blockNum;
+}
+
+int searchDirBlock(const char* block, const char* name, int len)
+{
+  // the inode of name if it is in this directory block, else 0
+  struct ext2_dir_entry* dEntry;
+  for (int counter=0, next; counter<blockSize; counter=next)
+    {
+      next = nextDirEntry(block, counter, &dEntry);
+      if ( dEntry != NULL && dEntry->inode != 0 && dEntry->name_len == len && memcmp(dEntry->name, name, len) == 0 )
+	return dEntry->inode;
+    }
+  return 0;
+}
+
+int linearLookup(const struct ext2_inode* dir, const char* name, int len)
+{
+  // look for name in every block of the directory in turn
+  char block [blockSize];
+  __u32 blocks = (dir->i_size + blockSize - 1)/blockSize;
+  for (__u32 b=0; b<blocks; b++)
+    {
+      int blockNum = logicalToPhysical(dir, b), found;
+      if (blockNum == 0)
+	continue;
+      readLookupBlock(blockNum, block);
+      if ( (found = searchDirBlock(block, name, len)) != 0 )
+	return found;
+    }
+  return 0;
+}
+
+int indexedLookup(const struct ext2_inode* dir, const char* name, int len)
+{
+  // look for name through the directory's htree index; -1 if the index can't be used, to scan the directory instead
+  char nodes [DX_MAX_LEVELS][blockSize]; // the root, then the index node at each further level
+  __u32* at [DX_MAX_LEVELS]; // the entry followed at each level, an {hash, block} pair
+  __u32* end [DX_MAX_LEVELS];
+  __u32 blocks = (dir->i_size + blockSize - 1)/blockSize;
+  int rootBlock = logicalToPhysical(dir, 0);
+  if (rootBlock == 0)
+    return -1;
+  readLookupBlock(rootBlock, nodes[0]);
+  __u8 hashVersion = nodes[0][DX_ROOT_INFO+4], infoLength = nodes[0][DX_ROOT_INFO+5], levels = nodes[0][DX_ROOT_INFO+6]+1;
+  __u32 hash = directoryHash(hashVersion, name, len);
+  if ( infoLength != 8 || levels > DX_MAX_LEVELS || hash == (__u32)-1 )
+    return -1;
+
+  __u32 nodeBlock = 0;
+  for (int level=0; level<levels; level++)
+    {
+      int entries = level == 0 ? DX_ROOT_INFO+infoLength : DX_NODE_ENTRIES;
+      if (level > 0)
+	{
+	  int blockNum = logicalToPhysical(dir, nodeBlock);
+	  if (blockNum == 0)
+	    return -1;
+	  readLookupBlock(blockNum, nodes[level]);
+	}
+      __u16* countLimit = (__u16*)(nodes[level]+entries); // limit, count: in place of the first entry's hash
+      __u32* first = (__u32*)(nodes[level]+entries);
+      if ( countLimit[1] == 0 || countLimit[1] > countLimit[0] || entries+countLimit[0]*8 > blockSize )
+	return -1;
+      end[level] = first + 2*countLimit[1];
+      __u32 *p = first+2, *q = end[level]-2; // the last entry whose hash is at most ours (the first has none, it takes the rest)
+      while (p <= q)
+	{
+	  __u32* m = p + 2*((q-p)/4);
+	  if (m[0] > hash)
+	    q = m-2;
+	  else
+	    p = m+2;
+	}
+      at[level] = p-2;
+      nodeBlock = at[level][1] & 0x00ffffff;
+      if (nodeBlock >= blocks)
+	return -1;
+    }
+
+  char leaf [blockSize];
+  while (1)
+    {
+      int blockNum = logicalToPhysical(dir, nodeBlock), found;
+      if (blockNum == 0)
+	return -1;
+      readLookupBlock(blockNum, leaf);
+      if ( (found = searchDirBlock(leaf, name, len)) != 0 )
+	return found;
+      // names with our hash may go on in the next leaf, if its first hash is ours with the collision bit set
+      int level = levels-1;
+      while (level >= 0 && at[level]+2 == end[level])
+	level--;
+      if ( level < 0 || (at[level][2] & 1) == 0 || (at[level][2] & ~1) != hash )
+	return 0;
+      at[level] += 2;
+      for (nodeBlock = at[level][1] & 0x00ffffff; ++level < levels; nodeBlock = at[level][1] & 0x00ffffff)
+	{
+	  int nodeNum = logicalToPhysical(dir, nodeBlock);
+	  if (nodeBlock >= blocks || nodeNum == 0)
+	    return -1;
+	  readLookupBlock(nodeNum, nodes[level]);
+	  __u16* countLimit = (__u16*)(nodes[level]+DX_NODE_ENTRIES);
+	  if ( countLimit[1] == 0 || countLimit[1] > countLimit[0] || DX_NODE_ENTRIES+countLimit[0]*8 > blockSize )
+	    return -1;
+	  at[level] = (__u32*)(nodes[level]+DX_NODE_ENTRIES);
+	  end[level] = at[level] + 2*countLimit[1];
+	}
+      if (nodeBlock >= blocks)
+	return -1;
+    }
+}
+
+int resolvePath(const char* path)
+{
+  // the inode path names, 0 if there is none
+  struct ext2_inode inode;
+  int inodeNum = EXT2_ROOT_INO;
+  lookupReads = 0;
+  for (const char* name=path; *name && inodeNum!=0; )
+    {
+      int len = strcspn(name, "/");
+      if (len == 0)
+	{ name++; continue; }
+      readInode(inodeNum, &inode);
+      if ( (inode.i_mode & 0xF000) != 0x4000 || len > EXT2_NAME_LEN ) // not a directory, or a name no entry can have
+	inodeNum = 0;
+      else
+	{
+	  int found = -1;
+	  if ( (inode.i_flags & EXT2_INDEX_FL) && (sb.s_feature_compat & EXT2_FEATURE_COMPAT_DIR_INDEX) )
+	    found = indexedLookup(&inode, name, len);
+	  inodeNum = found != -1 ? found : linearLookup(&inode, name, len);
+	}
+      name += len;
+    }
+  return inodeNum;
+}
+
+void lookupPath(const char* path)
+{
+  // print the inode path names (0 if there is none) and the blocks read to find it
+  int inodeNum = resolvePath(path);
+  printf("LOOKUP,'%s',%d,%d\n", path, inodeNum, lookupReads);
+}
+
+/* Extraction (--extract=DIR): files are written out to the host from their inodes, either the ones named with
+   --inode (as DIR/<inode>) or everything under --subtree (the root by default), recreated by name with its
+   directories and symlinks. A file's blocks are gathered into runs of blocks contiguous in both the file and the
+   image, and every run is handed to copy_file_range() (or sendfile(), where the kernel won't do that between these
+   two files), so the data goes from the image to the new file without passing through this program. Holes are
+   not written at all: the file is sized up front, and the blocks it has no data for stay unallocated. */
+
+struct blockRun
+{
+  __u32 logical, physical, count; // count blocks of the file from logical on, held from physical on in the image
+};
+
+struct extractTotals
+{
+  int files, directories, symlinks, skipped;
+  long long bytes;
+} extracted;
+
+typedef void (*runVisitor)(const struct blockRun* run, void* arg);
+
+void addBlock(struct blockRun* run, __u32 logical, __u32 physical, runVisitor visit, void* arg)
+{
+  // extend the current run with this block, or pass the run on and start another
+  if ( run->count != 0 && run->logical+run->count == logical && run->physical+run->count == physical )
+    { run->count++; return; }
+  if (run->count != 0)
+    visit(run, arg);
+  run->logical = logical; run->physical = physical; run->count = 1;
+}
+
+void walkIndirect(int blockNum, int indirectionLevel, __u32* logical, __u64 blocks, struct blockRun* run, runVisitor visit, void* arg)
+{
+  // the blocks under an indirect block, the counterpart of computeIndirection() for runs
+  __u32 perBlock = blockSize/4, span = 1;
+  for (int l=1; l<indirectionLevel; l++)
+    span *= perBlock;
+  if (blockNum == 0) // a hole as big as everything it would have held
+    { *logical += span*perBlock; return; }
+  __u32 readIn [perBlock];
+  if ( pread(fd, readIn, blockSize, computeOffset(blockNum)) == -1 )
+    { fprintf(stderr,"Error in pread() while computing indirection!\n"); exit(2); }
+  for (__u32 i=0; i<perBlock && *logical<blocks; i++)
+    {
+      if (indirectionLevel > 1)
+	walkIndirect(readIn[i], indirectionLevel-1, logical, blocks, run, visit, arg);
+      else
+	{
+	  if (readIn[i] != 0)
+	    addBlock(run, *logical, readIn[i], visit, arg);
+	  (*logical)++;
+	}
+    }
+}
+
+__u64 fileSize(const struct ext2_inode* inode)
+{
+  // the size of the file, whose upper 32 bits a regular file keeps in i_dir_acl once the filesystem has large_file
+  __u64 size = inode->i_size;
+  if ( (inode->i_mode & 0xF000) == 0x8000 && (sb.s_feature_ro_compat & EXT2_FEATURE_RO_COMPAT_LARGE_FILE) )
+    size |= (__u64)inode->i_dir_acl << 32;
+  return size;
+}
+
+void walkRuns(const struct ext2_inode* inode, runVisitor visit, void* arg)
+{
+  // call visit for every run of blocks holding the file's data, in file order
+  struct blockRun run = { 0, 0, 0 };
+  __u64 blocks = (fileSize(inode) + blockSize - 1)/blockSize;
+  __u32 logical = 0;
+  for (; logical<12 && logical<blocks; logical++)
+    if (inode->i_block[logical] != 0)
+      addBlock(&run, logical, inode->i_block[logical], visit, arg);
+  for (int level=1; level<=3 && logical<blocks; level++)
+    walkIndirect(inode->i_block[11+level], level, &logical, blocks, &run, visit, arg);
+  if (run.count != 0)
+    visit(&run, arg);
+}
+
+struct copyTarget
+{
+  int out;
+  __u64 size; // the file's size, which the last block may go past
+};
+
+void copyRun(const struct blockRun* run, void* arg)
+{
+  // move the run's data from the image into the file at the same offset, in the kernel
+  struct copyTarget* target = arg;
+  loff_t in = computeOffset(run->physical), out = (loff_t)run->logical*blockSize;
+  long long len = (long long)run->count*blockSize;
+  if ( (__u64)(out+len) > target->size )
+    len = target->size - out;
+  while (len > 0)
+    {
+      ssize_t x = copy_file_range(fd, &in, target->out, &out, len, 0);
+      if ( x == -1 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP) )
+	{
+	  off_t offset = in; // sendfile() writes at the file offset of out, so put it there first
+	  if ( lseek(target->out, out, SEEK_SET) == -1 || (x = sendfile(target->out, fd, &offset, len)) == -1 )
+	    { fprintf(stderr,"Error with sendfile while extracting, with message %s\n", strerror(errno)); exit(2); }
+	  in = offset; out += x;
+	}
+      else if (x == -1)
+	{ fprintf(stderr,"Error with copy_file_range while extracting, with message %s\n", strerror(errno)); exit(2); }
+      if (x == 0) // the image ends early
+	{ fprintf(stderr,"Image ends inside block %u while extracting\n", run->physical); exit(2); }
+      len -= x;
+      extracted.bytes += x;
+    }
+}
+
+void setTimes(int dirFd, const char* name, const struct ext2_inode* inode)
+{
+  struct timespec times [2] = { { inode->i_atime, 0 }, { inode->i_mtime, 0 } };
+  utimensat(dirFd, name, times, AT_SYMLINK_NOFOLLOW);
+}
+
+int createFailed(const char* name, const char* what)
+{
+  // whether creating name failed because the image put something there already (a second entry by that name, a
+  // symlink of its own), which only skips the entry. any other failure is fatal
+  if ( errno == EEXIST || errno == ELOOP || errno == ENOTDIR )
+    { fprintf(stderr,"Skipping %s, which would replace an entry already extracted\n", name); extracted.skipped++; return 1; }
+  fprintf(stderr,"Unable to create %s %s with message %s\n", what, name, strerror(errno));
+  exit(2);
+}
+
+void extractFile(const struct ext2_inode* inode, int dirFd, const char* name)
+{
+  // never through a symlink, and never over anything already there
+  struct copyTarget target = { openat(dirFd, name, O_WRONLY|O_CREAT|O_EXCL|O_NOFOLLOW, inode->i_mode & 0777), fileSize(inode) };
+  if ( target.out == -1 && createFailed(name, "file") )
+    return;
+  if ( ftruncate(target.out, (off_t)target.size) == -1 ) // the full size, holes and all
+    { fprintf(stderr,"Error with ftruncate on %s with message %s\n", name, strerror(errno)); exit(2); }
+  walkRuns(inode, copyRun, &target);
+  close(target.out);
+  setTimes(dirFd, name, inode);
+  extracted.files++;
+}
+
+void extractSymlink(const struct ext2_inode* inode, int dirFd, const char* name)
+{
+  char linkTarget [blockSize+1];
+  __u32 len = inode->i_size < (__u32)blockSize ? inode->i_size : (__u32)blockSize;
+  if ( inode->i_blocks == 0 || inode->i_size < sizeof(inode->i_block) ) // a fast symlink, kept in i_block itself, as the kernel decides it
+    {
+      if (len > sizeof(inode->i_block))
+	len = sizeof(inode->i_block);
+      memcpy(linkTarget, inode->i_block, len);
+    }
+  else if ( pread(fd, linkTarget, len, computeOffset(inode->i_block[0])) == -1 )
+    { fprintf(stderr,"Error with pread while extracting symlink\n"); exit(2); }
+  linkTarget[len] = '\0';
+  if ( symlinkat(linkTarget, dirFd, name) == -1 && createFailed(name, "symlink") )
+    return;
+  setTimes(dirFd, name, inode);
+  extracted.symlinks++;
+}
+
+void extractInode(int inodeNum, int dirFd, const char* name);
+
+unsigned char* extractedDirs; // a bit per inode, set once a directory has been written out, so that a corrupt image's cycles end
+
+void extractDirectoryRun(const struct blockRun* run, void* arg)
+{
+  // the entries of a run of directory blocks, all read at once, created in the directory open on *arg
+  int dirFd = *(int*)arg;
+  char* blocks = malloc((size_t)run->count*blockSize);
+  if (blocks == NULL)
+    { fprintf(stderr,"Memory allocation issue!\n"); exit(2); }
+  if ( pread(fd, blocks, (size_t)run->count*blockSize, computeOffset(run->physical)) == -1 )
+    { fprintf(stderr,"Error with pread in directory check\n"); exit(2); }
+  struct ext2_dir_entry* dEntry;
+  for (__u32 b=0; b<run->count; b++)
+    for (int counter=0, next; counter<blockSize; counter=next)
+      {
+	next = nextDirEntry(blocks+b*blockSize, counter, &dEntry);
+	if ( dEntry == NULL || dEntry->inode == 0 )
+	  continue;
+	int len = dEntry->name_len;
+	if ( (len == 1 && dEntry->name[0] == '.') || (len == 2 && dEntry->name[0] == '.' && dEntry->name[1] == '.') )
+	  continue;
+	if ( memchr(dEntry->name, '/', len) != NULL || memchr(dEntry->name, '\0', len) != NULL ) // would land outside DIR
+	  { extracted.skipped++; continue; }
+	char name [len+1];
+	sprintf(name, "%.*s", len, dEntry->name);
+	extractInode(dEntry->inode, dirFd, name);
+      }
+  free(blocks);
+}
+
+int enterDirectory(int inodeNum)
+{
+  // mark the directory as extracted, 0 if it already was
+  if ( extractedDirs == NULL && (extractedDirs = calloc(sb.s_inodes_count/8+1, 1)) == NULL )
+    { fprintf(stderr,"Memory allocation issue!\n"); exit(2); }
+  if ( extractedDirs[inodeNum/8] & (1 << inodeNum%8) )
+    return 0;
+  extractedDirs[inodeNum/8] |= 1 << inodeNum%8;
+  return 1;
+}
+
+void extractEntries(const struct ext2_inode* inode, int childFd)
+{
+  // write out the directory's entries into childFd, then give it the directory's mode and times
+  walkRuns(inode, extractDirectoryRun, &childFd);
+  struct timespec times [2] = { { inode->i_atime, 0 }, { inode->i_mtime, 0 } };
+  fchmod(childFd, inode->i_mode & 0777);
+  futimens(childFd, times);
+}
+
+void extractInode(int inodeNum, int dirFd, const char* name)
+{
+  // write out one inode as name in the directory open on dirFd, and everything under it if it is a directory. all
+  // of it is created relative to directories opened without following symlinks, so nothing the image supplies can
+  // lead outside DIR
+  struct ext2_inode inode;
+  if ( inodeNum < 1 || (__u32)inodeNum > sb.s_inodes_count )
+    { extracted.skipped++; return; }
+  readInode(inodeNum, &inode);
+  int type = inode.i_mode & 0xF000;
+  if (type == 0x8000)
+    extractFile(&inode, dirFd, name);
+  else if (type == 0xA000)
+    extractSymlink(&inode, dirFd, name);
+  else if (type == 0x4000)
+    {
+      if (!enterDirectory(inodeNum)) // a cycle, or a directory linked twice
+	{ extracted.skipped++; return; }
+      if ( mkdirat(dirFd, name, 0700) == -1 && errno != EEXIST ) // writable until its entries are in
+	{ fprintf(stderr,"Unable to create directory %s with message %s\n", name, strerror(errno)); exit(2); }
+      int childFd = openat(dirFd, name, O_RDONLY|O_DIRECTORY|O_NOFOLLOW); // fails if the image put a symlink there
+      if ( childFd == -1 && createFailed(name, "directory") )
+	return;
+      extracted.directories++;
+      extractEntries(&inode, childFd);
+      close(childFd);
+    }
+  else // devices, fifos and sockets have no data to recover
+    extracted.skipped++;
+}
+
+/* Batch mode: --batch=LIST audits every image named in LIST (one path per line) on a pool of worker processes.
+   Every image goes through two stages, each a child process: the scan, which is this program writing its summary
+   to OUTPUT/<name>.csv, and the audit, fileSystemConsistencyAnalyzer.py writing its findings to OUTPUT/<name>.audit
+   (error messages of both go to OUTPUT/<name>.err).
+   Images are taken largest first, so the long ones don't end up running alone at the end, and a stage is only
+   started while the pool has a free worker (--jobs), fewer than --io scans read images at once, and the memory
+   it is estimated to need fits in what --memory leaves (a stage which doesn't fit still runs once nothing else
+   does). Finished audits are preferred over new scans, since they free their summary's memory estimate. At the
+   end a report gives each image's result and stage times, and the totals. */
+
+#define STAGE_PENDING 0 // states of a batch image
+#define STAGE_SCANNING 1
+#define STAGE_SCANNED 2
+#define STAGE_AUDITING 3
+#define STAGE_DONE 4
+#define SCAN_MEMORY_BASE (1<<20) // the scan process itself
+#define AUDIT_MEMORY_BASE (16<<20) // a python interpreter
+#define AUDIT_MEMORY_FACTOR 16 // the analyzer's memory per byte of summary, roughly, as python lists of rows
+
+struct batchImage
+{
+  char* path;
+  char* name; // of the outputs, the image's file name
+  long long size; // bytes, what scheduling goes by
+  long long memory; // estimate for the stage running now
+  int state;
+  pid_t pid; // of the stage running now
+  struct timespec started;
+  double seconds[2], cpu[2]; // wall and cpu time of the scan and the audit
+  int status[2]; // exit status of each, -1 if it didn't run or was killed
+};
+
+struct batchImage* images;
+int imageCount=0;
+
+double secondsSince(const struct timespec* t)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec - t->tv_sec + (now.tv_nsec - t->tv_nsec)/1e9;
+}
+
+int bySizeDescending(const void* a, const void* b)
+{
+  long long x = ((const struct batchImage*)a)->size, y = ((const struct batchImage*)b)->size;
+  return x < y ? 1 : x > y ? -1 : 0;
+}
+
+void readBatchList(const char* list)
+{
+  // load the image paths in list ("-" for stdin), with their sizes, largest first
+  FILE* f = strcmp(list, "-") == 0 ? stdin : fopen(list, "r");
+  if (f == NULL)
+    { fprintf(stderr,"Unable to open batch list %s\n", list); exit(1); }
+  char line [4096];
+  int slots=0;
+  while ( fgets(line, sizeof(line), f) )
+    {
+      line[strcspn(line, "\r\n")] = '\0';
+      if (line[0] == '\0' || line[0] == '#')
+	continue;
+      if (imageCount == slots)
+	{
+	  slots = slots ? 2*slots : 64;
+	  if ( (images = realloc(images, slots*sizeof(struct batchImage))) == NULL )
+	    { fprintf(stderr,"Memory allocation issue!\n"); exit(2); }
+	}
+      struct batchImage* b = &images[imageCount++];
+      memset(b, 0, sizeof(*b));
+      struct stat st;
+      if ( (b->path = strdup(line)) == NULL )
+	{ fprintf(stderr,"Memory allocation issue!\n"); exit(2); }
+      b->name = strrchr(b->path, '/') ? strrchr(b->path, '/')+1 : b->path;
+      b->size = stat(line, &st) == 0 ? st.st_size : 0; // one which can't be read fails its scan, with the message
+      b->status[0] = b->status[1] = -1;
+    }
+  if (f != stdin)
+    fclose(f);
+  for (int i=0; i<imageCount; i++) // the outputs are named after the images
+    for (int j=0; j<i; j++)
+      if ( strcmp(images[i].name, images[j].name) == 0 )
+	{ fprintf(stderr,"Images %s and %s would share their outputs, rename one\n", images[j].path, images[i].path); exit(1); }
+  qsort(images, imageCount, sizeof(struct batchImage), bySizeDescending);
+}
+
+long long scanMemory(const struct batchImage* b)
+{
+  // the scan holds the whole inode table, and a bitmap or indirect block at a time
+  struct ext2_super_block super;
+  int image = open(b->path, O_RDONLY);
+  if ( image == -1 || pread(image, &super, sizeof(super), 1024) != sizeof(super) || super.s_magic != EXT2_SUPER_MAGIC )
+    super.s_inodes_count = 0; // the scan will fail, and say why
+  if (image != -1)
+    close(image);
+  return SCAN_MEMORY_BASE + (long long)super.s_inodes_count*sizeof(struct ext2_inode);
+}
+
+pid_t startStage(struct batchImage* b, const char* outputDir, const char* analyzer)
+{
+  // fork the image's next stage with its stdout going to its output file, and its stderr to the image's .err
+  char out [4096], summary [4096], errors [4096];
+  snprintf(summary, sizeof(summary), "%s/%s.csv", outputDir, b->name);
+  snprintf(out, sizeof(out), "%s/%s.audit", outputDir, b->name);
+  snprintf(errors, sizeof(errors), "%s/%s.err", outputDir, b->name);
+  int scan = b->state == STAGE_PENDING;
+  fflush(stdout); // or the child would write our buffered report too
+  pid_t pid = fork();
+  if (pid == -1)
+    { fprintf(stderr,"Fork failure in batch mode\n"); exit(2); }
+  if (pid == 0)
+    {
+      int file = open(scan ? summary : out, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+      if ( file == -1 || dup2(file, 1) == -1 )
+	{ fprintf(stderr,"Unable to create %s\n", scan ? summary : out); exit(1); }
+      close(file);
+      file = open(errors, O_WRONLY|O_CREAT|O_APPEND|(scan ? O_TRUNC : 0), 0644); // the scan starts it afresh
+      if ( file == -1 || dup2(file, 2) == -1 )
+	{ fprintf(stderr,"Unable to create %s\n", errors); exit(1); }
+      close(file);
+      if (scan)
+	{
+	  interpretImage(b->path);
+	  exit(0);
+	}
+      execlp("python3", "python3", analyzer, summary, (char*)NULL);
+      fprintf(stderr,"Unable to run %s\n", analyzer);
+      _exit(1);
+    }
+  b->state = scan ? STAGE_SCANNING : STAGE_AUDITING;
+  b->pid = pid;
+  clock_gettime(CLOCK_MONOTONIC, &b->started);
+  return pid;
+}
+
+void printBatchReport(double wall)
+{
+  // every image's result and stage times, then the totals
+  double stageTotal=0;
+  long long bytes=0;
+  int failed=0, inconsistent=0;
+  printf("%-32s %12s %9s %9s %9s %9s  %s\n", "image", "bytes", "scan s", "cpu s", "audit s", "cpu s", "result");
+  for (int i=0; i<imageCount; i++)
+    {
+      struct batchImage* b = &images[i];
+      const char* result = b->status[0] != 0 ? "scan failed" : b->status[1] == 0 ? "consistent" : b->status[1] == 2 ? "inconsistent" : "audit failed";
+      failed += b->status[0] != 0 || (b->status[1] != 0 && b->status[1] != 2);
+      inconsistent += b->status[0] == 0 && b->status[1] == 2;
+      stageTotal += b->seconds[0] + b->seconds[1];
+      bytes += b->size;
+      printf("%-32s %12lld %9.3f %9.3f %9.3f %9.3f  %s\n", b->name, b->size, b->seconds[0], b->cpu[0], b->seconds[1], b->cpu[1], result);
+    }
+  printf("%d images, %d consistent, %d inconsistent, %d failed\n", imageCount, imageCount-inconsistent-failed, inconsistent, failed);
+  printf("wall %.3f s, stages %.3f s (%.1fx in parallel), %.1f MB/s of images\n", wall, stageTotal, wall > 0 ? stageTotal/wall : 0, wall > 0 ? bytes/wall/1e6 : 0);
+}
+
+int runBatch(const char* list, const char* outputDir, const char* analyzer, int jobs, int ioJobs, long long memoryCap)
+{
+  // schedule every image's scan and audit on the pool, returning 0 if all images were consistent, 2 if any wasn't,
+  // 1 if any stage failed
+  readBatchList(list);
+  if ( mkdir(outputDir, 0755) == -1 && errno != EEXIST )
+    { fprintf(stderr,"Unable to create %s\n", outputDir); exit(1); }
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  int running=0, scanning=0, done=0;
+  long long memory=0;
+  while (done < imageCount)
+    {
+      for (int pass=0; pass<2; pass++) // audits first, then scans, largest first in both
+	for (int i=0; i<imageCount && running<jobs; i++)
+	  {
+	    struct batchImage* b = &images[i];
+	    if ( b->state != (pass == 0 ? STAGE_SCANNED : STAGE_PENDING) || (pass == 1 && scanning >= ioJobs) )
+	      continue;
+	    if (pass == 0) // the summary is there now, so the audit can be sized by it
+	      {
+		char summary [4096];
+		struct stat st;
+		snprintf(summary, sizeof(summary), "%s/%s.csv", outputDir, b->name);
+		b->memory = AUDIT_MEMORY_BASE + (stat(summary, &st) == 0 ? (long long)st.st_size*AUDIT_MEMORY_FACTOR : 0);
+	      }
+	    else
+	      b->memory = scanMemory(b);
+	    if ( memoryCap > 0 && running > 0 && memory + b->memory > memoryCap )
+	      continue; // a smaller one may still fit
+	    startStage(b, outputDir, analyzer);
+	    running++;
+	    scanning += pass == 1;
+	    memory += b->memory;
+	  }
+
+      int status;
+      struct rusage usage;
+      pid_t pid = wait4(-1, &status, 0, &usage);
+      if (pid == -1)
+	{ fprintf(stderr,"wait4() failure in batch mode\n"); exit(2); }
+      for (int i=0; i<imageCount; i++)
+	if ( images[i].pid == pid && (images[i].state == STAGE_SCANNING || images[i].state == STAGE_AUDITING) )
+	  {
+	    struct batchImage* b = &images[i];
+	    int stage = b->state == STAGE_AUDITING;
+	    b->seconds[stage] = secondsSince(&b->started);
+	    b->cpu[stage] = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec)/1e6;
+	    b->status[stage] = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+	    running--;
+	    scanning -= !stage;
+	    memory -= b->memory;
+	    b->state = stage == 0 && b->status[0] == 0 ? STAGE_SCANNED : STAGE_DONE;
+	    done += b->state == STAGE_DONE;
+	    break;
+	  }
+    }
+
+  printBatchReport(secondsSince(&start));
+  int result=0;
+  for (int i=0; i<imageCount; i++)
+    {
+      if ( images[i].status[0] != 0 || (images[i].status[1] != 0 && images[i].status[1] != 2) )
+	result = 1;
+      else if ( images[i].status[1] == 2 && result == 0 )
+	result = 2;
+      free(images[i].path);
+    }
+  free(images);
+  return result;
+}
+
+int main(int argc,  char *argv[] )
+{
+  static struct option long_options[] = {
+    {"batch", required_argument, 0, 'b'}, // file listing images to audit, one per line ("-" for stdin), see runBatch()
+    {"output", required_argument, 0, 'o'}, // directory for every image's summary and audit
+    {"jobs", required_argument, 0, 'j'}, // worker processes, by default one per cpu
+    {"io", required_argument, 0, 'i'}, // scans reading images at once, by default as many as --jobs
+    {"memory", required_argument, 0, 'm'}, // bytes the running stages may be estimated to need, by default half the ram
+    {"analyzer", required_argument, 0, 'a'}, // the consistency analyzer, by default the one next to this program
+    {"lookup", required_argument, 0, 'l'}, // instead of the summary, find the inode of this path, see lookupPath()
+    {"extract", required_argument, 0, 'x'}, // instead of the summary, write files out under this directory
+    {"inode", required_argument, 0, 'n'}, // with --extract, an inode to write out as DIR/<inode>, may be repeated
+    {"subtree", required_argument, 0, 's'}, // with --extract, the path to write out the tree under, by default the root
+    {0,0,0,0}
+  };
+  char* batchList=NULL; char* outputDir=NULL; char* analyzer=NULL; char* lookup=NULL; char* extractDir=NULL; char* subtree=NULL;
+  int* inodes = malloc(argc*sizeof(int)); int inodeCount=0;
+  int jobs = sysconf(_SC_NPROCESSORS_ONLN), ioJobs=0;
+  long long memoryCap = (long long)sysconf(_SC_PHYS_PAGES)*sysconf(_SC_PAGESIZE)/2;
+  int in;
+  while ( ( in = getopt_long(argc, argv, "", long_options, NULL) ) != -1 )
+    {
+      if (in == 'b')
+	batchList=optarg;
+      else if (in == 'o')
+	outputDir=optarg;
+      else if (in == 'j')
+	jobs=atoi(optarg);
+      else if (in == 'i')
+	ioJobs=atoi(optarg);
+      else if (in == 'm')
+	memoryCap=atoll(optarg);
+      else if (in == 'a')
+	analyzer=optarg;
+      else if (in == 'l')
+	lookup=optarg;
+      else if (in == 'x')
+	extractDir=optarg;
+      else if (in == 'n')
+	inodes[inodeCount++]=atoi(optarg);
+      else if (in == 's')
+	subtree=optarg;
+      else
+	{ fprintf(stderr,"Invalid input arguments!\n"); exit(1); }
+    }
+
+  if (batchList != NULL)
+    {
+      if ( outputDir == NULL || optind != argc || jobs < 1 || ioJobs < 0 || memoryCap < 0 )
+	{ fprintf(stderr,"Usage: %s --batch=LIST --output=DIR [--jobs=N] [--io=N] [--memory=BYTES] [--analyzer=PATH]\n", argv[0]); exit(1); }
+      char defaultAnalyzer [4096];
+      if (analyzer == NULL) // next to us
+	{
+	  const char* slash = strrchr(argv[0], '/');
+	  snprintf(defaultAnalyzer, sizeof(defaultAnalyzer), "%.*sfileSystemConsistencyAnalyzer.py", slash ? (int)(slash-argv[0]+1) : 0, argv[0]);
+	  analyzer = defaultAnalyzer;
+	}
+      exit( runBatch(batchList, outputDir, analyzer, jobs, ioJobs ? ioJobs : jobs, memoryCap) );
+    }
+
+  if ( optind != argc-1 || argv[optind]==NULL ) // we want exactly one input argument, and that should be the name of the file containing the file system image
+    { fprintf(stderr,"Invalid input arguments!\n"); exit(1); }
+  if ( lookup != NULL || extractDir != NULL )
+    {
+      fd = open(argv[optind], O_RDONLY);
+      if ( fd == -1 )
+	{ fprintf(stderr,"Unable to open specified file\n"); exit(1); }
+      readSuperblock();
+      readGroup();
+      if (lookup != NULL)
+	lookupPath(lookup);
+      if (extractDir != NULL)
+	{
+	  if ( mkdir(extractDir, 0755) == -1 && errno != EEXIST )
+	    { fprintf(stderr,"Unable to create directory %s with message %s\n", extractDir, strerror(errno)); exit(1); }
+	  int dirFd = open(extractDir, O_RDONLY|O_DIRECTORY);
+	  if (dirFd == -1)
+	    { fprintf(stderr,"Unable to open directory %s with message %s\n", extractDir, strerror(errno)); exit(1); }
+	  for (int i=0; i<inodeCount; i++)
+	    {
+	      char name [16];
+	      sprintf(name, "%d", inodes[i]);
+	      extractInode(inodes[i], dirFd, name);
+	    }
+	  if ( inodeCount == 0 || subtree != NULL )
+	    {
+	      int inodeNum = resolvePath(subtree ? subtree : "/");
+	      struct ext2_inode inode;
+	      if (inodeNum == 0)
+		{ fprintf(stderr,"No such path %s in the image\n", subtree); exit(1); }
+	      readInode(inodeNum, &inode);
+	      const char* slash = strrchr(subtree ? subtree : "/", '/');
+	      if ( (inode.i_mode & 0xF000) == 0x4000 ) // its entries go straight into DIR
+		{
+		  if (enterDirectory(inodeNum))
+		    {
+		      extracted.directories++;
+		      extractEntries(&inode, dirFd);
+		    }
+		}
+	      else // a single file, DIR/<its name>
+		extractInode(inodeNum, dirFd, slash ? slash+1 : subtree);
+	    }
+	  close(dirFd);
+	  printf("EXTRACTED,%d,%d,%d,%d,%lld\n", extracted.files, extracted.directories, extracted.symlinks, extracted.skipped, extracted.bytes);
+	}
+      exit(0);
+    }
+  interpretImage(argv[optind]);
   exit(0); 
 }
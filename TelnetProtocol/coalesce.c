@@ -0,0 +1,91 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Implementation of the phase switching declared in coalesce.h. The socket options only change when the phase does,
+so a connection which stays in one phase costs a comparison per read and nothing else.
+
+*/
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "coalesce.h"
+
+static int setOption(int fd, int option, int value)
+{
+  if ( setsockopt(fd, IPPROTO_TCP, option, &value, sizeof(value)) == -1 && errno != EOPNOTSUPP ) // a same-host socket (local.h) has no Nagle
+    return -1;
+  return 0;
+}
+
+static long msSince(const struct timespec* t)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - t->tv_sec)*1000 + (now.tv_nsec - t->tv_nsec)/1000000;
+}
+
+int coalesceNoDelay(int fd)
+{
+  // turn Nagle off, for a side of the connection which only ever sends keystrokes and small control messages
+  return setOption(fd, TCP_NODELAY, 1);
+}
+
+int coalesceInit(struct coalescer* c, int fd, int mode)
+{
+  // start out interactive. -1 with errno set if the socket wouldn't take the option
+  c->fd = -1;
+  c->corked = c->streak = 0;
+  if (mode == COALESCE_OFF)
+    return 0;
+  int on = 1;
+  if ( setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) == -1 )
+    return errno == EOPNOTSUPP ? 0 : -1; // not tcp, stays off
+  c->fd = fd;
+  return 0;
+}
+
+int coalesceOutput(struct coalescer* c, int len)
+{
+  // output which was read in one go of len bytes is about to be written. returns 1 if that corked the socket
+  if (c->fd == -1)
+    return 0;
+  c->streak = len >= COALESCE_BULK_READ ? c->streak + 1 : 0;
+  if (c->corked)
+    clock_gettime(CLOCK_MONOTONIC, &c->lastOutput);
+  else if ( c->streak >= COALESCE_BULK_STREAK && setOption(c->fd, TCP_CORK, 1) == 0 )
+    {
+      c->corked = 1;
+      clock_gettime(CLOCK_MONOTONIC, &c->lastOutput);
+      return 1;
+    }
+  return 0;
+}
+
+void coalesceInput(struct coalescer* c)
+{
+  // the peer sent something: back to interactive, pushing out what the cork holds
+  c->streak = 0;
+  if (c->corked && setOption(c->fd, TCP_CORK, 0) == 0)
+    c->corked = 0;
+}
+
+int coalesceTimeout(const struct coalescer* c)
+{
+  // ms until coalesceCheck() should push out the corked tail, -1 while there is nothing to push
+  if (!c->corked)
+    return -1;
+  long left = COALESCE_FLUSH_MS - msSince(&c->lastOutput);
+  return left > 0 ? left : 0;
+}
+
+void coalesceCheck(struct coalescer* c)
+{
+  // after a round of the poll loop: output which stopped growing goes out, and the phase is interactive again
+  if ( c->corked && coalesceTimeout(c) == 0 )
+    coalesceInput(c);
+}
@@ -0,0 +1,51 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Adaptive coalescing of what goes out on a tcp connection, used by part2Server.c for its clients (part2Client.c
+and loadGenerator.c only ever send keystrokes, and just turn Nagle off with coalesceNoDelay()). With the kernel's defaults, Nagle holds a small write back
+while an earlier one is unacknowledged, and the peer delays its acks, so an echo or a short reply can sit for tens
+of milliseconds; while bulk output read off a pipe a few KB at a time goes out as whatever segments each write
+happens to make. So a connection is in one of two phases:
+
+	interactive:	TCP_NODELAY, every write goes out at once. The default, and where the connection goes back
+			to whenever the peer sends something (a keystroke wants its answer now).
+	bulk:		TCP_CORK, after COALESCE_BULK_STREAK reads of at least COALESCE_BULK_READ bytes in a row. The
+			kernel only sends full segments, and the tail is pushed out once the output stops growing
+			for COALESCE_FLUSH_MS (the caller's poll timeout, see coalesceTimeout()), rather than after
+			the kernel's own 200 ms.
+
+Same-host UNIX sockets (local.h) have no segments to fill, so none of this applies to them.
+
+*/
+
+#ifndef COALESCE_H
+#define COALESCE_H
+
+#include <time.h>
+
+#define COALESCE_BULK_READ 2048 // output read in one go which is at least this much is bulk
+#define COALESCE_BULK_STREAK 2 // bulk reads in a row before the socket is corked
+#define COALESCE_FLUSH_MS 2 // corked output which hasn't grown for this long is pushed out
+
+#define COALESCE_OFF 0 // --coalesce: leave the kernel's defaults alone
+#define COALESCE_ADAPTIVE 1
+
+struct coalescer
+{
+  int fd; // -1 if the connection isn't tcp, or coalescing is off
+  int corked;
+  int streak; // bulk reads in a row
+  struct timespec lastOutput; // while corked, when output was last added
+};
+
+int coalesceNoDelay(int fd);
+int coalesceInit(struct coalescer* c, int fd, int mode);
+int coalesceOutput(struct coalescer* c, int len);
+void coalesceInput(struct coalescer* c);
+int coalesceTimeout(const struct coalescer* c);
+void coalesceCheck(struct coalescer* c);
+
+#endif
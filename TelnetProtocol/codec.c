@@ -0,0 +1,776 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Implementation of the codec interface in codec.h: the none/zlib/lz codec tables, parsing of --compress
+arguments, the connect time handshake, framing of encoded data, and the memory pool behind zlib's zalloc/zfree.
+Functions return -1 on failure and leave reporting (and exiting) to the calling program, since client and
+server each have their own exit procedures.
+
+*/
+
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include "codec.h"
+#include "lz.h"
+
+#define HELLO_VERSION 7
+#define POOL_CLASSES 16 // distinct block sizes the pool recycles; zlib only ever asks for a handful
+
+/* pool: every block carries a header with its size, and freed blocks are kept on a free list per size, so
+   that a session starting up after another one went idle reuses its memory instead of going to malloc */
+
+union blockHeader
+{
+  struct { size_t size; union blockHeader* next; } h;
+  max_align_t align;
+};
+
+static struct { size_t size; union blockHeader* free; } poolClasses[POOL_CLASSES];
+static struct codecPoolStats poolStats;
+
+static void* poolAlloc(struct codecSession* s, size_t bytes)
+{
+  union blockHeader* b = NULL;
+  poolStats.allocations++;
+  for (int i=0; i<POOL_CLASSES; i++)
+    if (poolClasses[i].size == bytes && poolClasses[i].free != NULL)
+      {
+	b = poolClasses[i].free;
+	poolClasses[i].free = b->h.next;
+	poolStats.cached -= bytes;
+	poolStats.reuses++;
+	break;
+      }
+  if (b == NULL && (b = malloc(sizeof(union blockHeader) + bytes)) == NULL)
+    return NULL;
+  b->h.size = bytes;
+  s->memory += bytes;
+  poolStats.inUse += bytes;
+  return b+1;
+}
+
+static void poolFree(struct codecSession* s, void* address)
+{
+  union blockHeader* b = (union blockHeader*)address - 1;
+  size_t bytes = b->h.size;
+  s->memory -= bytes;
+  poolStats.inUse -= bytes;
+  if (poolStats.cached + (long)bytes <= POOL_CACHE_MAX)
+    for (int i=0; i<POOL_CLASSES; i++)
+      if (poolClasses[i].size == bytes || (poolClasses[i].size == 0 && poolClasses[i].free == NULL))
+	{
+	  poolClasses[i].size = bytes;
+	  b->h.next = poolClasses[i].free;
+	  poolClasses[i].free = b;
+	  poolStats.cached += bytes;
+	  return;
+	}
+  free(b);
+}
+
+static voidpf zlibAlloc(voidpf opaque, uInt items, uInt size)
+{
+  struct codecSession* s = opaque;
+  long zlibMemory = s->memory - (s->pending != NULL ? PENDING_SIZE : 0);
+  if (s->memoryCap > 0 && zlibMemory + (long)items*size > s->memoryCap)
+    return Z_NULL;
+  return poolAlloc(s, (size_t)items*size);
+}
+
+static void zlibFree(voidpf opaque, voidpf address)
+{
+  poolFree((struct codecSession*)opaque, address);
+}
+
+void codecGetPoolStats(struct codecPoolStats* stats)
+{
+  *stats = poolStats;
+}
+
+/* none: bytes are passed through as is */
+
+static int noneInit(struct codecSession* s)
+{
+  (void)s;
+  return 0;
+}
+
+static int noneCopy(struct codecSession* s, const char* in, int len, char* out, int cap)
+{
+  (void)s;
+  if (len > cap) return -1;
+  memcpy(out, in, len);
+  return len;
+}
+
+static int noneReleaseEncoder(struct codecSession* s)
+{
+  (void)s;
+  return 0;
+}
+
+static void noneEnd(struct codecSession* s)
+{
+  (void)s;
+}
+
+/* zlib: one deflate and one inflate stream per connection, flushed at the end of every frame. The streams are
+   raw deflate: the handshake already identifies the dictionary, which is all the zlib header would add, and
+   raw streams can have their dictionary set right away instead of after inflate() asks for it. Each stream
+   is only initialized when it is first needed, and again after it was released for being idle */
+
+static void zlibPrepare(struct codecSession* s, z_stream* z)
+{
+  memset(z, 0, sizeof(*z));
+  z->zalloc = zlibAlloc; // internal state comes out of the pool, charged to this session
+  z->zfree = zlibFree;
+  z->opaque = s;
+}
+
+static int zlibOpenDeflater(struct codecSession* s)
+{
+  zlibPrepare(s, &s->deflater);
+  if ( deflateInit2(&s->deflater, s->level, Z_DEFLATED, -s->windowBits, s->memLevel, Z_DEFAULT_STRATEGY) != Z_OK )
+    return -1;
+  if ( s->dict != NULL && deflateSetDictionary(&s->deflater, (const Bytef *)s->dict->data, s->dict->len) != Z_OK )
+    { deflateEnd(&s->deflater); return -1; } // stream starts out as if it had just processed the dictionary
+  s->deflaterLive = 1;
+  return 0;
+}
+
+static int zlibOpenInflater(struct codecSession* s)
+{
+  zlibPrepare(s, &s->inflater);
+  if ( inflateInit2(&s->inflater, -s->windowBits) != Z_OK )
+    return -1;
+  if ( s->dict != NULL && inflateSetDictionary(&s->inflater, (const Bytef *)s->dict->data, s->dict->len) != Z_OK )
+    { inflateEnd(&s->inflater); return -1; }
+  s->inflaterLive = 1;
+  return 0;
+}
+
+static int zlibInit(struct codecSession* s)
+{
+  s->deflaterLive = s->inflaterLive = 0; // nothing is allocated until the first compressed frame
+  return 0;
+}
+
+static int zlibEncode(struct codecSession* s, const char* in, int len, char* out, int cap)
+{
+  if ( !s->deflaterLive && zlibOpenDeflater(s) == -1 )
+    return -1;
+  s->deflater.next_in = (Bytef *)in;
+  s->deflater.avail_in = (uInt)len;
+  s->deflater.next_out = (Bytef *)out;
+  s->deflater.avail_out = (uInt)cap;
+  if ( deflate(&s->deflater, Z_SYNC_FLUSH) == Z_STREAM_ERROR ) // sync flush so the peer can decode everything in this frame right away
+    return -1;
+  if (s->deflater.avail_in > 0 || s->deflater.avail_out == 0) // ran out of room in out
+    return -1;
+  return cap - s->deflater.avail_out;
+}
+
+static int zlibDecode(struct codecSession* s, const char* in, int len, char* out, int cap)
+{
+  if ( !s->inflaterLive && zlibOpenInflater(s) == -1 )
+    return -1;
+  s->inflater.next_in = (Bytef *)in;
+  s->inflater.avail_in = (uInt)len;
+  s->inflater.next_out = (Bytef *)out;
+  s->inflater.avail_out = (uInt)cap;
+  while (s->inflater.avail_in > 0)
+    {
+      int ret = inflate(&s->inflater, Z_SYNC_FLUSH);
+      if (ret != Z_OK && ret != Z_BUF_ERROR)
+	return -1;
+      if (s->inflater.avail_out == 0 && s->inflater.avail_in > 0) // frame expands past what the peer may send
+	return -1;
+    }
+  return cap - s->inflater.avail_out;
+}
+
+static int zlibReleaseEncoder(struct codecSession* s)
+{
+  if (!s->deflaterLive)
+    return 0;
+  deflateEnd(&s->deflater);
+  s->deflaterLive = 0;
+  return 1;
+}
+
+static void zlibReleaseDecoder(struct codecSession* s)
+{
+  if (s->inflaterLive)
+    inflateEnd(&s->inflater);
+  s->inflaterLive = 0;
+}
+
+static void zlibEnd(struct codecSession* s)
+{
+  zlibReleaseEncoder(s);
+  zlibReleaseDecoder(s);
+}
+
+/* lz: every frame is an independent block, which may refer back into the dictionary */
+
+static int lzEncode(struct codecSession* s, const char* in, int len, char* out, int cap)
+{
+  return lzCompress(in, len, out, cap, s->dict ? &s->dict->lz : NULL);
+}
+
+static int lzDecode(struct codecSession* s, const char* in, int len, char* out, int cap)
+{
+  return lzDecompress(in, len, out, cap, s->dict ? &s->dict->lz : NULL);
+}
+
+static const struct codec codecs[CODEC_COUNT] = {
+  { "none", CODEC_NONE, 1, noneInit, noneCopy, noneCopy, noneReleaseEncoder, noneEnd, noneEnd },
+  { "zlib", CODEC_ZLIB, 0, zlibInit, zlibEncode, zlibDecode, zlibReleaseEncoder, zlibReleaseDecoder, zlibEnd },
+  { "lz", CODEC_LZ, 1, noneInit, lzEncode, lzDecode, noneReleaseEncoder, noneEnd, noneEnd }
+};
+
+const struct codec* codecFind(int id)
+{
+  if (id < 0 || id >= CODEC_COUNT)
+    return NULL;
+  return &codecs[id];
+}
+
+static int findByName(const char* name, int nameLen)
+{
+  for (int i=0; i<CODEC_COUNT; i++)
+    if ( (int)strlen(codecs[i].name) == nameLen && strncmp(codecs[i].name, name, nameLen) == 0 )
+      return i;
+  return -1;
+}
+
+int codecParseSpec(const char* text, struct codecSpec* spec)
+{
+  // parse a client --compress argument: "interactive", "bulk", or a codec name with an optional ":level"
+  spec->id = CODEC_ZLIB;
+  spec->level = Z_DEFAULT_COMPRESSION;
+  spec->profile = PROFILE_DEFAULT;
+  spec->dictId = 0;
+  spec->windowBits = WINDOW_BITS_MAX;
+  spec->memLevel = MEM_LEVEL_DEFAULT;
+  spec->idleSeconds = 0;
+  if (text == NULL) // bare --compress keeps its original meaning, zlib at the default level
+    return 0;
+  if (strcmp(text, "interactive") == 0 || strcmp(text, "bulk") == 0)
+    {
+      spec->id = CODEC_AUTO;
+      spec->profile = text[0]=='i' ? PROFILE_INTERACTIVE : PROFILE_BULK;
+      return 0;
+    }
+
+  const char* colon = strchr(text, ':');
+  int nameLen = colon ? (int)(colon-text) : (int)strlen(text);
+  if ( (spec->id = findByName(text, nameLen)) < 0 )
+    return -1;
+  if (colon)
+    {
+      char* end;
+      long level = strtol(colon+1, &end, 10);
+      if (spec->id != CODEC_ZLIB || *end != '\0' || end == colon+1 || level < 0 || level > 9)
+	return -1;
+      spec->level = (int)level;
+    }
+  return 0;
+}
+
+int codecParseAllowed(const char* text, unsigned* allowed)
+{
+  // parse a server --compress argument: a comma separated list of codecs the server will agree to
+  if (text == NULL)
+    { *allowed = CODEC_ALL; return 0; }
+  *allowed = 1<<CODEC_NONE; // a peer can always fall back to no compression
+  while (*text)
+    {
+      int nameLen = strcspn(text, ",");
+      int id = findByName(text, nameLen);
+      if (id < 0)
+	return -1;
+      *allowed |= 1u<<id;
+      text += nameLen + (text[nameLen] == ',');
+    }
+  return 0;
+}
+
+int codecLoadDictionary(const char* path, struct codecDictionary* dict)
+{
+  // read a preset dictionary file; only its last DICT_MAX bytes can ever be used, so only those are kept
+  int fd = open(path, O_RDONLY);
+  if (fd == -1)
+    return -1;
+  off_t size = lseek(fd, 0, SEEK_END);
+  if ( size == -1 || lseek(fd, size > DICT_MAX ? size-DICT_MAX : 0, SEEK_SET) == -1 )
+    { close(fd); return -1; }
+
+  dict->len = 0;
+  int x = 0;
+  while ( dict->len < DICT_MAX && (x = read(fd, dict->data+dict->len, DICT_MAX-dict->len)) > 0 )
+    dict->len += x;
+  close(fd);
+  if (x == -1)
+    return -1;
+  if (dict->len == 0)
+    { errno = EINVAL; return -1; }
+
+  dict->id = adler32(adler32(0L, Z_NULL, 0), (const Bytef *)dict->data, dict->len);
+  if (dict->id == 0) // 0 means "no dictionary" in the handshake
+    dict->id = 1;
+  lzLoadDictionary(&dict->lz, dict->data, dict->len);
+  return 0;
+}
+
+static int readFull(int fd, void* buf, int count)
+{
+  // blocking read of exactly count bytes, used only during the handshake
+  for (int done=0; done<count; )
+    {
+      int x = read(fd, (char*)buf+done, count-done);
+      if (x == 0)
+	{ errno = ECONNRESET; return -1; }
+      if (x == -1)
+	{ if (errno == EINTR) continue; return -1; }
+      done += x;
+    }
+  return count;
+}
+
+static int writeFull(int fd, const void* buf, int count)
+{
+  for (int done=0; done<count; )
+    {
+      int x = write(fd, (const char*)buf+done, count-done);
+      if (x == -1)
+	{ if (errno == EINTR) continue; return -1; }
+      done += x;
+    }
+  return count;
+}
+
+static void packHello(unsigned char* hello, const struct codecSpec* spec)
+{
+  hello[0] = 'T';
+  hello[1] = 'N';
+  hello[2] = HELLO_VERSION;
+  hello[3] = (unsigned char)spec->id;
+  hello[4] = (unsigned char)(signed char)spec->level; // Z_DEFAULT_COMPRESSION travels as 0xff
+  hello[5] = (unsigned char)spec->profile;
+  for (int i=0; i<4; i++) // dictionary id, big endian
+    hello[6+i] = (unsigned char)(spec->dictId >> (24-8*i));
+  hello[10] = (unsigned char)spec->windowBits;
+  hello[11] = (unsigned char)spec->memLevel;
+  hello[12] = (unsigned char)(spec->idleSeconds >> 8);
+  hello[13] = (unsigned char)(spec->idleSeconds & 0xff);
+  hello[14] = (unsigned char)(spec->mux | spec->echo << 1);
+  for (int i=0; i<4; i++) // shell to watch, big endian
+    hello[15+i] = (unsigned char)(spec->watch >> (24-8*i));
+  for (int i=0; i<4; i++) // session to resume, big endian
+    hello[19+i] = (unsigned char)(spec->resume >> (24-8*i));
+  for (int i=0; i<8; i++) // output offset, big endian
+    hello[23+i] = (unsigned char)(spec->offset >> (56-8*i));
+}
+
+static int unpackHello(const unsigned char* hello, struct codecSpec* spec)
+{
+  if (hello[0] != 'T' || hello[1] != 'N' || hello[2] != HELLO_VERSION)
+    { errno = EPROTO; return -1; }
+  spec->id = hello[3];
+  spec->level = (signed char)hello[4];
+  spec->profile = hello[5];
+  spec->dictId = 0;
+  for (int i=0; i<4; i++)
+    spec->dictId = (spec->dictId << 8) | hello[6+i];
+  spec->windowBits = hello[10];
+  spec->memLevel = hello[11];
+  spec->idleSeconds = (hello[12] << 8) | hello[13];
+  spec->mux = hello[14] & 1;
+  spec->echo = hello[14] >> 1;
+  spec->watch = 0;
+  for (int i=0; i<4; i++)
+    spec->watch = (spec->watch << 8) | hello[15+i];
+  spec->resume = 0;
+  for (int i=0; i<4; i++)
+    spec->resume = (spec->resume << 8) | hello[19+i];
+  spec->offset = 0;
+  for (int i=0; i<8; i++)
+    spec->offset = (spec->offset << 8) | hello[23+i];
+  if (spec->echo > 1 || (spec->mux && spec->echo) || (spec->watch && (spec->mux || spec->echo)) || spec->windowBits < WINDOW_BITS_MIN || spec->windowBits > WINDOW_BITS_MAX || spec->memLevel < MEM_LEVEL_MIN || spec->memLevel > MEM_LEVEL_MAX)
+    { errno = EPROTO; return -1; }
+  return 0;
+}
+
+int codecHandshakeClient(int fd, const struct codecSpec* want, struct codecSpec* agreed)
+{
+  unsigned char hello [HELLO_SIZE];
+  packHello(hello, want);
+  if ( writeFull(fd, hello, HELLO_SIZE) == -1 || readFull(fd, hello, HELLO_SIZE) == -1 )
+    return -1;
+  if ( unpackHello(hello, agreed) == -1 )
+    return -1;
+  if ( codecFind(agreed->id) == NULL ) // server must settle on a concrete codec
+    { errno = EPROTO; return -1; }
+  if ( agreed->dictId != 0 && agreed->dictId != want->dictId ) // and can only agree to our own dictionary
+    { errno = EPROTO; return -1; }
+  if ( agreed->windowBits > want->windowBits || agreed->memLevel > want->memLevel ) // and never to more memory than we offered
+    { errno = EPROTO; return -1; }
+  if ( agreed->mux != want->mux || agreed->echo != want->echo || agreed->watch != want->watch )
+    { errno = EPROTO; return -1; }
+  return 0;
+}
+
+static void chooseCodec(const struct codecSpec* asked, unsigned allowed, struct codecSpec* agreed)
+{
+  // the server's policy: honour the client if it can, resolve profiles, and fall back to zlib and then none
+  *agreed = *asked;
+  if (asked->id == CODEC_AUTO)
+    {
+      if (asked->profile == PROFILE_INTERACTIVE) // tiny frames, so per frame overhead is all that matters
+	{ agreed->id = CODEC_LZ; agreed->level = 0; }
+      else if (asked->profile == PROFILE_BULK)
+	{ agreed->id = CODEC_ZLIB; agreed->level = BULK_ZLIB_LEVEL; }
+      else
+	{ agreed->id = CODEC_ZLIB; agreed->level = Z_DEFAULT_COMPRESSION; }
+    }
+  if ( codecFind(agreed->id) == NULL || (agreed->id == CODEC_ZLIB && (agreed->level < Z_DEFAULT_COMPRESSION || agreed->level > 9)) )
+    { agreed->id = CODEC_NONE; agreed->level = 0; }
+
+  if ( !(allowed & (1u<<agreed->id)) )
+    {
+      if ( agreed->id != CODEC_NONE && (allowed & (1u<<CODEC_ZLIB)) )
+	{ agreed->id = CODEC_ZLIB; agreed->level = Z_DEFAULT_COMPRESSION; }
+      else
+	{ agreed->id = CODEC_NONE; agreed->level = 0; }
+    }
+}
+
+long codecZlibCost(int windowBits, int memLevel)
+{
+  // pool bytes held by a session's live deflate + inflate pair, after the formulas in zconf.h
+  return (1L << (windowBits+2)) + (1L << (memLevel+9)) + (1L << windowBits) + ZLIB_STATE_BYTES;
+}
+
+static void chooseMemory(unsigned allowed, const struct codecLimits* limits, struct codecSpec* agreed)
+{
+  // take the smaller window/memLevel of both ends, then shrink them (window first, it costs 5x as much per
+  // step) until a session fits the server's cap. if even the smallest doesn't, zlib is off the table
+  if (agreed->windowBits > limits->windowBits) agreed->windowBits = limits->windowBits;
+  if (agreed->memLevel > limits->memLevel) agreed->memLevel = limits->memLevel;
+  agreed->idleSeconds = limits->idleSeconds;
+  if (agreed->id != CODEC_ZLIB || limits->sessionMemory <= 0)
+    return;
+
+  while ( codecZlibCost(agreed->windowBits, agreed->memLevel) > limits->sessionMemory )
+    {
+      if (agreed->windowBits > WINDOW_BITS_MIN && agreed->windowBits-WINDOW_BITS_MIN >= agreed->memLevel-MEM_LEVEL_MIN)
+	agreed->windowBits--;
+      else if (agreed->memLevel > MEM_LEVEL_MIN)
+	agreed->memLevel--;
+      else
+	{
+	  agreed->id = (allowed & (1u<<CODEC_LZ)) ? CODEC_LZ : CODEC_NONE; // stateless, costs nothing between frames
+	  agreed->level = 0;
+	  return;
+	}
+    }
+}
+
+int codecAnswerHello(unsigned char* hello, unsigned allowed, const struct codecDictionary* dict, const struct codecLimits* limits, struct codecSpec* agreed)
+{
+  // turn the client's hello into the server's answer in place, for servers which read it without blocking. agreed
+  // keeps the session the client asked to resume, but the answer resumes none until codecResumeHello() says so
+  struct codecSpec asked;
+  if ( unpackHello(hello, &asked) == -1 )
+    return -1;
+  chooseCodec(&asked, allowed, agreed);
+  chooseMemory(allowed, limits, agreed);
+  if ( agreed->id == CODEC_NONE || dict == NULL || asked.dictId != dict->id ) // only use a dictionary both ends have
+    agreed->dictId = 0;
+  packHello(hello, agreed);
+  codecResumeHello(hello, 0, 0);
+  return 0;
+}
+
+int codecJoinHello(unsigned char* hello, const struct codecSpec* shared, struct codecSpec* agreed)
+{
+  // answer a hello (already checked by codecAnswerHello()) with a spec some other stream uses already, e.g. that
+  // of the frames every viewer of a shell gets, if the client can take it: any codec, but only its own dictionary
+  // and no more memory than it offered. -1 with errno set to EPROTO if it can't
+  struct codecSpec asked;
+  if ( unpackHello(hello, &asked) == -1 )
+    return -1;
+  if ( (shared->dictId != 0 && shared->dictId != asked.dictId) || shared->windowBits > asked.windowBits || shared->memLevel > asked.memLevel )
+    { errno = EPROTO; return -1; }
+  *agreed = *shared;
+  agreed->mux = asked.mux;
+  agreed->echo = asked.echo;
+  agreed->watch = asked.watch;
+  agreed->resume = 0;
+  agreed->offset = 0;
+  packHello(hello, agreed);
+  return 0;
+}
+
+void codecResumeHello(unsigned char* hello, unsigned long token, unsigned long long offset)
+{
+  // fill in the session an answer belongs to, which the client may ask to resume once its connection drops (0 for
+  // none), and the output offset it starts at
+  for (int i=0; i<4; i++)
+    hello[19+i] = (unsigned char)(token >> (24-8*i));
+  for (int i=0; i<8; i++)
+    hello[23+i] = (unsigned char)(offset >> (56-8*i));
+}
+
+int codecHandshakeServer(int fd, unsigned allowed, const struct codecDictionary* dict, const struct codecLimits* limits, struct codecSpec* agreed)
+{
+  unsigned char hello [HELLO_SIZE];
+  if ( readFull(fd, hello, HELLO_SIZE) == -1 || codecAnswerHello(hello, allowed, dict, limits, agreed) == -1 )
+    return -1;
+  return writeFull(fd, hello, HELLO_SIZE) == -1 ? -1 : 0;
+}
+
+int codecInit(struct codecSession* s, const struct codecSpec* spec, const struct codecDictionary* dict)
+{
+  if ( (s->codec = codecFind(spec->id)) == NULL )
+    return -1;
+  if ( spec->dictId != 0 && (dict == NULL || dict->id != spec->dictId) )
+    { s->codec = NULL; return -1; }
+  s->level = spec->level;
+  s->dict = spec->dictId != 0 ? dict : NULL;
+  s->windowBits = spec->windowBits;
+  s->memLevel = spec->memLevel;
+  s->idleSeconds = spec->idleSeconds;
+  s->pending = NULL; // allocated when data first arrives
+  s->pendingStart = s->pendingLen = 0;
+  s->memory = 0;
+  clock_gettime(CLOCK_MONOTONIC, &s->lastActivity);
+  s->ratioEstimate = RATIO_ONE/2; // assume text until shown otherwise
+  s->framesSinceProbe = 0;
+  s->urgent = 0;
+  if ( s->codec->init(s) == -1 )
+    { s->codec = NULL; return -1; }
+  return 0;
+}
+
+void codecEnd(struct codecSession* s)
+{
+  if (s->codec != NULL)
+    s->codec->end(s);
+  if (s->pending != NULL)
+    poolFree(s, s->pending);
+  s->pending = NULL;
+  s->codec = NULL;
+}
+
+static int worthCompressing(struct codecSession* s, int len)
+{
+  // decide whether this frame goes through the codec, or is sent as is
+  if (len < FRAME_RAW_THRESHOLD || s->codec->id == CODEC_NONE)
+    return 0;
+  if (s->ratioEstimate <= RATIO_INCOMPRESSIBLE || ++s->framesSinceProbe >= FRAME_PROBE_INTERVAL)
+    {
+      s->framesSinceProbe = 0;
+      return 1;
+    }
+  return 0;
+}
+
+int codecEncode(struct codecSession* s, const char* in, int len, char* wire, int cap)
+{
+  // encode len (<= FRAME_MAX) bytes into wire, returning the number of bytes to put on the socket: one frame, or a
+  // FRAME_RESET notice and the frame raw if a stream codec ran out of room (cap needs FRAME_HEADER_SIZE to spare)
+  if (len > FRAME_MAX || cap < FRAME_HEADER_SIZE + len)
+    return -1;
+
+  clock_gettime(CLOCK_MONOTONIC, &s->lastActivity);
+  int n = -1, reset = 0;
+  if ( worthCompressing(s, len) )
+    {
+      n = s->codec->encode(s, in, len, wire+FRAME_HEADER_SIZE, cap-FRAME_HEADER_SIZE);
+      if (n < 0 && !s->codec->stateless) // didn't fit (incompressible data at a small memLevel): a stream codec can't go
+	{                                // on from half way, so start it over, tell the peer, and send the frame raw
+	  reset = codecRestart(s, wire, cap);
+	  if (reset < 0 || cap < reset + FRAME_HEADER_SIZE + len)
+	    return -1;
+	}
+      int ratio = n < 0 || n > len ? RATIO_ONE : n*RATIO_ONE/len;
+      s->ratioEstimate = (s->ratioEstimate*7 + ratio) / 8;
+      if ( s->codec->stateless && (n < 0 || n >= len) ) // didn't help, and nothing depends on it having been done
+	n = -1;
+    }
+  char* frame = wire + reset; // after the FRAME_RESET notice, if there is one
+  frame[0] = FRAME_COMPRESSED;
+  if (n < 0)
+    {
+      frame[0] = 0;
+      memcpy(frame+FRAME_HEADER_SIZE, in, len);
+      n = len;
+    }
+  if (n > 0xffff)
+    return -1;
+  frame[1] = (char)(n >> 8);
+  frame[2] = (char)(n & 0xff);
+  return reset + FRAME_HEADER_SIZE + n;
+}
+
+int codecFeed(struct codecSession* s, const char* wire, int len)
+{
+  // append bytes read off the socket, to be decoded by codecNextFrame()
+  clock_gettime(CLOCK_MONOTONIC, &s->lastActivity);
+  if ( s->pending == NULL && (s->pending = poolAlloc(s, PENDING_SIZE)) == NULL )
+    return -1;
+  if (s->pendingStart > 0) // slide the unconsumed tail to the front
+    {
+      memmove(s->pending, s->pending+s->pendingStart, s->pendingLen);
+      s->pendingStart = 0;
+    }
+  if (len > PENDING_SIZE - s->pendingLen)
+    return -1;
+  memcpy(s->pending+s->pendingLen, wire, len);
+  s->pendingLen += len;
+  return len;
+}
+
+int codecNextFrame(struct codecSession* s, char* out, int cap)
+{
+  // decode the next complete frame into out: returns its length, 0 if more bytes are needed, -1 if corrupt
+  if (s->pending == NULL)
+    return 0;
+  char* p = s->pending + s->pendingStart;
+  if (s->pendingLen < FRAME_HEADER_SIZE)
+    return 0;
+  int wireLen = ((unsigned char)p[1] << 8) | (unsigned char)p[2];
+  if (wireLen > FRAME_WIRE_MAX)
+    return -1;
+  if (s->pendingLen < FRAME_HEADER_SIZE + wireLen)
+    return 0;
+
+  if (p[0] & FRAME_RESET) // peer released its compressor, so the stream we decode with is finished too
+    {
+      s->codec->releaseDecoder(s);
+      s->pendingStart += FRAME_HEADER_SIZE + wireLen;
+      s->pendingLen -= FRAME_HEADER_SIZE + wireLen;
+      return codecNextFrame(s, out, cap);
+    }
+
+  int n;
+  s->urgent = (p[0] & FRAME_URGENT) != 0;
+  if ( (p[0] & FRAME_COMPRESSED) && !s->urgent )
+    n = s->codec->decode(s, p+FRAME_HEADER_SIZE, wireLen, out, cap);
+  else
+    n = noneCopy(s, p+FRAME_HEADER_SIZE, wireLen, out, cap);
+  s->pendingStart += FRAME_HEADER_SIZE + wireLen;
+  s->pendingLen -= FRAME_HEADER_SIZE + wireLen;
+  return n;
+}
+
+int codecEncodeUrgent(struct codecSession* s, const char* in, int len, char* wire, int cap)
+{
+  // frame a control message as FRAME_URGENT, returning the number of bytes to put on the socket. it never goes
+  // through the codec, so the receiver can take it out of order
+  if (len > FRAME_MAX || cap < FRAME_HEADER_SIZE + len)
+    return -1;
+  clock_gettime(CLOCK_MONOTONIC, &s->lastActivity);
+  wire[0] = FRAME_URGENT;
+  wire[1] = (char)(len >> 8);
+  wire[2] = (char)(len & 0xff);
+  memcpy(wire+FRAME_HEADER_SIZE, in, len);
+  return FRAME_HEADER_SIZE + len;
+}
+
+int codecNextUrgent(struct codecSession* s, char* out, int cap)
+{
+  // take the first complete FRAME_URGENT frame out of the received data, skipping over (and leaving in place) the
+  // frames before it: returns its length, 0 if there is none, -1 if the data is corrupt
+  if (s->pending == NULL)
+    return 0;
+  char* p = s->pending + s->pendingStart;
+  int at = 0;
+  while (s->pendingLen - at >= FRAME_HEADER_SIZE)
+    {
+      int wireLen = ((unsigned char)p[at+1] << 8) | (unsigned char)p[at+2];
+      if (wireLen > FRAME_WIRE_MAX)
+	return -1;
+      if (s->pendingLen - at < FRAME_HEADER_SIZE + wireLen)
+	return 0;
+      if (p[at] & FRAME_URGENT)
+	{
+	  if (wireLen > cap)
+	    return -1;
+	  memcpy(out, p+at+FRAME_HEADER_SIZE, wireLen);
+	  int after = at + FRAME_HEADER_SIZE + wireLen;
+	  memmove(p+at, p+after, s->pendingLen - after); // close the gap, the frames around it stay in order
+	  s->pendingLen -= FRAME_HEADER_SIZE + wireLen;
+	  return wireLen;
+	}
+      at += FRAME_HEADER_SIZE + wireLen;
+    }
+  return 0;
+}
+
+int codecFeedRoom(const struct codecSession* s)
+{
+  // most bytes codecFeed() can take right now
+  return s->pending == NULL ? PENDING_SIZE : PENDING_SIZE - s->pendingLen;
+}
+
+int codecIdleTimeout(struct codecSession* s)
+{
+  // milliseconds until codecIdle() has something to release, or -1 if it never will (poll timeout format)
+  if ( s->codec == NULL || s->idleSeconds == 0 || !(s->deflaterLive || (s->pending != NULL && s->pendingLen == 0)) )
+    return -1;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  long elapsed = (now.tv_sec - s->lastActivity.tv_sec)*1000 + (now.tv_nsec - s->lastActivity.tv_nsec)/1000000;
+  long left = s->idleSeconds*1000L - elapsed;
+  return left > 0 ? (int)left : 0;
+}
+
+int codecResetFrame(char* wire, int cap)
+{
+  // the FRAME_RESET notice on its own, for a peer whose decoder has to start over whether or not we just dropped
+  // any compressor state (one that missed frames, see codecRestart())
+  if (cap < FRAME_HEADER_SIZE)
+    return -1;
+  wire[0] = FRAME_RESET;
+  wire[1] = wire[2] = 0;
+  return FRAME_HEADER_SIZE;
+}
+
+int codecRestart(struct codecSession* s, char* wire, int cap)
+{
+  // drop the compressor state, e.g. because frames encoded with it were thrown away before they were sent. returns
+  // the size of the FRAME_RESET notice for the peer written into wire, 0 if there was no state to drop
+  if ( !s->codec->releaseEncoder(s) )
+    return 0;
+  return codecResetFrame(wire, cap);
+}
+
+int codecIdle(struct codecSession* s, char* wire, int cap)
+{
+  // once the session has been idle long enough, give its compressor state and receive buffer back to the
+  // pool. returns the size of the notice for the peer written into wire, 0 if nothing needs to be sent
+  if (codecIdleTimeout(s) != 0)
+    return 0;
+  if (s->pending != NULL && s->pendingLen == 0)
+    {
+      poolFree(s, s->pending);
+      s->pending = NULL;
+      s->pendingStart = 0;
+    }
+  return codecRestart(s, wire, cap);
+}
+
+long codecSessionMemory(const struct codecSession* s)
+{
+  return sizeof(*s) + s->memory;
+}
@@ -0,0 +1,202 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Compression codec interface shared by part2Client.c and part2Server.c. A codec is a small table of functions
+(init/encode/decode/end) operating on a codecSession, which holds the state for both directions of one
+connection. Three codecs exist: "none" (bytes pass through untouched), "zlib" (one deflate stream
+per direction, sync flushed per frame, at a selectable level) and "lz" (the in-tree LZ block codec from lz.h,
+which is stateless and the cheapest per frame).
+
+Every chunk travels in a frame made of a flag byte and a 2 byte big endian payload length followed by the payload,
+so the receiver always decodes whole chunks no matter how TCP splits them. The flag byte says whether the payload
+was compressed: frames below FRAME_RAW_THRESHOLD bytes (single keystrokes, short echoes) are always sent raw, and
+so are most frames while a running estimate of the codec's ratio on recent frames says the data isn't compressing
+(already compressed files, random bytes). Every FRAME_PROBE_INTERVAL'th such frame is compressed anyway, to notice
+when the data becomes compressible again.
+
+Which codec and level a connection uses is settled by a handshake right after connect(): the client sends a
+hello naming the codec it wants (or just a profile, "interactive" or "bulk"), and the server answers with the
+codec it will actually use, limited to the codecs it was started with. The hello also asks for channel
+multiplexing (see mux.h), or for the server to edit and echo lines (see lineEdit.h); not both. Or it asks to
+watch another session's shell (part2Client --watch), in which case the answer is the codec of the frames that
+shell's viewers share, which are encoded once for all of them.
+
+A server started with --detach names every session it could keep through a dropped connection with a token in
+its answer. A client whose connection breaks connects again and sends a hello with that token and the number of
+bytes of output it has received, and the answer tells it where the output it gets next starts: right there, or
+further on if the server's scrollback doesn't reach back that far. An answer with another token means the session
+is gone and a new one started.
+
+Control events (^C, ^D, a resized terminal) travel as FRAME_URGENT frames, which carry one mux.h message and are
+never compressed, so they don't depend on any frame before them. The server pulls them out of its receive buffer
+with codecNextUrgent() ahead of the data frames still waiting there for the shell to take them; codecNextFrame()
+returns them in order like any other frame, with urgent set.
+
+Both codecs can start from a preset dictionary (--dict) of typical terminal traffic, so that the prompts, escape
+sequences and command output at the start of a short session already compress well. A dictionary is named by
+the adler32 of its contents; the hello carries that id, and the dictionary is only used when both ends loaded
+the same one. trainDictionary.c builds dictionaries from recorded sessions.
+
+Memory per session is bounded. The zlib window (windowBits) and hash table size (memLevel) are negotiated in the
+hello, as the smaller of what either end asks for, and the server shrinks them further until a session fits
+under its --session-memory cap (see codecZlibCost()). zlib's internal state is allocated through zalloc/zfree
+from a process wide pool, which recycles same sized blocks across sessions and keeps a count of what every
+session holds. Streams are only initialized when the first compressed frame is sent or received, and once a
+session has been idle for the agreed number of seconds its deflate state and receive buffer go back to the
+pool; the peer is told with an empty FRAME_RESET frame, so it can release its inflate state as well, and the
+next compressed frame starts a fresh stream (and dictionary) on both ends. The same happens when a compressed
+frame wouldn't fit in FRAME_WIRE_MAX (incompressible data at a small memLevel or window): the half written
+stream is dropped, and the frame follows the FRAME_RESET raw.
+
+*/
+
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <zlib.h>
+#include <time.h>
+#include "lz.h"
+
+#define HELLO_SIZE 31 // handshake message, the same size in both directions
+#define FRAME_HEADER_SIZE 3
+#define FRAME_COMPRESSED 0x01 // flag byte: payload is codec output, otherwise it is the data as is
+#define FRAME_RESET 0x02 // flag byte of an empty frame: the sender dropped its compressor state
+#define FRAME_URGENT 0x04 // flag byte: the payload is a control message, sent as is
+#define FRAME_RAW_THRESHOLD 32 // smaller frames aren't worth a codec call, a sync flush alone costs more than they'd save
+#define FRAME_PROBE_INTERVAL 16
+#define RATIO_ONE 256 // fixed point 1.0 for the compression ratio estimate
+#define RATIO_INCOMPRESSIBLE 243 // ~0.95: above this the estimate says compression doesn't pay
+#define FRAME_MAX 16384 // max plaintext bytes carried in one frame
+#define FRAME_WIRE_MAX (FRAME_MAX + FRAME_MAX/255 + 64) // max encoded payload of one frame, for any codec (a frame whose output would be larger goes raw)
+
+#define CODEC_NONE 0
+#define CODEC_ZLIB 1
+#define CODEC_LZ 2
+#define CODEC_AUTO 255 // client leaves the choice to the server, based on profile
+#define CODEC_COUNT 3
+#define CODEC_ALL ( (1<<CODEC_NONE) | (1<<CODEC_ZLIB) | (1<<CODEC_LZ) )
+
+#define PROFILE_DEFAULT 0
+#define PROFILE_INTERACTIVE 1 // keystrokes and prompts: lowest latency per frame
+#define PROFILE_BULK 2 // large outputs: best compression ratio per cpu cycle
+
+#define BULK_ZLIB_LEVEL 1 // on terminal output level 1 gives ~6x at half the cpu of level 6's ~7x
+
+#define DICT_MAX 32768 // a deflate window, anything older could never be referenced
+
+#define WINDOW_BITS_MIN 9 // smallest window raw deflate supports
+#define WINDOW_BITS_MAX 15
+#define MEM_LEVEL_MIN 1
+#define MEM_LEVEL_MAX 9
+#define MEM_LEVEL_DEFAULT 8
+#define ZLIB_STATE_BYTES 13312 // deflate_state + inflate_state, on top of their windows and tables
+#define FEED_MAX 1024 // most bytes a caller passes to codecFeed() at once
+#define PENDING_SIZE (FRAME_HEADER_SIZE+FRAME_WIRE_MAX+FEED_MAX) // receive buffer, held only while a session is active
+#define POOL_CACHE_MAX (8<<20) // freed blocks kept for reuse, anything beyond goes back to the system
+
+struct codecSpec
+{
+  int id; // CODEC_*
+  int level; // codec specific, for zlib 0-9 or Z_DEFAULT_COMPRESSION
+  int profile; // PROFILE_*
+  unsigned long dictId; // preset dictionary in use, 0 for none
+  int windowBits; // zlib window is 1<<windowBits bytes
+  int memLevel; // zlib hash table and output buffer size
+  int idleSeconds; // release compressor state after this long without traffic, 0 to keep it
+  int mux; // frames carry channel headers, see mux.h
+  int echo; // the server edits and echoes lines, see lineEdit.h
+  unsigned long watch; // pid of a shell to watch read-only instead of running one, 0 for none
+  unsigned long resume; // hello: session to resume, 0 for a new one. answer: the session's token, 0 if it can't be resumed
+  unsigned long long offset; // hello: bytes of output received in the session. answer: where its output picks up
+};
+
+struct codecLimits // server side bounds on what a client may ask for
+{
+  int windowBits;
+  int memLevel;
+  int idleSeconds;
+  long sessionMemory; // cap on the zlib state of one session, 0 for none
+};
+
+struct codecPoolStats
+{
+  long inUse; // bytes handed out to sessions
+  long cached; // bytes freed by sessions and kept for reuse
+  long allocations; // calls to zalloc and friends
+  long reuses; // of which were served from the cache
+};
+
+struct codecDictionary
+{
+  char data [DICT_MAX];
+  int len;
+  unsigned long id; // adler32 of data, never 0
+  struct lzDictionary lz; // data indexed for the lz codec
+};
+
+struct codecSession;
+
+struct codec
+{
+  const char* name;
+  int id;
+  int stateless; // a stateless codec's output may be thrown away, e.g. when it came out larger than its input
+  int (*init)(struct codecSession* s);
+  int (*encode)(struct codecSession* s, const char* in, int len, char* out, int cap);
+  int (*decode)(struct codecSession* s, const char* in, int len, char* out, int cap);
+  int (*releaseEncoder)(struct codecSession* s); // returns 1 if there was state to release
+  void (*releaseDecoder)(struct codecSession* s);
+  void (*end)(struct codecSession* s);
+};
+
+struct codecSession
+{
+  const struct codec* codec;
+  int level;
+  const struct codecDictionary* dict; // NULL unless a dictionary was agreed on
+  int windowBits, memLevel, idleSeconds;
+  z_stream deflater; // zlib only, each initialized on first use
+  z_stream inflater;
+  int deflaterLive, inflaterLive;
+  char* pending; // PENDING_SIZE bytes of received data not yet decoded, NULL while idle
+  int pendingStart, pendingLen;
+  long memory; // bytes this session holds from the pool
+  long memoryCap; // cap on memory for zlib streams, 0 for none
+  struct timespec lastActivity;
+  int ratioEstimate; // running average of compressed/raw size of frames sent, out of RATIO_ONE
+  int framesSinceProbe; // frames sent raw since compression was last tried
+  int urgent; // the frame codecNextFrame() returned last was FRAME_URGENT
+};
+
+const struct codec* codecFind(int id);
+int codecParseSpec(const char* text, struct codecSpec* spec);
+int codecParseAllowed(const char* text, unsigned* allowed);
+int codecLoadDictionary(const char* path, struct codecDictionary* dict);
+
+int codecHandshakeClient(int fd, const struct codecSpec* want, struct codecSpec* agreed);
+int codecHandshakeServer(int fd, unsigned allowed, const struct codecDictionary* dict, const struct codecLimits* limits, struct codecSpec* agreed);
+int codecAnswerHello(unsigned char* hello, unsigned allowed, const struct codecDictionary* dict, const struct codecLimits* limits, struct codecSpec* agreed);
+int codecJoinHello(unsigned char* hello, const struct codecSpec* shared, struct codecSpec* agreed);
+void codecResumeHello(unsigned char* hello, unsigned long token, unsigned long long offset);
+
+int codecInit(struct codecSession* s, const struct codecSpec* spec, const struct codecDictionary* dict);
+void codecEnd(struct codecSession* s);
+int codecEncode(struct codecSession* s, const char* in, int len, char* wire, int cap);
+int codecFeed(struct codecSession* s, const char* wire, int len);
+int codecNextFrame(struct codecSession* s, char* out, int cap);
+int codecEncodeUrgent(struct codecSession* s, const char* in, int len, char* wire, int cap);
+int codecNextUrgent(struct codecSession* s, char* out, int cap);
+int codecFeedRoom(const struct codecSession* s);
+int codecRestart(struct codecSession* s, char* wire, int cap);
+int codecResetFrame(char* wire, int cap);
+
+int codecIdleTimeout(struct codecSession* s);
+int codecIdle(struct codecSession* s, char* wire, int cap);
+long codecZlibCost(int windowBits, int memLevel);
+long codecSessionMemory(const struct codecSession* s);
+void codecGetPoolStats(struct codecPoolStats* stats);
+
+#endif
@@ -0,0 +1,117 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Checks that any frame, however incompressible, makes it through every codec and profile at every window and
+memLevel a server can shrink a session to. For each combination the client and server ends shake hands over a
+socketpair (the server in a child process, as it would be in part2Server), and then full FRAME_MAX frames of
+random bytes and of text are encoded with codecEncode() and decoded again with codecFeed()/codecNextFrame(), fed
+in FEED_MAX pieces like a socket would deliver them. Prints the number of combinations checked, or what failed
+and exits 1. Run with make check.
+
+*/
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "codec.h"
+
+static const char* specs [] = { "none", "zlib", "zlib:1", "zlib:9", "lz", "interactive", "bulk" };
+
+char randomFrame [FRAME_MAX], textFrame [FRAME_MAX];
+
+int agree(const char* text, int windowBits, int memLevel, struct codecSpec* agreed)
+{
+  // shake hands as a client asking for text would, with a server limited to windowBits and memLevel
+  struct codecSpec want = { 0 }; // no mux, echo, watch or resume
+  struct codecLimits limits = { windowBits, memLevel, 0, 0 };
+  int fds [2];
+  if ( codecParseSpec(text, &want) == -1 || socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1 )
+    return -1;
+  pid_t server = fork();
+  if (server == -1)
+    return -1;
+  if (server == 0)
+    {
+      struct codecSpec answered;
+      close(fds[0]);
+      _exit( codecHandshakeServer(fds[1], CODEC_ALL, NULL, &limits, &answered) == -1 );
+    }
+  close(fds[1]);
+  int result = codecHandshakeClient(fds[0], &want, agreed);
+  int status;
+  close(fds[0]);
+  waitpid(server, &status, 0);
+  return result == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0 ? -1 : 0;
+}
+
+int roundTrip(struct codecSession* encoder, struct codecSession* decoder, const char* data, int len)
+{
+  // send one frame from encoder to decoder, 0 if exactly data came out
+  char wire [FRAME_HEADER_SIZE+FRAME_WIRE_MAX], out [FRAME_MAX];
+  int wireSize = codecEncode(encoder, data, len, wire, sizeof(wire));
+  if (wireSize == -1)
+    return -1;
+  int got = 0;
+  for (int fed=0; fed<wireSize; )
+    {
+      int piece = wireSize-fed < FEED_MAX ? wireSize-fed : FEED_MAX;
+      if ( codecFeed(decoder, wire+fed, piece) == -1 )
+	return -1;
+      fed += piece;
+      int n;
+      while ( (n = codecNextFrame(decoder, out, sizeof(out))) > 0 )
+	{
+	  if (got + n > len || memcmp(out, data+got, n) != 0)
+	    return -1;
+	  got += n;
+	}
+      if (n == -1)
+	return -1;
+    }
+  return got == len ? 0 : -1;
+}
+
+int main(void)
+{
+  // fill the frames: random bytes, and text that repeats the way terminal output does
+  srand(1);
+  for (int i=0; i<FRAME_MAX; i++)
+    randomFrame[i] = (char)rand();
+  for (int i=0; i<FRAME_MAX; )
+    i += snprintf(textFrame+i, FRAME_MAX-i, "drwxr-xr-x 2 user user 4096 Oct %2d 12:%02d dir%d\n", i%31, i%60, i);
+
+  int checked = 0;
+  for (unsigned k=0; k<sizeof(specs)/sizeof(specs[0]); k++)
+    for (int windowBits=WINDOW_BITS_MIN; windowBits<=WINDOW_BITS_MAX; windowBits++)
+      for (int memLevel=MEM_LEVEL_MIN; memLevel<=MEM_LEVEL_MAX; memLevel++)
+	{
+	  struct codecSpec agreed;
+	  struct codecSession encoder, decoder;
+	  if ( agree(specs[k], windowBits, memLevel, &agreed) == -1 )
+	    { fprintf(stderr, "handshake failure for %s with message %s\n", specs[k], strerror(errno)); exit(1); }
+	  if ( codecInit(&encoder, &agreed, NULL) == -1 || codecInit(&decoder, &agreed, NULL) == -1 )
+	    { fprintf(stderr, "codecInit() failure for %s\n", specs[k]); exit(1); }
+	  // incompressible first, while the ratio estimate still has every frame compressed, then text on the
+	  // same streams, to see that they carry on after whatever the codec had to do
+	  const char* frames [] = { randomFrame, textFrame, randomFrame, textFrame };
+	  for (int f=0; f<4; f++)
+	    if ( roundTrip(&encoder, &decoder, frames[f], FRAME_MAX) == -1 )
+	      {
+		fprintf(stderr, "frame %d of %s (%s) at windowBits %d memLevel %d didn't make it through\n", f, specs[k],
+			encoder.codec->name, agreed.windowBits, agreed.memLevel);
+		exit(1);
+	      }
+	  codecEnd(&encoder);
+	  codecEnd(&decoder);
+	  checked++;
+	}
+  printf("%d combinations of codec, window and memLevel passed\n", checked);
+  return 0;
+}
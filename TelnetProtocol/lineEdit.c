@@ -0,0 +1,63 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Implementation of the line editor declared in lineEdit.h. Whether a character was echoed is worked out again
+from the character itself when it is erased, so the line needs nothing stored next to it. A UTF-8 character is
+erased whole, as one column on the screen.
+
+*/
+
+#include "lineEdit.h"
+
+static int echoed(char c)
+{
+  // printable ASCII, tab, and every byte of a UTF-8 character, which the terminal puts back together
+  unsigned char b = c;
+  return (b >= 0x20 && b != 0x7f) || b == '\t';
+}
+
+int lineKey(struct lineEditor* e, char key, char* echo, int* echoLen)
+{
+  // apply one key to the line, leaving its echo in echo. returns 1 if the key ended the line, which is then
+  // e->line[0..e->len) and is the caller's to take before calling lineReset()
+  *echoLen = 0;
+  if (key == 0x7f || key == 0x08)
+    {
+      while ( e->len > 0 && (e->line[e->len-1] & 0xc0) == 0x80 ) // the continuation bytes of a UTF-8 character
+	e->len--;                                                  // go with the byte that starts it
+      if (e->len > 0 && echoed(e->line[--e->len]))
+	{
+	  echo[0] = '\b'; echo[1] = ' '; echo[2] = '\b';
+	  *echoLen = 3;
+	}
+      return 0;
+    }
+  if (key == '\r' || key == '\n')
+    {
+      e->line[e->len++] = '\n';
+      echo[0] = '\r'; echo[1] = '\n';
+      *echoLen = 2;
+      return 1;
+    }
+  if (e->len >= EDIT_LINE_MAX-1) // keep room for the LF
+    {
+      echo[0] = '\a';
+      *echoLen = 1;
+      return 0;
+    }
+  e->line[e->len++] = key;
+  if (echoed(key))
+    {
+      echo[0] = key;
+      *echoLen = 1;
+    }
+  return 0;
+}
+
+void lineReset(struct lineEditor* e)
+{
+  e->len = 0;
+}
@@ -0,0 +1,43 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Line editing for sessions which ask for echo in the hello (part2Client --predict), shared by part2Server.c and
+part2Client.c. The shells have no terminal of their own, so nothing else ever echoes what is typed or gives a
+backspace its meaning. With echo on, the server edits each line the way a terminal in canonical mode would,
+echoes every key, and hands the shell only whole lines:
+
+	printable characters		added to the line, echoed as they are (every byte of a UTF-8 character
+					is, so the terminal shows it as it is typed)
+	tab				added to the line, echoed as is
+	DEL or ^H			the last character (all the bytes of a UTF-8 one) is taken off the line;
+					echoed as "\b \b" if that character was echoed, otherwise not at all
+					(nothing happens on an empty line)
+	CR or LF			the line (ending in a LF) is ready for the shell, echoed as "\r\n"
+	anything else			added to the line without being echoed (e.g. the bytes of an arrow key)
+
+Once a line holds EDIT_LINE_MAX-1 characters it takes no more (they are echoed as a bell), so the LF always fits.
+
+The editor is deterministic: the client runs its own copy over the keys it sends, and so knows exactly what the
+server will echo for each of them before the echo comes back.
+
+*/
+
+#ifndef LINE_EDIT_H
+#define LINE_EDIT_H
+
+#define EDIT_LINE_MAX 4096 // the size of a Linux terminal's line buffer
+#define EDIT_ECHO_MAX 3 // longest echo of one key
+
+struct lineEditor
+{
+  char line [EDIT_LINE_MAX];
+  int len;
+};
+
+int lineKey(struct lineEditor* e, char key, char* echo, int* echoLen);
+void lineReset(struct lineEditor* e);
+
+#endif
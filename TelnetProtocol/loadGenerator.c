@@ -0,0 +1,963 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Load generator for part2Server. Opens --sessions concurrent connections to a running server (each with the
+handshake and codec a part2Client given the same --compress/--dict options would use) and drives them all from
+a single poll loop for --duration seconds, with one of three scripts:
+
+	keystroke: types "echo <token>" followed by Enter, one keystroke (and so one frame) every --interval ms
+		   like an operator would, and measures the time from the Enter to the token coming back from the
+		   shell: the keystroke-to-echo latency an operator sees.
+	bulk:	   runs --command (by default a command printing ~1.3 MB) followed by an echo of a token, and
+		   measures the time until the token arrives, i.e. the time to deliver the whole output.
+	interrupt: runs --command (by default yes), stops reading once its output starts, like a terminal which
+		   can't keep up, and after --interval ms sends ^C. Measures the time from the ^C to the server's
+		   answer that it landed, which is how long output from before the interrupt keeps arriving. The
+		   shell is interrupted as well, so every session does this once.
+	replay:	   sends the input of a session recording (--replay, see record.h) to a server running replayShell
+		   on the same recording, at the times it was recorded or, with --fast, each input as soon as all
+		   the output recorded before it has come back. Measures the time from each input to the last of
+		   the output recorded after it, and ends once every session has played the whole recording.
+
+Sessions start spread over one interval, so that they don't all type in lockstep. At the end every session sends
+^D and waits for the server to close it, and a report is printed: latency percentiles, bytes per second in each
+direction (on the wire, and before compression), the cpu time this tool and, with --server-pid, the server and
+its shells used per session, and the server's resident memory.
+
+Run it once with and once without --compress (against a server started with --compress) to compare. With --mux,
+all sessions run as channels of a single multiplexed connection (mux.h) instead of one connection each.
+
+--viewers=N (with --server-pid) also has N read-only viewers watch every session's shell (part2Client --watch),
+each decoding everything it is sent, to measure what they cost the server: the output is encoded once for all of
+a shell's viewers, so the server's cpu per session should hardly change with N.
+
+--results=FILE saves the figures of the report, one "name value" line each, and --baseline=FILE compares the run
+with figures saved earlier, e.g. by the same replay against another build of the server.
+
+*/
+
+#define _GNU_SOURCE // memmem()
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include "codec.h"
+#include "mux.h"
+#include "translate.h"
+#include "record.h"
+#include "local.h"
+#include "coalesce.h"
+
+#define SCRIPT_KEYSTROKE 0
+#define SCRIPT_BULK 1
+#define SCRIPT_INTERRUPT 2
+#define SCRIPT_REPLAY 3
+#define TOKEN_MAX 32
+#define MATCH_KEEP (TOKEN_MAX+2) // output kept between reads, so a token split across two reads is still found
+#define DEFAULT_BULK_COMMAND "seq 1 200000"
+#define DEFAULT_INTERRUPT_COMMAND "yes"
+#define REPLAY_DURATION 1e6 // seconds, a replay runs until it is done unless --duration says otherwise
+#define METRICS_MAX 24
+#define SHELLS_MAX 4096 // of the server, looked for in /proc for --viewers
+
+struct loadSession
+{
+  int socket; // with --mux the same for every session
+  struct codecSession* codec; // ownCodec, or with --mux the connection's
+  struct codecSession ownCodec;
+  int channel; // --mux: channel number, and the window and credit of that channel
+  int sendWindow, creditOwed;
+  char line [TOKEN_MAX+FRAME_MAX]; // what is being typed, up to and including the Enter
+  int lineLen, typed;
+  char token [TOKEN_MAX+2]; // output that ends the current round trip: the echoed token and its <cr><lf>
+  int tokenLen;
+  char recent [MATCH_KEEP+FEED_MAX]; // tail of the output, searched for the token
+  int recentLen;
+  struct timespec next; // time of the next keystroke, or of the next command in bulk mode
+  struct timespec sent; // time Enter was sent, while waiting for the token
+  int waiting; // Enter sent, token not seen yet
+  int paused; // interrupt script: output started, and is left unread until next
+  int interrupted; // interrupt script: ^C sent, output is dropped until the server answers
+  int rounds;
+  int closing; // ^D sent, waiting for the server to hang up
+  int closed;
+  struct timespec began; // replay: time 0 of the recording
+  int stepIndex, stepSent; // replay: next step of the recording, and how much of it (an input) is sent
+  int awaiting; // replay: first input whose output hasn't all come back
+  long long replayed; // replay: output received
+  struct timespec* sentAt; // replay: when each input step went out
+};
+
+struct loadViewer // --viewers: a connection watching one of the shells
+{
+  int socket;
+  struct codecSession codec;
+  int closed;
+};
+
+struct loadSession* sessions;
+int sessionCount = 4;
+int script = SCRIPT_KEYSTROKE;
+const char* scriptNames[] = { "keystroke", "bulk", "interrupt", "replay" };
+int intervalMs = 50; // between keystrokes (keystroke) or commands (bulk)
+double duration = 0; // --duration, or 10 s (REPLAY_DURATION for a replay)
+char* command = NULL; // --command, or the script's default
+pid_t serverPid = 0;
+struct codecSpec compressSpec = { CODEC_NONE, 0, PROFILE_DEFAULT, 0, WINDOW_BITS_MAX, MEM_LEVEL_DEFAULT, 0, 0, 0, 0, 0, 0 };
+struct codecDictionary dictionary;
+struct codecSession sharedCodec; // --mux
+struct recording replay; // --replay
+long long* outputBefore; // replay: output the client gets from the steps before each step, translated as the server does
+long long outputTotal;
+int fast = 0; // replay: send input as soon as its output has come back, not at recorded times
+int replaysDone = 0;
+char* resultsPath = NULL; // --results
+char* baselinePath = NULL; // --baseline
+int tcpOnly = 0; // --tcp
+int local = 0; // connected to the server's same-host socket
+struct loadViewer* viewers; // --viewers
+int viewersPerShell = 0, viewerCount = 0;
+long viewerWire, viewerData; // received by all viewers together
+
+double* latencies; // milliseconds, one per completed round trip
+int latencyCount, latencySlots;
+long wireSent, wireReceived, dataSent, dataReceived;
+
+double msBetween(const struct timespec* a, const struct timespec* b)
+{
+  return (b->tv_sec - a->tv_sec)*1000.0 + (b->tv_nsec - a->tv_nsec)/1e6;
+}
+
+void addMs(struct timespec* t, double ms)
+{
+  long ns = t->tv_nsec + (long)(ms*1e6);
+  t->tv_sec += ns / 1000000000L;
+  t->tv_nsec = ns % 1000000000L;
+}
+
+void recordLatency(double ms)
+{
+  if (latencyCount == latencySlots)
+    {
+      latencySlots = latencySlots ? 2*latencySlots : 1024;
+      if ( (latencies = realloc(latencies, latencySlots * sizeof(double))) == NULL )
+	{ fprintf(stderr, "Memory allocation issue!\n"); exit(1); }
+    }
+  latencies[latencyCount++] = ms;
+}
+
+int connectToServer(char* port)
+{
+  // same as part2Client's connectToServer: the server's same-host socket unless --tcp, otherwise a tcp connection
+  // to the given port on localhost
+  int sockfd;
+  if ( !tcpOnly && (sockfd = localConnect(atoi(port))) != -1 )
+    {
+      local = 1;
+      return sockfd;
+    }
+  if ( (sockfd = socket(AF_INET, SOCK_STREAM, 0)) == -1 )
+    { fprintf(stderr, "socket() failure with message %s\n", strerror(errno)); exit(1); }
+  struct hostent *hostInfo;
+  if ( (hostInfo = gethostbyname("localhost")) == NULL )
+    { fprintf(stderr, "gethostbyname() failure with number %s\n", strerror(h_errno)); exit(1); }
+  struct sockaddr_in connectServer = { AF_INET, htons(atoi(port)), {0}, {0} };
+  memcpy( (void*)(&connectServer.sin_addr.s_addr), (void*)(hostInfo->h_addr_list[0]), hostInfo->h_length );
+  if ( connect(sockfd, (struct sockaddr *) &connectServer, sizeof(connectServer)) == -1 )
+    { fprintf(stderr, "connect() failure with message %s\n", strerror(errno)); exit(1); }
+  return sockfd;
+}
+
+void sendWire(struct loadSession* s, const char* buf, int size)
+{
+  // encode and send one frame, the way part2Client's write_compress does
+  char wire [FRAME_HEADER_SIZE+FRAME_WIRE_MAX];
+  int wireSize = codecEncode(s->codec, buf, size, wire, sizeof(wire));
+  if (wireSize == -1)
+    { fprintf(stderr, "%s encode failure\n", s->codec->codec->name); exit(1); }
+  for (int done=0; done<wireSize; )
+    {
+      int x = write(s->socket, wire+done, wireSize-done);
+      if ( x == -1 && (errno == EPIPE || errno == ECONNRESET) ) // the server hung up, the next read finds out
+	return;
+      if (x == -1)
+	{ fprintf(stderr, "write() failure with message %s\n", strerror(errno)); exit(1); }
+      done += x;
+    }
+  wireSent += wireSize;
+}
+
+void sendFrame(struct loadSession* s, const char* buf, int size)
+{
+  // send keystrokes or a command line, on the session's channel with --mux
+  char frame [MUX_HEADER_SIZE+FRAME_MAX];
+  dataSent += size;
+  if (!compressSpec.mux)
+    { sendWire(s, buf, size); return; }
+  muxHeader(frame, MUX_DATA, s->channel);
+  memcpy(frame+MUX_HEADER_SIZE, buf, size);
+  s->sendWindow -= size;
+  sendWire(s, frame, MUX_HEADER_SIZE+size);
+}
+
+void sendControl(struct loadSession* s, int type, unsigned long value, int valueLen)
+{
+  char frame [MUX_CONTROL_MAX];
+  sendWire(s, frame, muxControl(frame, type, s->channel, value, valueLen));
+}
+
+void sendUrgent(struct loadSession* s, int type)
+{
+  // ^C or ^D, the way part2Client sends them
+  char message [MUX_CONTROL_MAX];
+  char wire [FRAME_HEADER_SIZE+MUX_CONTROL_MAX];
+  int wireSize = codecEncodeUrgent(s->codec, message, muxControl(message, type, s->channel, 0, 0), wire, sizeof(wire));
+  for (int done=0; done<wireSize; )
+    {
+      int x = write(s->socket, wire+done, wireSize-done);
+      if ( x == -1 && (errno == EPIPE || errno == ECONNRESET) ) // the server hung up, the next read finds out
+	return;
+      if (x == -1)
+	{ fprintf(stderr, "write() failure with message %s\n", strerror(errno)); exit(1); }
+      done += x;
+    }
+  wireSent += wireSize;
+}
+
+void loadReplay(const char* path)
+{
+  // load the recording, and work out how much output the client gets before each step: replayShell writes what
+  // was recorded, which the server translates before sending it on
+  if ( recordLoad(path, &replay) == -1 )
+    { fprintf(stderr, "Unable to load recording %s with message %s\n", path, strerror(errno)); exit(1); }
+  if ( (outputBefore = malloc((replay.count+1) * sizeof(long long))) == NULL )
+    { fprintf(stderr, "Memory allocation issue!\n"); exit(1); }
+  char* out = NULL;
+  int outSlots = 0, shellDone = 0;
+  outputTotal = 0;
+  for (int i=0; i<replay.count; i++)
+    {
+      struct recordStep* r = &replay.steps[i];
+      outputBefore[i] = outputTotal;
+      if (r->type != RECORD_OUTPUT || shellDone)
+	continue;
+      if (2*r->len > outSlots)
+	{
+	  outSlots = 2*r->len;
+	  if ( (out = realloc(out, outSlots)) == NULL )
+	    { fprintf(stderr, "Memory allocation issue!\n"); exit(1); }
+	}
+      int outSize;
+      if ( translate(r->data, r->len, TRANSLATE_FROM_SHELL|TRANSLATE_STOP_EOF, out, &outSize) < r->len ) // the server ends the output at a ^D
+	shellDone = 1;
+      outputTotal += outSize;
+    }
+  outputBefore[replay.count] = outputTotal;
+  free(out);
+}
+
+long long outputAfter(int step)
+{
+  // output the client has once the replies to an input step are all in: everything up to the next input
+  int next = step+1;
+  while (next < replay.count && replay.steps[next].type != RECORD_INPUT)
+    next++;
+  return outputBefore[next];
+}
+
+void replayReceived(struct loadSession* s, int size, const struct timespec* now)
+{
+  // time every input whose output is now all in, and once the whole recording is, hang up
+  s->replayed += size;
+  for (; s->awaiting < s->stepIndex; s->awaiting++)
+    {
+      if (replay.steps[s->awaiting].type != RECORD_INPUT)
+	continue;
+      long long until = outputAfter(s->awaiting);
+      if (s->replayed < until)
+	break;
+      if (until > outputBefore[s->awaiting]) // there was a reply to wait for
+	recordLatency(msBetween(&s->sentAt[s->awaiting], now));
+      s->rounds++;
+    }
+  if (s->stepIndex == replay.count && s->awaiting == replay.count && s->replayed >= outputTotal && !s->closing)
+    {
+      sendUrgent(s, MUX_EOF);
+      s->closing = 1;
+      replaysDone++;
+    }
+}
+
+void replayStep(struct loadSession* s, const struct timespec* now)
+{
+  // send the inputs of the recording which are due: at their recorded time or, with --fast, once the output
+  // recorded before them is all in. with --mux, only as much as the window takes
+  while (s->stepIndex < replay.count)
+    {
+      struct recordStep* r = &replay.steps[s->stepIndex];
+      if (r->type != RECORD_INPUT)
+	{ s->stepIndex++; continue; }
+      if (s->stepSent == 0)
+	{
+	  s->next = s->began;
+	  addMs(&s->next, r->at/1e6);
+	  s->waiting = fast && s->replayed < outputBefore[s->stepIndex];
+	  if ( s->waiting || (!fast && msBetween(&s->next, now) < 0) )
+	    return;
+	}
+      int chunk = r->len - s->stepSent < FRAME_MAX ? r->len - s->stepSent : FRAME_MAX;
+      if (compressSpec.mux && chunk > s->sendWindow) // wait for credit
+	chunk = s->sendWindow;
+      if (chunk <= 0)
+	return;
+      sendFrame(s, r->data + s->stepSent, chunk);
+      if ( (s->stepSent += chunk) < r->len )
+	continue;
+      s->sentAt[s->stepIndex++] = *now;
+      s->stepSent = 0;
+    }
+  s->waiting = 1; // all sent, only output to come
+  replayReceived(s, 0, now); // maybe there is none
+}
+
+void startRound(struct loadSession* s, int index)
+{
+  // prepare the next line to type, ending in Enter, and the token its output ends with
+  s->tokenLen = snprintf(s->token, sizeof(s->token), "lg%d.%d\r\n", index, s->rounds);
+  if (script == SCRIPT_KEYSTROKE)
+    s->lineLen = snprintf(s->line, sizeof(s->line), "echo %.*s\r", s->tokenLen-2, s->token);
+  else if (script == SCRIPT_INTERRUPT) // runs until interrupted
+    s->lineLen = snprintf(s->line, sizeof(s->line), "%s\r", command);
+  else
+    s->lineLen = snprintf(s->line, sizeof(s->line), "%s; echo %.*s\r", command, s->tokenLen-2, s->token);
+  s->typed = 0;
+}
+
+void step(struct loadSession* s, const struct timespec* now)
+{
+  // send whatever is due: the next keystroke, in bulk mode the whole command line at once, or the ^C
+  if (script == SCRIPT_REPLAY)
+    {
+      if (!s->closing)
+	replayStep(s, now);
+      return;
+    }
+  if (s->paused && !s->closing && msBetween(&s->next, now) >= 0) // enough output has piled up
+    {
+      sendUrgent(s, MUX_INTERRUPT);
+      s->paused = 0;
+      s->interrupted = 1;
+      s->sent = *now;
+      return;
+    }
+  if (s->waiting || s->closing || msBetween(&s->next, now) < 0)
+    return;
+  if ( compressSpec.mux && s->sendWindow < (script == SCRIPT_KEYSTROKE ? 1 : s->lineLen) ) // wait for credit
+    return;
+  if (script != SCRIPT_KEYSTROKE)
+    {
+      sendFrame(s, s->line, s->lineLen);
+      s->typed = s->lineLen;
+    }
+  else
+    sendFrame(s, s->line + s->typed++, 1);
+
+  if (s->typed == s->lineLen)
+    {
+      s->sent = *now;
+      s->waiting = 1;
+    }
+  else
+    addMs(&s->next, intervalMs);
+}
+
+void received(struct loadSession* s, int index, const char* data, int size, const struct timespec* now)
+{
+  // look for the token in the output, keeping only as much of it as a token split across reads needs
+  dataReceived += size;
+  if (compressSpec.mux && (s->creditOwed += size) >= MUX_CREDIT_BATCH) // consumed as soon as it is read
+    {
+      sendControl(s, MUX_CREDIT, s->creditOwed, 4);
+      s->creditOwed = 0;
+    }
+  if (script == SCRIPT_REPLAY)
+    {
+      replayReceived(s, size, now);
+      return;
+    }
+  if (!s->waiting)
+    return;
+  if (script == SCRIPT_INTERRUPT) // the first output starts the pause, nothing is read until the ^C
+    {
+      if (!s->paused && !s->interrupted)
+	{
+	  s->paused = 1;
+	  s->next = *now;
+	  addMs(&s->next, intervalMs);
+	}
+      return;
+    }
+  int keep = s->recentLen < MATCH_KEEP ? s->recentLen : MATCH_KEEP;
+  memmove(s->recent, s->recent + s->recentLen - keep, keep);
+  s->recentLen = keep;
+  for (int done=0; done<size; )
+    {
+      int chunk = size-done < FEED_MAX ? size-done : FEED_MAX;
+      memcpy(s->recent + s->recentLen, data+done, chunk);
+      s->recentLen += chunk;
+      done += chunk;
+      if ( memmem(s->recent, s->recentLen, s->token, s->tokenLen) != NULL )
+	{
+	  recordLatency(msBetween(&s->sent, now));
+	  s->waiting = 0;
+	  s->recentLen = 0;
+	  s->rounds++;
+	  s->next = *now;
+	  addMs(&s->next, intervalMs);
+	  startRound(s, index);
+	  return;
+	}
+      keep = s->recentLen < MATCH_KEEP ? s->recentLen : MATCH_KEEP;
+      memmove(s->recent, s->recent + s->recentLen - keep, keep);
+      s->recentLen = keep;
+    }
+}
+
+long cpuTicks(pid_t pid, pid_t* parent, int withChildren)
+{
+  // utime+stime of a process from /proc, plus that of its children which it has waited for, -1 if it's gone
+  char path [64], text [1024];
+  snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+  FILE* f = fopen(path, "r");
+  if (f == NULL)
+    return -1;
+  int n = fread(text, 1, sizeof(text)-1, f);
+  fclose(f);
+  text[n > 0 ? n : 0] = '\0';
+  char* p = strrchr(text, ')'); // the command name may contain anything, fields start after it
+  int ppid;
+  unsigned long utime, stime;
+  long cutime, cstime;
+  if ( p == NULL || sscanf(p+2, "%*c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu %ld %ld", &ppid, &utime, &stime, &cutime, &cstime) != 5 )
+    return -1;
+  if (parent)
+    *parent = ppid;
+  return utime + stime + (withChildren ? cutime + cstime : 0);
+}
+
+void serverCpu(long* server, long* shells)
+{
+  // cpu ticks of the server itself, and of its children (the shells) which are still running, including the
+  // commands they ran and waited for
+  *server = cpuTicks(serverPid, NULL, 0);
+  *shells = 0;
+  DIR* proc = opendir("/proc");
+  struct dirent* entry;
+  while ( proc && (entry = readdir(proc)) != NULL )
+    {
+      pid_t pid = atoi(entry->d_name), parent;
+      long ticks;
+      if ( pid > 0 && (ticks = cpuTicks(pid, &parent, 1)) >= 0 && parent == serverPid )
+	*shells += ticks;
+    }
+  if (proc)
+    closedir(proc);
+}
+
+int serverShells(pid_t* shells, int cap)
+{
+  // pids of the server's children, i.e. of its shells, as serverCpu() finds them
+  int count = 0;
+  DIR* proc = opendir("/proc");
+  struct dirent* entry;
+  while ( proc && count < cap && (entry = readdir(proc)) != NULL )
+    {
+      pid_t pid = atoi(entry->d_name), parent;
+      if ( pid > 0 && cpuTicks(pid, &parent, 0) >= 0 && parent == serverPid )
+	shells[count++] = pid;
+    }
+  if (proc)
+    closedir(proc);
+  return count;
+}
+
+long serverMemory(const char* field)
+{
+  // a "VmRSS:"/"VmHWM:" line of the server's /proc status, in KB
+  char path [64], line [256];
+  long kb = -1;
+  snprintf(path, sizeof(path), "/proc/%d/status", (int)serverPid);
+  FILE* f = fopen(path, "r");
+  while ( f && fgets(line, sizeof(line), f) )
+    if ( strncmp(line, field, strlen(field)) == 0 )
+      kb = atol(line + strlen(field));
+  if (f)
+    fclose(f);
+  return kb;
+}
+
+int byValue(const void* a, const void* b)
+{
+  double x = *(const double*)a, y = *(const double*)b;
+  return x < y ? -1 : x > y;
+}
+
+double percentile(double p)
+{
+  int i = (int)(p/100 * latencyCount);
+  return latencies[i < latencyCount ? i : latencyCount-1];
+}
+
+void compareResults(const char* names[], const double values[], int count)
+{
+  // print every figure next to the one --baseline has for it, and how much it changed
+  FILE* f = fopen(baselinePath, "r");
+  if (f == NULL)
+    { fprintf(stderr, "Unable to open baseline %s with message %s\n", baselinePath, strerror(errno)); return; }
+  char line [256], name [64];
+  double base;
+  printf("against %s:\n", baselinePath);
+  while ( fgets(line, sizeof(line), f) )
+    {
+      if ( sscanf(line, "%63s %lf", name, &base) != 2 )
+	continue;
+      for (int i=0; i<count; i++)
+	if ( strcmp(names[i], name) == 0 )
+	  {
+	    if (base != 0)
+	      printf("  %-24s %14.3f -> %14.3f  %+7.1f%%\n", name, base, values[i], (values[i]-base)*100/base);
+	    else
+	      printf("  %-24s %14.3f -> %14.3f\n", name, base, values[i]);
+	  }
+    }
+  fclose(f);
+}
+
+void report(double seconds, double clientCpu, long serverTicks, long shellTicks, long rss)
+{
+  const char* names [METRICS_MAX]; // the figures below, for --results and --baseline
+  double values [METRICS_MAX];
+  int count = 0;
+  printf("%d %s sessions%s over %s for %.1f s, codec %s\n", sessionCount, scriptNames[script],
+	 compressSpec.mux ? " on one connection" : "", local ? "the same-host socket" : "tcp", seconds, sessions[0].codec->codec->name);
+  if (latencyCount > 0)
+    {
+      qsort(latencies, latencyCount, sizeof(double), byValue);
+      printf("%s latency (ms) over %d round trips: p50 %.3f  p90 %.3f  p99 %.3f  p99.9 %.3f  max %.3f\n",
+	     script == SCRIPT_BULK ? "command" : script == SCRIPT_INTERRUPT ? "interrupt-to-answer" : script == SCRIPT_REPLAY ? "input-to-output" : "keystroke-to-echo",
+	     latencyCount, percentile(50), percentile(90), percentile(99), percentile(99.9), latencies[latencyCount-1]);
+      names[count] = "latency_p50_ms"; values[count++] = percentile(50);
+      names[count] = "latency_p90_ms"; values[count++] = percentile(90);
+      names[count] = "latency_p99_ms"; values[count++] = percentile(99);
+      names[count] = "latency_p99.9_ms"; values[count++] = percentile(99.9);
+      names[count] = "latency_max_ms"; values[count++] = latencies[latencyCount-1];
+    }
+  else
+    printf("no round trips completed\n");
+  printf("client->server: %.0f bytes/s on the wire, %.0f bytes/s of data\n", wireSent/seconds, dataSent/seconds);
+  printf("server->client: %.0f bytes/s on the wire, %.0f bytes/s of data\n", wireReceived/seconds, dataReceived/seconds);
+  names[count] = "seconds"; values[count++] = seconds;
+  names[count] = "round_trips"; values[count++] = latencyCount;
+  names[count] = "sent_wire_bytes_per_s"; values[count++] = wireSent/seconds;
+  names[count] = "sent_data_bytes_per_s"; values[count++] = dataSent/seconds;
+  names[count] = "received_wire_bytes_per_s"; values[count++] = wireReceived/seconds;
+  names[count] = "received_data_bytes_per_s"; values[count++] = dataReceived/seconds;
+  printf("cpu per session: load generator %.3f ms/s", clientCpu*1000/seconds/sessionCount);
+  names[count] = "generator_cpu_ms_per_s"; values[count++] = clientCpu*1000/seconds/sessionCount;
+  if (serverPid)
+    {
+      double tick = 1000.0/sysconf(_SC_CLK_TCK);
+      printf(", server %.3f ms/s, shells %.3f ms/s\n", serverTicks*tick/seconds/sessionCount, shellTicks*tick/seconds/sessionCount);
+      printf("server rss: %ld KB, peak %ld KB\n", rss, serverMemory("VmHWM:"));
+      names[count] = "server_cpu_ms_per_s"; values[count++] = serverTicks*tick/seconds/sessionCount;
+      names[count] = "server_rss_kb"; values[count++] = rss;
+    }
+  else
+    printf("\n");
+  if (viewersPerShell)
+    {
+      printf("viewers: %d per shell, each %.0f bytes/s on the wire, %.0f bytes/s of data\n", viewersPerShell,
+	     viewerWire/seconds/viewerCount, viewerData/seconds/viewerCount);
+      names[count] = "viewer_wire_bytes_per_s"; values[count++] = viewerWire/seconds/viewerCount;
+      names[count] = "viewer_data_bytes_per_s"; values[count++] = viewerData/seconds/viewerCount;
+    }
+
+  if (resultsPath)
+    {
+      FILE* f = fopen(resultsPath, "w");
+      for (int i=0; f && i<count; i++)
+	fprintf(f, "%s %.6f\n", names[i], values[i]);
+      if ( f == NULL || fclose(f) == EOF )
+	fprintf(stderr, "Unable to write results to %s with message %s\n", resultsPath, strerror(errno));
+    }
+  if (baselinePath)
+    compareResults(names, values, count);
+}
+
+double cpuSeconds(void)
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec)/1e6;
+}
+
+void closedByServer(struct loadSession* s, int index)
+{
+  if (!s->closing && !(script == SCRIPT_INTERRUPT && s->rounds > 0)) // an interrupt ends the shell as well
+    fprintf(stderr, "session %d closed by the server\n", index);
+  s->closed = 1;
+}
+
+int channelMessage(int first, const char* data, int size, const struct timespec* now)
+{
+  // hand a message from the server to the session whose channel it is for (a control message, or with --mux any
+  // message; first is the session on channel 0), returning 1 if that closed it
+  struct muxMessage m;
+  if ( muxUnpack(data, size, &m) == -1 || first + m.channel >= sessionCount )
+    { fprintf(stderr, "bad channel message\n"); exit(1); }
+  struct loadSession* s = &sessions[first + m.channel];
+  if (m.type == MUX_DATA && s->interrupted) // from before the ^C landed
+    dataReceived += m.len;
+  else if (m.type == MUX_DATA)
+    received(s, first + m.channel, m.payload, m.len, now);
+  else if (m.type == MUX_CREDIT)
+    s->sendWindow = s->sendWindow > MUX_WINDOW - m.credit ? MUX_WINDOW : s->sendWindow + m.credit;
+  else if (m.type == MUX_INTERRUPT && s->interrupted)
+    {
+      recordLatency(msBetween(&s->sent, now));
+      s->interrupted = 0;
+      s->waiting = 0;
+      s->rounds++;
+    }
+  else if (m.type == MUX_CLOSE && !s->closed)
+    {
+      closedByServer(s, first + m.channel);
+      return 1;
+    }
+  return 0;
+}
+
+void openViewers(char* port)
+{
+  // --viewers: watch every shell the server runs, which once our sessions have their handshakes done includes theirs
+  pid_t shells [SHELLS_MAX];
+  int shellCount = serverShells(shells, SHELLS_MAX);
+  if (shellCount < sessionCount)
+    { fprintf(stderr, "found %d shells of server %d, expected %d\n", shellCount, (int)serverPid, sessionCount); exit(1); }
+  viewerCount = shellCount * viewersPerShell;
+  if ( (viewers = calloc(viewerCount, sizeof(struct loadViewer))) == NULL )
+    { fprintf(stderr, "Memory allocation issue!\n"); exit(1); }
+  struct codecSpec want = compressSpec, agreed;
+  want.mux = want.echo = 0;
+  for (int i=0; i<viewerCount; i++)
+    {
+      want.watch = shells[i / viewersPerShell];
+      viewers[i].socket = connectToServer(port);
+      if ( codecHandshakeClient(viewers[i].socket, &want, &agreed) == -1 )
+	{ fprintf(stderr, "viewer handshake failure with message %s\n", strerror(errno)); exit(1); }
+      if ( codecInit(&viewers[i].codec, &agreed, &dictionary) == -1 )
+	{ fprintf(stderr, "codecInit() failure for codec %s\n", codecFind(agreed.id)->name); exit(1); }
+    }
+}
+
+void readViewer(struct loadViewer* v)
+{
+  // decode whatever a viewer was sent; a resync the decoder couldn't follow would fail here
+  char buf [FEED_MAX], data [FRAME_MAX];
+  int x = read(v->socket, buf, sizeof(buf)), dataSize;
+  if (x <= 0) // the shell is gone
+    {
+      if (x == -1)
+	fprintf(stderr, "read() failure with message %s\n", strerror(errno));
+      close(v->socket);
+      v->closed = 1;
+      return;
+    }
+  viewerWire += x;
+  if ( codecFeed(&v->codec, buf, x) == -1 )
+    { fprintf(stderr, "frame overflow at viewer\n"); exit(1); }
+  while ( (dataSize = codecNextFrame(&v->codec, data, sizeof(data))) > 0 )
+    viewerData += dataSize;
+  if (dataSize == -1)
+    { fprintf(stderr, "%s decode failure at viewer\n", v->codec.codec->name); exit(1); }
+}
+
+void runSessions(void)
+{
+  int pollCount = compressSpec.mux ? 1 : sessionCount; // one socket for all sessions with --mux
+  struct pollfd* fds = malloc((sessionCount + viewerCount) * sizeof(struct pollfd));
+  if (fds == NULL)
+    { fprintf(stderr, "Memory allocation issue!\n"); exit(1); }
+  struct timespec start, now, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i=0; i<sessionCount; i++)
+    {
+      sessions[i].next = start;
+      addMs(&sessions[i].next, (double)intervalMs * i / sessionCount); // spread out over one interval
+      sessions[i].began = sessions[i].next;
+      if (script != SCRIPT_REPLAY)
+	startRound(&sessions[i], i);
+      fds[i] = (struct pollfd){ sessions[i].socket, POLLIN, 0 };
+    }
+  end = start;
+  addMs(&end, duration*1000);
+
+  long serverStart = 0, shellsStart = 0, serverEnd = 0, shellsEnd = 0, rss = 0;
+  double cpuStart = cpuSeconds();
+  if (serverPid)
+    serverCpu(&serverStart, &shellsStart);
+
+  int live = sessionCount, stopping = 0;
+  while (live > 0)
+    {
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      if ( !stopping && (msBetween(&end, &now) >= 0 || replaysDone == sessionCount) ) // time is up (or the replay done): sample the server before the shells go away, then hang up
+	{
+	  stopping = 1;
+	  if (msBetween(&end, &now) < 0)
+	    end = now;
+	  if (serverPid)
+	    {
+	      serverCpu(&serverEnd, &shellsEnd);
+	      rss = serverMemory("VmRSS:");
+	    }
+	  for (int i=0; i<sessionCount; i++)
+	    if (!sessions[i].closed && !sessions[i].closing)
+	      {
+		sendUrgent(&sessions[i], MUX_EOF);
+		sessions[i].closing = 1;
+	      }
+	}
+
+      int timeout = stopping ? -1 : (int)msBetween(&now, &end) + 1;
+      for (int i=0; i<sessionCount && !stopping; i++)
+	{
+	  step(&sessions[i], &now);
+	  int t = (int)msBetween(&now, &sessions[i].next) + 1;
+	  if ( (!sessions[i].waiting || sessions[i].paused) && t < timeout )
+	    timeout = t > 0 ? t : 0;
+	}
+      for (int i=0; i<pollCount && !compressSpec.mux; i++) // a paused session's output piles up on the server
+	fds[i].events = sessions[i].paused ? 0 : POLLIN;
+      for (int i=0; i<viewerCount; i++) // after the sessions' sockets, viewers always read
+	fds[pollCount+i] = (struct pollfd){ viewers[i].closed ? -1 : viewers[i].socket, POLLIN, 0 };
+
+      if ( poll(fds, pollCount + viewerCount, timeout) < 0 )
+	{ fprintf(stderr, "Poll failure with message %s\n", strerror(errno)); exit(1); }
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      for (int i=0; i<pollCount; i++)
+	{
+	  if ( !(fds[i].revents & (POLLIN|POLLERR|POLLHUP)) )
+	    continue;
+	  struct loadSession* s = &sessions[i];
+	  char buf [FEED_MAX];
+	  int x = read(s->socket, buf, sizeof(buf));
+	  if (x <= 0) // server hung up
+	    {
+	      if (x == -1)
+		fprintf(stderr, "read() failure with message %s\n", strerror(errno));
+	      for (int j = compressSpec.mux ? 0 : i; j < (compressSpec.mux ? sessionCount : i+1); j++) // with --mux, on all of them
+		if (!sessions[j].closed)
+		  {
+		    closedByServer(&sessions[j], j);
+		    live--;
+		  }
+	      fds[i].fd = -1;
+	      close(s->socket);
+	      continue;
+	    }
+	  wireReceived += x;
+	  if ( codecFeed(s->codec, buf, x) == -1 )
+	    { fprintf(stderr, "frame overflow\n"); exit(1); }
+	  char data [FRAME_MAX];
+	  int dataSize;
+	  while ( (dataSize = codecNextFrame(s->codec, data, sizeof(data))) > 0 )
+	    {
+	      if (compressSpec.mux || s->codec->urgent)
+		live -= channelMessage(i, data, dataSize, &now);
+	      else if (s->interrupted) // from before the ^C landed
+		dataReceived += dataSize;
+	      else
+		received(s, i, data, dataSize, &now);
+	    }
+	  if (dataSize == -1)
+	    { fprintf(stderr, "%s decode failure\n", s->codec->codec->name); exit(1); }
+	}
+      for (int i=0; i<viewerCount; i++)
+	if (fds[pollCount+i].revents & (POLLIN|POLLERR|POLLHUP))
+	  readViewer(&viewers[i]);
+    }
+  if (compressSpec.mux && fds[0].fd != -1) // every channel closed, now the connection
+    close(fds[0].fd);
+  if (!stopping) // every session ended before time was up (an interrupt kills the shell), sample the server now
+    {
+      end = now;
+      if (serverPid)
+	{
+	  serverCpu(&serverEnd, &shellsEnd);
+	  rss = serverMemory("VmRSS:");
+	}
+    }
+
+  report(msBetween(&start, &end)/1000, cpuSeconds()-cpuStart, serverEnd-serverStart, shellsEnd-shellsStart, rss);
+  free(fds);
+}
+
+int main(int argc, char* argv[])
+{
+  static struct option long_options[] = {
+    {"port", required_argument, 0, 'p'}, // port part2Server listens on
+    {"sessions", required_argument, 0, 'n'}, // concurrent sessions to open
+    {"script", required_argument, 0, 's'}, // keystroke, bulk or interrupt
+    {"interval", required_argument, 0, 'i'}, // ms between keystrokes, or between bulk commands
+    {"duration", required_argument, 0, 't'}, // seconds to run for
+    {"command", required_argument, 0, 'C'}, // command the bulk or interrupt script runs
+    {"compress", optional_argument, 0, 'c'}, // same as part2Client --compress
+    {"dict", required_argument, 0, 'd'}, // same as part2Client --dict
+    {"server-pid", required_argument, 0, 'P'}, // report cpu and memory of this server process
+    {"mux", no_argument, 0, 'x'}, // run every session as a channel of one connection
+    {"replay", required_argument, 0, 'r'}, // recording to play with the replay script (which this implies), see record.h
+    {"fast", no_argument, 0, 'f'}, // replay as fast as the server answers, not at recorded times
+    {"results", required_argument, 0, 'R'}, // save the report's figures to this file
+    {"baseline", required_argument, 0, 'B'}, // compare the report with figures saved by --results
+    {"tcp", no_argument, 0, 'T'}, // connect over tcp, not the server's same-host socket
+    {"viewers", required_argument, 0, 'V'}, // read-only viewers to watch each shell with, needs --server-pid
+    {0,0,0,0}
+  };
+
+  int in;
+  char* port = NULL;
+  while ( ( in = getopt_long(argc, argv, "", long_options, NULL) ) != -1 )
+    {
+      if (in == 'p')
+	port = optarg;
+      else if (in == 'n')
+	sessionCount = atoi(optarg);
+      else if (in == 's')
+	{
+	  if (strcmp(optarg, "keystroke") == 0)
+	    script = SCRIPT_KEYSTROKE;
+	  else if (strcmp(optarg, "bulk") == 0)
+	    script = SCRIPT_BULK;
+	  else if (strcmp(optarg, "interrupt") == 0)
+	    script = SCRIPT_INTERRUPT;
+	  else if (strcmp(optarg, "replay") == 0)
+	    script = SCRIPT_REPLAY;
+	  else
+	    { fprintf(stderr, "Unrecognized --script %s\n", optarg); exit(1); }
+	}
+      else if (in == 'i')
+	intervalMs = atoi(optarg);
+      else if (in == 't')
+	duration = atof(optarg);
+      else if (in == 'C')
+	command = optarg;
+      else if (in == 'c')
+	{
+	  if ( codecParseSpec(optarg, &compressSpec) == -1 )
+	    { fprintf(stderr, "Unrecognized --compress codec %s\n", optarg); exit(1); }
+	}
+      else if (in == 'd')
+	{
+	  if ( codecLoadDictionary(optarg, &dictionary) == -1 )
+	    { fprintf(stderr, "Unable to load dictionary %s with message %s\n", optarg, strerror(errno)); exit(1); }
+	  compressSpec.dictId = dictionary.id;
+	}
+      else if (in == 'P')
+	serverPid = atoi(optarg);
+      else if (in == 'x')
+	compressSpec.mux = 1;
+      else if (in == 'r')
+	{
+	  loadReplay(optarg);
+	  script = SCRIPT_REPLAY;
+	}
+      else if (in == 'f')
+	fast = 1;
+      else if (in == 'R')
+	resultsPath = optarg;
+      else if (in == 'B')
+	baselinePath = optarg;
+      else if (in == 'T')
+	tcpOnly = 1;
+      else if (in == 'V')
+	viewersPerShell = atoi(optarg);
+      else if (in == '?')
+	{ fprintf(stderr, "Unrecognized argument\n"); exit(1); }
+    }
+  if (command == NULL)
+    command = script == SCRIPT_INTERRUPT ? DEFAULT_INTERRUPT_COMMAND : DEFAULT_BULK_COMMAND;
+  if (duration == 0)
+    duration = script == SCRIPT_REPLAY ? REPLAY_DURATION : 10;
+  if (port == NULL || sessionCount < 1 || (compressSpec.mux && sessionCount > MUX_CHANNELS) || intervalMs < 0 || duration <= 0 || strlen(command) > FRAME_MAX/2
+      || (script == SCRIPT_REPLAY) != (replay.data != NULL) || viewersPerShell < 0 || (viewersPerShell > 0 && !serverPid))
+    { fprintf(stderr, "Usage: loadGenerator --port=PORT [--sessions=N (up to %d with --mux)] [--script=keystroke|bulk|interrupt|replay] [--interval=MS] [--duration=S] [--command=CMD] [--replay=FILE] [--fast] [--compress[=codec]] [--dict=FILE] [--server-pid=PID] [--mux] [--results=FILE] [--baseline=FILE] [--tcp] [--viewers=N]\n", MUX_CHANNELS); exit(1); }
+
+  signal(SIGPIPE, SIG_IGN); // a server which hung up shows up as EPIPE instead
+  sessions = calloc(sessionCount, sizeof(struct loadSession));
+  if (sessions == NULL)
+    { fprintf(stderr, "Memory allocation issue!\n"); exit(1); }
+  for (int i=0; i<sessionCount; i++)
+    {
+      struct loadSession* s = &sessions[i];
+      struct codecSpec agreed;
+      if ( script == SCRIPT_REPLAY && (s->sentAt = calloc(replay.count+1, sizeof(struct timespec))) == NULL )
+	{ fprintf(stderr, "Memory allocation issue!\n"); exit(1); }
+      if (compressSpec.mux && i > 0) // another channel of the first session's connection
+	{
+	  s->socket = sessions[0].socket;
+	  s->codec = &sharedCodec;
+	}
+      else
+	{
+	  s->socket = connectToServer(port);
+	  s->codec = compressSpec.mux ? &sharedCodec : &s->ownCodec;
+	  if ( codecHandshakeClient(s->socket, &compressSpec, &agreed) == -1 )
+	    { fprintf(stderr, "handshake failure with message %s\n", strerror(errno)); exit(1); }
+	  if ( codecInit(s->codec, &agreed, &dictionary) == -1 )
+	    { fprintf(stderr, "codecInit() failure for codec %s\n", codecFind(agreed.id)->name); exit(1); }
+	  if ( coalesceNoDelay(s->socket) == -1 ) // like part2Client
+	    { fprintf(stderr, "setsockopt() failure with message %s\n", strerror(errno)); exit(1); }
+	}
+      if (compressSpec.mux)
+	{
+	  s->channel = i;
+	  s->sendWindow = MUX_WINDOW;
+	  sendControl(s, MUX_OPEN, 0, 0);
+	}
+    }
+
+  if (viewersPerShell)
+    openViewers(port);
+  runSessions();
+  for (int i=0; i < (compressSpec.mux ? 1 : sessionCount); i++)
+    codecEnd(sessions[i].codec);
+  for (int i=0; i<viewerCount; i++)
+    {
+      if (!viewers[i].closed)
+	close(viewers[i].socket);
+      codecEnd(&viewers[i].codec);
+    }
+  for (int i=0; i<sessionCount; i++)
+    free(sessions[i].sentAt);
+  recordFree(&replay);
+  free(outputBefore);
+  free(sessions);
+  free(viewers);
+  free(latencies);
+  exit(0);
+}
@@ -0,0 +1,80 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Implementation of the same-host transport declared in local.h.
+
+*/
+
+#define _GNU_SOURCE // struct ucred
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "local.h"
+
+static socklen_t localAddress(int port, struct sockaddr_un* address)
+{
+  // the abstract address for port: sun_path starts with a NUL, and its length is exactly that of the name
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  int len = snprintf(address->sun_path+1, sizeof(address->sun_path)-1, LOCAL_NAME, port);
+  return offsetof(struct sockaddr_un, sun_path) + 1 + len;
+}
+
+int localListen(int port)
+{
+  // listen for same-host clients, non-blocking like the tcp listener. -1 with errno set on failure
+  struct sockaddr_un address;
+  socklen_t len = localAddress(port, &address);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd == -1)
+    return -1;
+  if ( bind(fd, (struct sockaddr *) &address, len) == -1 || listen(fd, SOMAXCONN) == -1 )
+    {
+      int saved = errno;
+      close(fd);
+      errno = saved;
+      return -1;
+    }
+  return fd;
+}
+
+int localConnect(int port)
+{
+  // connect to a server on this host, -1 (with errno set) if none listens for port here
+  struct sockaddr_un address;
+  socklen_t len = localAddress(port, &address);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1)
+    return -1;
+  if ( connect(fd, (struct sockaddr *) &address, len) == -1 )
+    {
+      int saved = errno;
+      close(fd);
+      errno = saved;
+      return -1;
+    }
+  struct ucred peer;
+  socklen_t peerLen = sizeof(peer);
+  if ( getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &peerLen) == -1 )
+    {
+      int saved = errno;
+      close(fd);
+      errno = saved;
+      return -1;
+    }
+  if ( peer.uid != getuid() && peer.uid != 0 ) // any user can take an abstract name: only trust a listener run by us or root
+    {
+      close(fd);
+      errno = EACCES;
+      return -1;
+    }
+  return fd;
+}
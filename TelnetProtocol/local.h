@@ -0,0 +1,28 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Same-host transport, shared by part2Server.c, part2Client.c and loadGenerator.c. Clients only ever connect to a
+server on their own machine, where a TCP connection over loopback still goes through the whole TCP/IP stack (and
+its Nagle and delayed ack timers) for every keystroke and every chunk of output. So besides its TCP port, the
+server listens on a UNIX stream socket named after the port in the abstract namespace (nothing on disk to clean
+up), and clients try that first, falling back to TCP if no server answers there (an older server, or one in
+another network namespace). Everything above the socket, from the hello on, is the same either way.
+
+Abstract names have no permissions, so any local user could claim one first. Clients check with SO_PEERCRED that
+whoever answers runs as them or as root, and use TCP otherwise; a server which finds its name taken just warns and
+serves over TCP, so holding the name can't keep it from starting either.
+
+*/
+
+#ifndef LOCAL_H
+#define LOCAL_H
+
+#define LOCAL_NAME "part2Server.%d" // abstract socket name, after the leading NUL, for a port
+
+int localListen(int port);
+int localConnect(int port);
+
+#endif
@@ -0,0 +1,188 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Implementation of the LZ block codec declared in lz.h. The compressor hashes the next 4 bytes at every
+position into a table of recent positions, and on a hit extends the match as far as it goes. Both functions
+return the number of bytes written to dst, or -1 if dst is too small (compressor) or the input is malformed
+(decompressor); the decompressor never reads or writes outside of the buffers it is given.
+
+Positions are "virtual": the dictionary (if any) occupies positions [0, dict->len) and the block follows it,
+so a single hash table and a single offset space cover both. A match found in the dictionary is not extended
+past the dictionary's end, which keeps the inner loops free of boundary checks.
+
+*/
+
+#include <string.h>
+#include <stdint.h>
+#include "lz.h"
+
+#define LZ_LAST_LITERALS 5 // the format requires the last 5 bytes of a block to be literals
+#define LZ_MF_LIMIT 12 // and the last match to start at least 12 bytes before the end
+#define LZ_SKIP_TRIGGER 6 // after 2^6 misses in a row start skipping ahead faster through incompressible data
+
+static uint32_t read32(const unsigned char* p)
+{
+  uint32_t v;
+  memcpy(&v, p, sizeof(v)); // unaligned safe load
+  return v;
+}
+
+static unsigned hashOf(uint32_t v)
+{
+  return (v * 2654435761u) >> (32 - LZ_HASH_LOG);
+}
+
+static int writeLength(unsigned char* dst, int op, int dstCap, int len)
+{
+  // write the 255-continued extension of a literal/match length which didn't fit into its token nibble
+  for (; len >= 255; len -= 255)
+    {
+      if (op >= dstCap) return -1;
+      dst[op++] = 255;
+    }
+  if (op >= dstCap) return -1;
+  dst[op++] = (unsigned char)len;
+  return op;
+}
+
+static int emitSequence(unsigned char* dst, int op, int dstCap, const unsigned char* lit, int litLen, int offset, int matchLen)
+{
+  // emit one token + literals (+ offset and match length, unless this is the final literal only sequence)
+  if (op >= dstCap) return -1;
+  int token = op++;
+  dst[token] = (unsigned char)((litLen >= 15 ? 15 : litLen) << 4);
+  if (litLen >= 15 && (op = writeLength(dst, op, dstCap, litLen-15)) < 0)
+    return -1;
+  if (op + litLen > dstCap) return -1;
+  memcpy(dst+op, lit, litLen);
+  op += litLen;
+  if (matchLen == 0) // last sequence carries no match
+    return op;
+
+  if (op + 2 > dstCap) return -1;
+  dst[op++] = (unsigned char)(offset & 0xff);
+  dst[op++] = (unsigned char)(offset >> 8);
+  matchLen -= LZ_MIN_MATCH;
+  dst[token] |= (unsigned char)(matchLen >= 15 ? 15 : matchLen);
+  if (matchLen >= 15 && (op = writeLength(dst, op, dstCap, matchLen-15)) < 0)
+    return -1;
+  return op;
+}
+
+void lzLoadDictionary(struct lzDictionary* dict, const char* data, int len)
+{
+  // keep (a pointer to) the tail of data which is still reachable by an offset, and index every position in it
+  if (len > LZ_MAX_OFFSET)
+    { data += len - LZ_MAX_OFFSET; len = LZ_MAX_OFFSET; }
+  dict->data = data;
+  dict->len = len;
+  memset(dict->table, 0xff, sizeof(dict->table));
+  for (int i=0; i+LZ_MIN_MATCH <= len; i++)
+    dict->table[hashOf(read32((const unsigned char*)data+i))] = i;
+}
+
+int lzCompressBound(int srcLen)
+{
+  return srcLen + srcLen/255 + 16;
+}
+
+int lzCompress(const char* source, int srcLen, char* dest, int dstCap, const struct lzDictionary* dict)
+{
+  const unsigned char* src = (const unsigned char*)source;
+  const unsigned char* dictData = dict ? (const unsigned char*)dict->data : NULL;
+  unsigned char* dst = (unsigned char*)dest;
+  int dictLen = dict ? dict->len : 0;
+  int table[1<<LZ_HASH_LOG];
+  int ip=0, anchor=0, op=0, misses=0;
+
+  if (dict) // start from the dictionary's positions instead of an empty table
+    memcpy(table, dict->table, sizeof(table));
+  else
+    memset(table, 0xff, sizeof(table)); // all entries -1, i.e. no earlier position
+  int matchLimit = srcLen - LZ_LAST_LITERALS;
+  while (ip < srcLen - LZ_MF_LIMIT)
+    {
+      uint32_t seq = read32(src+ip);
+      unsigned h = hashOf(seq);
+      int ref = table[h]; // virtual position of the last occurence of this hash
+      table[h] = dictLen + ip;
+      int offset = dictLen + ip - ref;
+      if (ref < 0 || offset > LZ_MAX_OFFSET)
+	{ ip += 1 + (misses++ >> LZ_SKIP_TRIGGER); continue; }
+
+      const unsigned char *refp, *refStart, *refEnd; // candidate match, and the buffer it lives in
+      if (ref < dictLen)
+	{ refp = dictData + ref; refStart = dictData; refEnd = dictData + dictLen; }
+      else
+	{ refp = src + (ref - dictLen); refStart = src; refEnd = src + srcLen; }
+      if (refEnd - refp < LZ_MIN_MATCH || read32(refp) != seq)
+	{ ip += 1 + (misses++ >> LZ_SKIP_TRIGGER); continue; }
+
+      while (refp > refStart && ip > anchor && refp[-1] == src[ip-1]) // extend the match backwards into pending literals
+	{ refp--; ip--; }
+      int len = LZ_MIN_MATCH;
+      while (ip+len < matchLimit && refp+len < refEnd && refp[len] == src[ip+len])
+	len++;
+
+      if ( (op = emitSequence(dst, op, dstCap, src+anchor, ip-anchor, offset, len)) < 0 )
+	return -1;
+      ip += len;
+      anchor = ip;
+      misses = 0;
+    }
+  return emitSequence(dst, op, dstCap, src+anchor, srcLen-anchor, 0, 0);
+}
+
+static int readLength(const unsigned char* src, int* ip, int srcLen, int len)
+{
+  // add the 255-continued extension to a length whose token nibble was saturated
+  unsigned char b;
+  do
+    {
+      if (*ip >= srcLen) return -1;
+      b = src[(*ip)++];
+      len += b;
+    }
+  while (b == 255);
+  return len;
+}
+
+int lzDecompress(const char* source, int srcLen, char* dest, int dstCap, const struct lzDictionary* dict)
+{
+  const unsigned char* src = (const unsigned char*)source;
+  const unsigned char* dictData = dict ? (const unsigned char*)dict->data : NULL;
+  unsigned char* dst = (unsigned char*)dest;
+  int dictLen = dict ? dict->len : 0;
+  int ip=0, op=0;
+
+  while (ip < srcLen)
+    {
+      int token = src[ip++];
+      int litLen = token >> 4;
+      if (litLen == 15 && (litLen = readLength(src, &ip, srcLen, litLen)) < 0)
+	return -1;
+      if (litLen > srcLen-ip || litLen > dstCap-op)
+	return -1;
+      memcpy(dst+op, src+ip, litLen);
+      ip += litLen;
+      op += litLen;
+      if (ip == srcLen) // final sequence has literals only
+	break;
+
+      if (ip+2 > srcLen) return -1;
+      int offset = src[ip] | (src[ip+1] << 8);
+      ip += 2;
+      if (offset == 0 || offset > op + dictLen) return -1;
+      int matchLen = token & 15;
+      if (matchLen == 15 && (matchLen = readLength(src, &ip, srcLen, matchLen)) < 0)
+	return -1;
+      matchLen += LZ_MIN_MATCH;
+      if (matchLen > dstCap-op) return -1;
+      for (int i=0; i<matchLen; i++, op++) // byte-wise copy, since the match may overlap the bytes it produces
+	dst[op] = op >= offset ? dst[op-offset] : dictData[dictLen + op - offset]; // before the block means in the dictionary
+    }
+  return op;
+}
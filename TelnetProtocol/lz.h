@@ -0,0 +1,37 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Small, dependency free LZ77 block codec which produces and consumes the LZ4 block format (token, literals,
+2 byte little endian offset, extended lengths). It keeps no history between blocks, so each block can be
+decoded on its own, which is what the framed transport in codec.c needs. It trades ratio for speed: there
+is a single hash table probe per position and no lazy matching.
+
+Both sides may share a preset dictionary, which acts as if it were the 64 KB of data preceding every block;
+matches may then point back into it. The dictionary's hash table is built once by lzLoadDictionary() and
+copied at the start of each block, so using one costs almost nothing per block.
+
+*/
+
+#ifndef LZ_H
+#define LZ_H
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_LOG 12
+#define LZ_MAX_OFFSET 65535
+
+struct lzDictionary
+{
+  const char* data; // last LZ_MAX_OFFSET bytes at most of the caller's dictionary, not copied
+  int len;
+  int table [1<<LZ_HASH_LOG]; // hash -> position in data, or -1
+};
+
+void lzLoadDictionary(struct lzDictionary* dict, const char* data, int len);
+int lzCompressBound(int srcLen);
+int lzCompress(const char* src, int srcLen, char* dst, int dstCap, const struct lzDictionary* dict);
+int lzDecompress(const char* src, int srcLen, char* dst, int dstCap, const struct lzDictionary* dict);
+
+#endif
@@ -0,0 +1,53 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Packing and unpacking of the channel messages declared in mux.h. Callers put MUX_DATA payloads right after a
+header written by muxHeader(), so output never has to be copied just to be framed; the small control messages
+are built whole by muxControl(). Functions return -1 with errno set on malformed input, and leave reporting it to
+the calling program.
+
+*/
+
+#include <errno.h>
+#include "mux.h"
+
+void muxHeader(char* frame, int type, int channel)
+{
+  frame[0] = (char)type;
+  frame[1] = (char)channel;
+}
+
+int muxControl(char* frame, int type, int channel, unsigned long value, int valueLen)
+{
+  // a message whose payload is value as valueLen (0-4) big endian bytes, returning its size
+  muxHeader(frame, type, channel);
+  for (int i=0; i<valueLen; i++)
+    frame[MUX_HEADER_SIZE+i] = (char)(value >> (8*(valueLen-1-i)));
+  return MUX_HEADER_SIZE + valueLen;
+}
+
+int muxUnpack(const char* frame, int len, struct muxMessage* m)
+{
+  const unsigned char* p = (const unsigned char*)frame;
+  if (len < MUX_HEADER_SIZE || p[0] > MUX_RESIZE || p[1] >= MUX_CHANNELS)
+    { errno = EPROTO; return -1; }
+  m->type = p[0];
+  m->channel = p[1];
+  m->payload = frame + MUX_HEADER_SIZE;
+  m->len = len - MUX_HEADER_SIZE;
+  m->credit = 0;
+  if (m->type == MUX_RESIZE && m->len != 4)
+    { errno = EPROTO; return -1; }
+  if (m->type == MUX_CREDIT)
+    {
+      if (m->len != 4 || p[2] & 0x80)
+	{ errno = EPROTO; return -1; }
+      m->credit = (p[2] << 24) | (p[3] << 16) | (p[4] << 8) | p[5];
+      if (m->credit <= 0 || m->credit > MUX_WINDOW) // never more than a whole window is outstanding
+	{ errno = EPROTO; return -1; }
+    }
+  return 0;
+}
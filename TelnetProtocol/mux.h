@@ -0,0 +1,73 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Channel multiplexing, shared by part2Client.c, part2Server.c and loadGenerator.c. A client which asks for it in
+the hello (part2Client --mux) can run up to MUX_CHANNELS shells over one connection, all sharing the connection's
+handshake, codec and compression streams. Every frame's data then starts with a two byte header, the message type
+and the channel it is about:
+
+	MUX_OPEN	client -> server: start a shell on the channel
+	MUX_DATA	either way: terminal input for, or output of, the channel's shell
+	MUX_CLOSE	client -> server: hang up the channel's shell. server -> client: the shell is gone (its
+			payload is its exit status and signal, a byte each, or empty if it never started), and the
+			channel may be opened again
+	MUX_CREDIT	either way: a 4 byte big endian count of MUX_DATA bytes the sender has consumed
+
+Three more messages carry the control events of every connection, multiplexed or not (on channel 0 then). They
+always travel in FRAME_URGENT frames (codec.h), which the server acts on as soon as they arrive, ahead of any
+input still queued for the shell:
+
+	MUX_INTERRUPT	client -> server: ^C. The shell's process group gets SIGINT, and its input and output
+			queued on the server are thrown away. server -> client: the interrupt landed, the output
+			which follows was written after it; the client drops the channel's output in between
+	MUX_EOF		client -> server: ^D. Input which arrived before it still reaches the shell, then its
+			input is closed
+	MUX_RESIZE	client -> server: the terminal's size, rows then columns, 2 bytes each big endian
+
+Each channel has its own flow control window in each direction: a side may have at most MUX_WINDOW bytes of
+MUX_DATA payload on a channel which the other side hasn't credited back yet. Credit is only given once data has
+left the receiver's buffers (reached the shell, or the terminal), so a channel whose reader stalls stops its own
+sender without holding up the others, and the server can always take a channel's data without ever blocking the
+connection. Credit is handed back in batches of at least half a window, so it costs one small frame per 16 KB.
+
+Messages for a channel which isn't open (e.g. crossing its MUX_CLOSE) are ignored.
+
+*/
+
+#ifndef MUX_H
+#define MUX_H
+
+#include "codec.h"
+
+#define MUX_HEADER_SIZE 2
+#define MUX_PAYLOAD_MAX (FRAME_MAX - MUX_HEADER_SIZE)
+#define MUX_CHANNELS 64
+#define MUX_WINDOW 32768 // initial credit of every channel, in each direction
+#define MUX_CREDIT_BATCH (MUX_WINDOW/2)
+#define MUX_CONTROL_MAX 8 // header plus the largest control payload
+
+#define MUX_OPEN 0
+#define MUX_DATA 1
+#define MUX_CLOSE 2
+#define MUX_CREDIT 3
+#define MUX_INTERRUPT 4
+#define MUX_EOF 5
+#define MUX_RESIZE 6
+
+struct muxMessage
+{
+  int type; // MUX_*
+  int channel;
+  const char* payload; // points into the frame it was unpacked from
+  int len;
+  int credit; // MUX_CREDIT only
+};
+
+void muxHeader(char* frame, int type, int channel);
+int muxControl(char* frame, int type, int channel, unsigned long value, int valueLen);
+int muxUnpack(const char* frame, int len, struct muxMessage* m);
+
+#endif
@@ -14,6 +14,9 @@ from which back and forth communication with the terminal will be managed.
 This file contains the source code for the first part of this project; the first few functions generally 
 pertain to an wrapper of system calls to check for errors more elegantly, the middle contains the 
 code for case with no argument and with a shell argument, and the final section contains main.
+
+Newlines are translated a whole read at a time (translate.h), and each read leads to one write per destination
+rather than one per character.
 */
 
 #include <termios.h>
@@ -26,9 +29,9 @@ code for case with no argument and with a shell argument, and the final section
 #include <sys/wait.h>
 #include <errno.h>
 #include <string.h>
+#include "translate.h"
 
-char cr = 0x0D; // constants 
-char lf = 0x0A; 
+#define BUF_SIZE 4096 // bytes per read, from stdin or the shell
 int eof = 0; // global vars
 int childKilled=0;
 pid_t ChildID;
@@ -112,24 +115,20 @@ void generalCase()
 {
 	
 
-  char buf [256];
-  int x;
+  char buf [BUF_SIZE];
+  char out [2*BUF_SIZE];
+  int x, outSize;
   int toExit=0;
   
-  /* read in from stdin 256 bytes at a time until eof found, printing characters as is to stdout
+  /* read in from stdin BUF_SIZE bytes at a time until eof found, printing characters as is to stdout
      with the exception of mapping any <cr> or <lf> occurence to <cr><lf> */
   while (!toExit)
   {
-    x = myread(0, buf, 256); // read 256 bytes from stdin into buf
-    for (int i=0; i<x; i++)
-      {
-	if (buf[i]==0x04) // if received eof, then exit
-	  toExit=1;
-	else if (buf[i]==cr || buf[i]==lf) // if received <cr> or <lf>, then map said occurence to <cr><lf>
-	  { mywrite(1, &cr, 1); mywrite(1, &lf, 1); }
-	else
-	  mywrite(1, &(buf[i]), 1); // otherwise write character exactly as is to stdout
-      }
+    x = myread(0, buf, BUF_SIZE); // read up to BUF_SIZE bytes from stdin into buf
+    if ( translate(buf, x, TRANSLATE_TO_TERMINAL|TRANSLATE_STOP_EOF, out, &outSize) < x ) // if received eof, then exit
+      toExit=1;
+    if (outSize > 0)
+      mywrite(1, out, outSize); // everything up to the eof, as one write
   }
   setExitTerminalModes(); // set exit terminal procedures
 }
@@ -182,7 +181,9 @@ void shellArgCase(char* prog)
 	{ setExitTerminalModes(); fprintf(stderr, "Error setting up signal, with message %s\n", strerror(errno)); exit(1); }
 
       int res;
-      char buf [256];
+      char buf [BUF_SIZE];
+      char out [2*BUF_SIZE];
+      int outSize;
       int eof=0;
       while(!eof)
 	{
@@ -193,29 +194,27 @@ void shellArgCase(char* prog)
 
 	    if ( fds[0].revents & POLLIN ) // stdin has input ready 
 	    {
-	      int x = myread(0, buf, 256); // perform read from stdin
-	      for (int i=0; i<x; i++)
+	      int x = myread(0, buf, BUF_SIZE); // perform read from stdin
+	      int stops = TRANSLATE_STOP_EOF|TRANSLATE_STOP_INTR;
+	      for (int i=0; i<x; )
 	      { 
+		// echo the keys up to the next ^C or ^D with <cr> or <lf> mapped to <cr><lf> as done earlier, and
+		// send them to the child with both mapped to <lf>
+		translate(buf+i, x-i, TRANSLATE_TO_TERMINAL|stops, out, &outSize);
+		if (outSize > 0)
+		  mywrite(1, out, outSize);
+		i += translate(buf+i, x-i, TRANSLATE_TO_SHELL|stops, out, &outSize);
+		if (outSize > 0)
+		  mywrite(pipeEnteringChild[1], out, outSize);
+		if (i == x)
+		  break;
 		if (buf[i]==0x04)
 		  myclose(pipeEnteringChild[1]); // don't set eof here; only once eof from shell received
-		else if (buf[i]==0x03) // ^C, or siginterrupt command to be given to the child
-		  {
-		    if ( kill(ChildID,SIGINT)<0 )
-		      { setExitTerminalModes(); fprintf(stderr, "Kill to child failure, with message %s\n", strerror(errno)); exit(1); }
-		    else
-		      childKilled=1; // mark killed
-		  }
-		else if (buf[i]==cr || buf[i]==lf)
-		  {
-		    // map <cr> or <lf> to <cr><lf> as done earlier
-		    mywrite(1, &cr, 1); mywrite(1, &lf, 1);
-		    mywrite(pipeEnteringChild[1], &lf, 1);
-		  }
+		else if ( kill(ChildID,SIGINT)<0 ) // ^C, or siginterrupt command to be given to the child
+		  { setExitTerminalModes(); fprintf(stderr, "Kill to child failure, with message %s\n", strerror(errno)); exit(1); }
 		else
-		  {
-		    mywrite(1, &(buf[i]), 1); // if normal character, just write to child as is 
-		    mywrite(pipeEnteringChild[1], &(buf[i]), 1);
-		  }
+		  childKilled=1; // mark killed
+		i++;
 	      }
 	      fds[0].revents = 0;
 	    }
@@ -223,16 +222,11 @@ void shellArgCase(char* prog)
 
 	   else if ( fds[1].revents & POLLIN ) // if shell has input for the terminal
 	   {	    
-	     int y = myread(pipeExitingChild[0], buf, 256); // read from shell
-	     for (int i=0; i<y; i++) 
-	     {
-	      if (buf[i]==0x04) // if shell sent us an eof, set eof
-		{ eof=1; break; }
-	      else if (buf[i]==lf) // if shell sent us an <lf> map to <cr><lf>
-		{ mywrite(1, &cr, 1); mywrite(1, &lf, 1); }
-	      else // otherwise map as is
-		mywrite(1, &(buf[i]), 1);
-	     }
+	     int y = myread(pipeExitingChild[0], buf, BUF_SIZE); // read from shell
+	     if ( translate(buf, y, TRANSLATE_FROM_SHELL|TRANSLATE_STOP_EOF, out, &outSize) < y ) // if shell sent us an eof, set eof
+	       eof=1;
+	     if (outSize > 0) // every <lf> mapped to <cr><lf>, the rest as is
+	       mywrite(1, out, outSize);
 	     fds[1].revents = 0;
 	   }
 
@@ -7,9 +7,26 @@ NAME: Mihir Arya
 This aspect of the telnet project is a continuation of part 1. This file contains all client side acitivites 
 needed to process user-input from stdin, send it to a specified port on a specified remote client using TCP 
 socket programming, and then receive and process the input from that remote client. Logging options can be specified, 
-to record all read/write transactions between the client and the server to stdout. Additionally, a compression option 
+to record all read/write transactions between the client and the server to a file; the log is written by a background 
+thread (sessionLog.c) so that the session never waits on the disk. Additionally, a compression option 
 can be specified, which will compress any data being sent to the client, and also decompress any data being received 
-from the same. 
+from the same. With --mux, the connection carries several shells on separate channels (mux.h): ^] followed by a 
+digit switches the terminal to that channel, starting its shell the first time, and the output of channels in the 
+background is held (and, by withholding credit, paused on the server) until they are switched to. ^C, ^D and
+changes of the terminal's size go to the server as urgent control messages, ahead of anything queued; after a ^C,
+output is dropped until the server answers that the interrupt landed, so that it stops right away rather than
+once everything already on the way has been printed.
+With --predict, the server edits and echoes each line (lineEdit.h) instead of the client echoing keys blindly,
+and the client, which runs the same line editor, draws the echo of every key as soon as it is typed, underlined
+until the server's echo confirms it. Typing and erasing on the current line thus show up without waiting a round
+trip, while what ends up on the screen is always what the server sent: output which doesn't match the expected
+echo wipes the guesses off the screen first, and they reappear once their echo really arrives.
+With --watch=PID, the client runs no shell of its own but watches the server's shell PID (as shown by its --stats)
+read-only, alongside whoever is typing into it: keys other than ^C and ^D, which leave, are ignored.
+If the server keeps sessions through dropped connections (part2Server --detach), a connection which breaks (as
+opposed to the server closing it once the shell is done) is made again, for up to --reconnect seconds, and the
+session resumed where the output we received ends: the shell is the same one, and what it printed in the
+meantime follows.
 The first few functions in this file are helper functions pertaining to tasks like safe reads, safe writes, safe 
 exits, stream compression intialization, etc. These are followed by functions to process things like compressed reads
 and writes, logging, polled I/O from stdin/server. Finally, the main method processes all necessary user inputs and 
@@ -30,18 +47,81 @@ options (such as port number, log file if logging specified, etc).
 #include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/ioctl.h>
 #include <netdb.h>
-#include <ulimit.h>
 #include <fcntl.h>
+#include <time.h>
 #include <zlib.h>
+#include "codec.h"
+#include "sessionLog.h"
+#include "ring.h"
+#include "mux.h"
+#include "lineEdit.h"
+#include "translate.h"
+#include "local.h"
+#include "coalesce.h"
+
+#define MUX_ESCAPE 0x1D // ^], followed by a digit switches the terminal to that channel (opening it if need be)
+#define INTERRUPT_KEY 0x03 // ^C
+#define EOF_KEY 0x04 // ^D
+#define PREDICT_MAX 256 // keys waiting for their echo at once, beyond that we give up on the oldest
+#define PREDICT_STALE_MS 2000 // echo this late isn't coming (a ^C threw it away), stop waiting for it
+#define SAVE_CURSOR "\0337"
+#define RESTORE_CURSOR "\0338"
+#define CLEAR_BELOW "\033[J"
+#define UNDERLINE_ON "\033[4m"
+#define UNDERLINE_OFF "\033[24m"
+#define RECONNECT_DEFAULT 30 // --reconnect: seconds to keep trying to resume a session whose connection broke
+#define RECONNECT_FIRST_MS 100 // wait before the second attempt, doubling up to RECONNECT_MAX_MS
+#define RECONNECT_MAX_MS 2000
 
 char cr = 0x0D;
 char lf = 0x0A;
 
 struct termios terminalModes;
 tcflag_t iFlagInit, oFlagInit, lFlagInit;
-z_stream out_stream, in_stream;
-int setCompress, fdLog = 0;
+struct codecSession session; // compression state for the connection, settled by the handshake with the server
+struct codecSpec compressSpec = { CODEC_NONE, 0, PROFILE_DEFAULT, 0, WINDOW_BITS_MAX, MEM_LEVEL_DEFAULT, 0, 0, 0, 0, 0, 0 }; // what we ask the server for
+struct codecDictionary dictionary; // preset dictionary, if --dict was given
+int logging = 0; // --log given
+int tcpOnly = 0; // --tcp: connect over tcp even though the server is on this host
+char* port = NULL; // of the server, to connect to again when resuming
+int reconnectSeconds = RECONNECT_DEFAULT; // --reconnect, 0 to leave once the connection breaks
+unsigned long resumeToken = 0; // names our session to the server, 0 if it can't be resumed
+unsigned long long outputReceived = 0; // bytes of output the session sent us, where a resumed one picks up
+int connectionLost = 0; // the connection to the server broke, pollInputs() resumes the session
+
+struct clientChannel // --mux: one shell on the server
+{
+  int open;
+  struct ring held; // output which arrived while the channel was in the background, shown once it is switched to
+  int sendWindow; // input the server has room for
+  int creditOwed; // output shown but not yet credited to the server
+  int discarding; // ^C sent, its output is dropped until the server's MUX_INTERRUPT comes back
+};
+struct clientChannel channels [MUX_CHANNELS]; // without --mux, channels[0] is the connection's one shell
+int active = 0; // channel the terminal is attached to
+int escaped = 0; // MUX_ESCAPE was typed, the next key is a command
+volatile sig_atomic_t resized = 1; // SIGWINCH came, the server should hear the terminal's new size
+int columns = 80; // of the terminal
+
+struct prediction // --predict: a key sent to the server whose echo hasn't come back yet
+{
+  char echo [EDIT_ECHO_MAX]; // what the server's line editor will echo for it
+  int echoLen;
+  int shown; // drawn (underlined) ahead of the echo
+};
+int predicting = 0; // --predict given
+struct lineEditor editor; // our copy of the server's, to know what it will echo
+struct prediction predictions [PREDICT_MAX]; // oldest first. the shown ones always come before the others
+int predictionCount;
+int echoMatched; // bytes of the oldest one's echo received so far
+struct timespec lastEcho; // when the echo last made progress
+int anchored; // the cursor position before the first key drawn is saved, everything after it can be redrawn
+int anchorColumn;
+char confirmed [EDIT_LINE_MAX*EDIT_ECHO_MAX]; // echo received since the anchor, as it is on the screen
+int confirmedLen;
+int column, columnKnown = 1; // where the cursor is on its line, unknown after an escape sequence until the next CR
 
 void setTerminalModes(tcflag_t iFlag, tcflag_t oFlag, tcflag_t lFlag)
 {
@@ -60,21 +140,28 @@ void setTerminalModes(tcflag_t iFlag, tcflag_t oFlag, tcflag_t lFlag)
 
 void exitOut (int exitCode)
 {
-  if(setCompress) // if compression was enabled then close the compression streak ends 
-    { 
-      if ( deflateEnd(&out_stream) == Z_STREAM_ERROR )
-        fprintf(stderr, "deflateEnd() failure at client \n");
-      if ( inflateEnd(&in_stream) == Z_STREAM_ERROR )
-	fprintf(stderr, "inflateEnd() failure at client \n");
-    }
+  codecEnd(&session); // close the compression streams, if any were opened
+  logClose(); // write out what is still buffered for the log
   setTerminalModes(iFlagInit,oFlagInit, lFlagInit); // restore terminal modes prior to exiting            
   exit(exitCode);
 }
 
+int resumable(void)
+{
+  return resumeToken != 0 && reconnectSeconds > 0;
+}
+
 int mywrite(int fd, void *buf, size_t count)
 {
   // write bytes from buffer to file descriptor, analogous to how this was done in part1
   int x = write(fd,buf,count);
+  if ( x==-1 && fd != 1 && resumable() ) // the connection to the server broke, what we sent is lost
+    {
+      connectionLost = 1;
+      return count;
+    }
+  if ( x==-1 && errno==EPIPE ) // the server hung up, which a same-host socket reports on the next write already
+    exitOut(0);
   if ( x==-1 )
     { fprintf(stderr, "Write failure with message %s\n",strerror(errno)); exitOut(1); }
   return x;
@@ -89,24 +176,33 @@ int myread(int fd, void *buf, size_t count)
   return x;
 }
 
-void initializeCompression() // initialize compression stream
+int initializeCompression(int file) // negotiate a codec with the server (resuming our session, if we had one) and initialize its streams
 {
-  out_stream.zalloc=Z_NULL;
-  in_stream.zalloc=Z_NULL;
-  out_stream.zfree=Z_NULL;
-  in_stream.zfree=Z_NULL;
-  out_stream.opaque=Z_NULL;
-  in_stream.opaque=Z_NULL;
-  if ( deflateInit(&out_stream, Z_DEFAULT_COMPRESSION) != Z_OK ) // initialize compression stream, with default compression level
-    { fprintf(stderr, "deflateInit() failure at client with message \n"); exitOut(1); }
-  if ( inflateInit(&in_stream) != Z_OK ) // initialize decompression system
-    { fprintf(stderr, "inflateInit() failure at client with message \n"); exitOut(1); } 
+  struct codecSpec want = compressSpec, agreed;
+  want.resume = resumeToken;
+  want.offset = outputReceived;
+  if ( codecHandshakeClient(file, &want, &agreed) == -1 ) // propose compressSpec, server answers with what it will use
+    { fprintf(stderr, "handshake failure at client with message %s\n", strerror(errno)); return -1; }
+  if ( codecInit(&session, &agreed, &dictionary) == -1 )
+    { fprintf(stderr, "codecInit() failure at client for codec %s\n", codecFind(agreed.id)->name); exitOut(1); }
+  char note [64];
+  if (resumeToken && agreed.resume != resumeToken)
+    mywrite(1, note, snprintf(note, sizeof(note), "\r\n[session gone, new shell]\r\n"));
+  else if (resumeToken && agreed.offset > outputReceived) // the server's scrollback didn't reach back that far
+    mywrite(1, note, snprintf(note, sizeof(note), "\r\n[resumed, %llu bytes of output lost]\r\n", agreed.offset - outputReceived));
+  else if (resumeToken)
+    mywrite(1, note, snprintf(note, sizeof(note), "\r\n[resumed]\r\n"));
+  resumeToken = agreed.resume;
+  outputReceived = agreed.offset;
+  return 0;
 }
 
 
-int connectToServer(char* port) // do socket programming to create a TCP level connection to specified port
+int connectToServer(void) // do socket programming to create a TCP level connection to specified port, -1 if nothing listens there
 {
   int sockfd;
+  if ( !tcpOnly && (sockfd = localConnect(atoi(port))) != -1 ) // the server is on this host, skip the tcp/ip stack (local.h)
+    return sockfd;
   if ( (sockfd = socket(AF_INET, SOCK_STREAM, 0)) == -1 ) // create socket (with IPv4 address family for now)
     { fprintf(stderr, "socket() failure at client with message %s\n", strerror(errno)); exitOut(1); }
  
@@ -121,71 +217,408 @@ int connectToServer(char* port) // do socket programming to create a TCP level c
   memcpy( (void*)(&connectServer.sin_addr.s_addr), (void*)(hostInfo->h_addr_list[0]), hostInfo->h_length );
 
   if ( connect(sockfd, (struct sockaddr *) &connectServer, sizeof(connectServer)) == -1 ) // create a connection with params dumped in earlier
-    { fprintf(stderr, "connect() failure at client with message %s\n", strerror(errno)); exitOut(1); }
+    {
+      int saved = errno;
+      close(sockfd);
+      errno = saved;
+      return -1;
+    }
   return sockfd;
 }
 
-void logWrite(int received, char* buf, int size)
-{ // write to log
-  if (received) // bytes were received over TCP
-    dprintf(fdLog, "RECEIVED %d bytes: ",size);
-  else // bytes were sent over TCP 
-    dprintf(fdLog, "SENT %d bytes: ", size);
-  for (int i=0; i<size; i++) // write the actual bytes which were sent/received
-    dprintf(fdLog, &buf[i]);
-  dprintf(fdLog, "\n");
+int write_compress(int file, char* buf, int writeSize)
+{
+  // perform write of buffer content to file (encoded with the negotiated codec, which may be none)
+  char out[FRAME_HEADER_SIZE+FRAME_WIRE_MAX];
+  int wireSize = codecEncode(&session, buf, writeSize, out, sizeof(out));
+  if (wireSize == -1)
+    { fprintf(stderr, "%s encode failure at client \n", session.codec->name); exitOut(1); }
+
+  writeSize = mywrite(file, out, wireSize); // write (compressed) buffer to server
+
+  if (logging) // if logging option specified, take note of write content and amount
+    logRecord(LOG_SENT, out, writeSize);
+  
+ return writeSize;
+}
+
+int read_uncompress(int file, char* buf, int readSize)
+{
+  // read bytes from server and queue them up for decoding; the caller then pulls out decoded data with
+  // codecNextFrame(). returns the number of bytes read, so 0 still means the server closed the connection, unless
+  // the connection broke and the session is to be resumed
+  readSize = read(file, buf, readSize); // read bytes from server
+  if ( readSize == -1 && resumable() ) // the connection broke, pollInputs() resumes the session
+    {
+      connectionLost = 1;
+      return 0;
+    }
+  if ( readSize == -1 )
+    { fprintf(stderr, "Read failure with message %s\n",strerror(errno)); exitOut(1); }
+  if (logging) // if logging on take note of read content and size
+    logRecord(LOG_RECEIVED, buf, readSize);
+  if ( codecFeed(&session, buf, readSize) == -1 )
+    { fprintf(stderr, "frame overflow at client \n"); exitOut(1); }
+  return readSize;
+}
+
+
+void sendControl(int file, int type, int id, unsigned long value, int valueLen)
+{
+  char frame [MUX_CONTROL_MAX];
+  write_compress(file, frame, muxControl(frame, type, id, value, valueLen));
 }
 
-int write_compress(int file, char* buf, int writeSize)
+void sendUrgent(int file, int type, int id, unsigned long value, int valueLen)
+{
+  // send a control message in an urgent frame, which the server acts on ahead of anything we sent before it
+  char message [MUX_CONTROL_MAX];
+  char out [FRAME_HEADER_SIZE+MUX_CONTROL_MAX];
+  int wireSize = codecEncodeUrgent(&session, message, muxControl(message, type, id, value, valueLen), out, sizeof(out));
+  if (wireSize == -1)
+    { fprintf(stderr, "urgent frame encode failure at client \n"); exitOut(1); }
+  mywrite(file, out, wireSize);
+  if (logging)
+    logRecord(LOG_SENT, out, wireSize);
+}
+
+void noteResize(int sig)
+{
+  (void)sig;
+  resized = 1;
+}
+
+void sendSize(int file)
+{
+  // tell the server how large the terminal is, for the shells it starts from now on
+  struct winsize size;
+  resized = 0;
+  if ( ioctl(0, TIOCGWINSZ, &size) == -1 || size.ws_row == 0 )
+    return;
+  columns = size.ws_col;
+  sendUrgent(file, MUX_RESIZE, active, ((unsigned long)size.ws_row << 16) | size.ws_col, 4);
+}
+
+void sendInput(int file, char* buf, int size)
 {
-   // perform write of buffer content to file (using compression if that option was specified)
-  char out[128];
-  *out=*buf;
+  // send keystrokes to the server, on the active channel when multiplexed. input beyond the channel's window (only
+  // possible when its shell stopped reading, and we just switched to it) is dropped
+  if (!compressSpec.mux)
+    {
+      if (size > 0)
+	write_compress(file, buf, size); // the whole read goes to the server as one frame
+      return;
+    }
+  char frame [MUX_HEADER_SIZE+256];
+  struct clientChannel* c = &channels[active];
+  if (size > c->sendWindow)
+    size = c->sendWindow;
+  if (size <= 0)
+    return;
+  muxHeader(frame, MUX_DATA, active);
+  memcpy(frame+MUX_HEADER_SIZE, buf, size);
+  c->sendWindow -= size;
+  write_compress(file, frame, MUX_HEADER_SIZE+size);
+}
 
-  if (!setCompress) // if no compression speficied write normally
-    writeSize = mywrite(file, out, 1);
-  else // write using compression
+void creditServer(int file, int id, int shown)
+{
+  // hand the server back window for output which made it to the terminal, half a window at a time
+  channels[id].creditOwed += shown;
+  if (channels[id].creditOwed >= MUX_CREDIT_BATCH)
     {
-      out_stream.avail_in = (uInt)writeSize; // bytes to compress
-      out_stream.next_in = (Bytef *)buf; // location of bytes to compress
-      out_stream.next_out = (Bytef *)out; // product needs to be in buf!
-      out_stream.avail_out = (uInt)128; // number of bytes available in output 'compressed' buffer
+      sendControl(file, MUX_CREDIT, id, channels[id].creditOwed, 4);
+      channels[id].creditOwed = 0;
+    }
+}
 
-      while (out_stream.avail_in>0) // while there are still bytes to compress and output buffer is not full, do compression
-        if ( deflate(&out_stream, Z_SYNC_FLUSH) == Z_STREAM_ERROR)
-	   fprintf(stderr, "deflate() failure at client \n");
+void switchChannel(int file, int id)
+{
+  // attach the terminal to a channel, opening it first if need be, and show what it printed in the background
+  struct clientChannel* c = &channels[id];
+  if (!c->open)
+    {
+      c->open = 1;
+      c->sendWindow = MUX_WINDOW;
+      c->creditOwed = 0;
+      c->discarding = 0;
+      ringInit(&c->held, MUX_WINDOW);
+      sendControl(file, MUX_OPEN, id, 0, 0);
+    }
+  active = id;
+  char note [32];
+  mywrite(1, note, snprintf(note, sizeof(note), "\r\n[channel %d]\r\n", id));
+  int shown = ringLen(&c->held);
+  while (ringLen(&c->held) > 0)
+    if ( ringFlush(&c->held, 1) == -1 )
+      { fprintf(stderr, "Write failure with message %s\n", strerror(errno)); exitOut(1); }
+  ringRelease(&c->held);
+  if (shown > 0)
+    creditServer(file, id, shown);
+}
 
-      writeSize = mywrite(file, out, 128-out_stream.avail_out); // write compressed buffer to server 
+void channelOutput(int file, const char* data, int size)
+{
+  // act on one message from the server on a multiplexed connection
+  struct muxMessage m;
+  if ( muxUnpack(data, size, &m) == -1 )
+    { fprintf(stderr, "bad channel message at client\n"); exitOut(1); }
+  struct clientChannel* c = &channels[m.channel];
+  if (!c->open)
+    return;
+  if (m.type == MUX_DATA && c->discarding) // written before the ^C landed
+    creditServer(file, m.channel, m.len);
+  else if (m.type == MUX_INTERRUPT)
+    c->discarding = 0;
+  else if (m.type == MUX_DATA && m.channel == active)
+    {
+      mywrite(1, (void*)m.payload, m.len);
+      creditServer(file, m.channel, m.len);
+    }
+  else if (m.type == MUX_DATA) // no credit until it is shown, so a background shell stops once it has filled held
+    {
+      if ( ringPut(&c->held, m.payload, m.len) == -1 )
+	{ fprintf(stderr, "server overran the window of channel %d\n", m.channel); exitOut(1); }
+    }
+  else if (m.type == MUX_CREDIT)
+    c->sendWindow = c->sendWindow > MUX_WINDOW - m.credit ? MUX_WINDOW : c->sendWindow + m.credit;
+  else if (m.type == MUX_CLOSE) // shell is gone: switch to another one, or leave with the last
+    {
+      c->open = 0;
+      ringDiscard(&c->held);
+      ringRelease(&c->held);
+      char note [32];
+      mywrite(1, note, snprintf(note, sizeof(note), "\r\n[channel %d exited]\r\n", m.channel));
+      if (m.channel != active)
+	return;
+      for (int id=0; id<MUX_CHANNELS; id++)
+	if (channels[id].open)
+	  { switchChannel(file, id); return; }
+      exitOut(0);
     }
+}
 
-  if (fdLog) // if logging option specified, take note of write content and amount
-    logWrite(0,out, writeSize);
-  
- return writeSize;
+void trackColumn(const char* data, int size)
+{
+  // follow the cursor through what is written to the terminal, so predictions are never drawn where they could
+  // wrap onto the next line
+  for (int i=0; i<size; i++)
+    {
+      unsigned char b = data[i];
+      if (b == cr)
+	{ column = 0; columnKnown = 1; }
+      else if (b == '\b')
+	column -= column > 0;
+      else if (b == '\t')
+	column = (column + 8) & ~7;
+      else if (b == 0x1b) // the escape sequence may move the cursor anywhere
+	columnKnown = 0;
+      else if (b >= 0x20 && b != 0x7f && (b < 0x80 || b >= 0xc0)) // a UTF-8 character counts once
+	column++;
+      if (column >= columns - 1)
+	columnKnown = 0;
+    }
 }
 
-int read_uncompress(int file, char* buf, int readSize)
+void drawPrediction(const struct prediction* p, int from)
+{
+  // draw a key's echo (from byte from on) ahead of the server, underlined while it is only our guess
+  char out [16];
+  int n = 0;
+  if (p->echoLen == 1)
+    n = snprintf(out, sizeof(out), UNDERLINE_ON "%c" UNDERLINE_OFF, p->echo[0]);
+  else
+    for (int i=from; i<p->echoLen; i++)
+      out[n++] = p->echo[i];
+  mywrite(1, out, n);
+  trackColumn(p->echo+from, p->echoLen-from);
+}
+
+void redrawPredictions(int wipe)
 {
-  // perform read of file content to buffer (using decompression if that option was specified earlier)
-  readSize = myread(file, buf, readSize); // read bytes from server
-  if (fdLog) // if logging on take note of read size
-    logWrite(1,buf, readSize);
-  if (setCompress) // if bytes read are actually compressed then uncompress them
+  // go back to the anchor and draw the confirmed echo plainly, then the keys still waiting for theirs. with wipe,
+  // those are left off the screen (and will be written when their echo arrives), and the anchor goes: something
+  // other than the echo we expected is about to be written
+  mywrite(1, RESTORE_CURSOR CLEAR_BELOW, strlen(RESTORE_CURSOR CLEAR_BELOW));
+  mywrite(1, confirmed, confirmedLen);
+  column = anchorColumn;
+  columnKnown = 1;
+  trackColumn(confirmed, confirmedLen);
+  for (int i=0; i<predictionCount; i++)
+    {
+      if (wipe)
+	predictions[i].shown = 0;
+      else if (predictions[i].shown)
+	drawPrediction(&predictions[i], i == 0 ? echoMatched : 0);
+    }
+  if (wipe)
     {
-      in_stream.avail_in = (uInt)readSize; // bytes available from read
-      in_stream.next_in = (Bytef *)buf; // location of said bytes
-      in_stream.next_out = (Bytef *)buf;
-      in_stream.avail_out = (uInt)1024; // max output buffer size on uncompression pipeline
+      anchored = 0;
+      confirmedLen = 0;
+    }
+}
+
+void forgetPredictions(void)
+{
+  // stop waiting for echo which may never come: whatever of it does come is then written like any other output
+  if (anchored)
+    redrawPredictions(1);
+  predictionCount = 0;
+  echoMatched = 0;
+}
+
+int showable(const struct prediction* p)
+{
+  // we only draw what can be taken back again: characters typed on the current line, and erasing them. nothing
+  // after a key we couldn't draw, whose echo we then have to wait for
+  if (predictionCount > 0 && !predictions[predictionCount-1].shown)
+    return 0;
+  if (p->echoLen == 1) // not the bytes of a UTF-8 character, which the underline around each would break apart
+    return p->echo[0] >= 0x20 && p->echo[0] < 0x7f && columnKnown;
+  return p->echoLen == EDIT_ECHO_MAX && anchored && columnKnown && column > anchorColumn; // not what was there before the anchor
+}
 
-      while(in_stream.avail_in>0) // while there are bytes to still uncompress and output buffer size is not exceeded, uncompress
-        if ( inflate(&in_stream, Z_SYNC_FLUSH) == Z_STREAM_ERROR )
-	   fprintf(stderr, "inflate() failure at client \n"); 
+void predictKeys(const char* keys, int count)
+{
+  // --predict: run the keys about to be sent through our copy of the server's line editor, remember the echo each
+  // will get, and draw it right away where we can
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if ( predictionCount > 0 && (now.tv_sec-lastEcho.tv_sec)*1000 + (now.tv_nsec-lastEcho.tv_nsec)/1000000 > PREDICT_STALE_MS )
+    forgetPredictions();
+  for (int i=0; i<count; i++)
+    {
+      struct prediction p;
+      if ( lineKey(&editor, keys[i], p.echo, &p.echoLen) )
+	lineReset(&editor);
+      if (p.echoLen == 0) // nothing to wait for
+	continue;
+      if (predictionCount == PREDICT_MAX)
+	forgetPredictions();
+      if (predictionCount == 0) // the wait starts now
+	lastEcho = now;
+      p.shown = showable(&p);
+      if (p.shown && !anchored)
+	{
+	  mywrite(1, SAVE_CURSOR, strlen(SAVE_CURSOR));
+	  anchored = 1;
+	  anchorColumn = column;
+	}
+      if (p.shown)
+	drawPrediction(&p, 0);
+      predictions[predictionCount++] = p;
+    }
+}
 
-      readSize = 1024-in_stream.avail_out; // number of bytes which were uncompressed
+void serverOutput(const char* data, int size)
+{
+  // write what the server sent to the terminal. with --predict, the echo of keys we drew is on the screen already
+  // and only has to lose its underline; anything else is written as it is, after wiping our guesses off the screen
+  if (!predicting)
+    {
+      mywrite(1, (void*)data, size);
+      return;
     }
-  return readSize;
+  int from = 0, progress = 0; // data[from..] is still to be written
+  for (int i=0; i<size; i++)
+    {
+      struct prediction* p = &predictions[0];
+      int match = predictionCount > 0 && data[i] == p->echo[echoMatched];
+      if (match && p->shown && confirmedLen == (int)sizeof(confirmed)) // too much to redraw, settle the screen
+	redrawPredictions(1);
+      if (match && p->shown) // the shown ones come first, so nothing is waiting to be written before this
+	{
+	  confirmed[confirmedLen++] = data[i];
+	  from = i+1;
+	}
+      else if (anchored) // output, or echo we couldn't draw (e.g. of a CR): our guesses make way for it
+	redrawPredictions(1);
+      if (!match)
+	continue;
+      progress = 1;
+      if (++echoMatched == p->echoLen)
+	{
+	  memmove(predictions, predictions+1, (--predictionCount) * sizeof(struct prediction));
+	  echoMatched = 0;
+	}
+    }
+  if (from < size)
+    {
+      mywrite(1, (void*)(data+from), size-from);
+      trackColumn(data+from, size-from);
+    }
+  if (progress)
+    clock_gettime(CLOCK_MONOTONIC, &lastEcho);
+  if (progress && anchored) // the confirmed echo loses its underline
+    redrawPredictions(0);
+}
+
+int terminalInput(int file, char* buf, int readSize, char* keys)
+{
+  // pick ^C, ^D and MUX_ESCAPE commands (only when multiplexed) out of what was typed, leaving the keystrokes
+  // for the active channel in keys and returning how many there are. each of them sends what was typed before
+  // it first
+  int keyCount = 0;
+  for (int i=0; i<readSize; i++)
+    {
+      if (compressSpec.mux && !escaped && buf[i] == MUX_ESCAPE)
+	{ escaped = 1; continue; }
+      if (!escaped && (buf[i] == INTERRUPT_KEY || buf[i] == EOF_KEY))
+	{
+	  sendInput(file, keys, keyCount);
+	  keyCount = 0;
+	  sendUrgent(file, buf[i] == INTERRUPT_KEY ? MUX_INTERRUPT : MUX_EOF, active, 0, 0);
+	  if (buf[i] == INTERRUPT_KEY)
+	    {
+	      channels[active].discarding = 1;
+	      forgetPredictions(); // the server throws away the line, and perhaps the echo still on its way
+	    }
+	  lineReset(&editor); // the server hands the shell the line on ^D, and drops it on ^C
+	}
+      else if (escaped && buf[i] >= '0' && buf[i] <= '9')
+	{
+	  sendInput(file, keys, keyCount);
+	  keyCount = 0;
+	  switchChannel(file, buf[i]-'0');
+	}
+      else // anything else after ^] is typed as is, so ^] ^] types a ^] and ^] ^C a ^C
+	keys[keyCount++] = buf[i];
+      escaped = 0;
+    }
+  return keyCount;
 }
 
+int resumeConnection(int file)
+{
+  // the connection broke (rather than the server closing it): connect again and resume the session, trying for up
+  // to reconnectSeconds. keys typed meanwhile wait in the terminal. returns the new connection
+  struct timespec start, now;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  close(file);
+  codecEnd(&session);
+  connectionLost = 0;
+  mywrite(1, "\r\n[connection lost, resuming]", strlen("\r\n[connection lost, resuming]"));
+  for (int delay=RECONNECT_FIRST_MS; ; delay = 2*delay < RECONNECT_MAX_MS ? 2*delay : RECONNECT_MAX_MS)
+    {
+      if ( (file = connectToServer()) != -1 )
+	{
+	  if ( initializeCompression(file) == 0 )
+	    break;
+	  close(file);
+	}
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      if (now.tv_sec - start.tv_sec >= reconnectSeconds)
+	{ fprintf(stderr, "Unable to resume the session within %d seconds\n", reconnectSeconds); exitOut(1); }
+      struct timespec wait = { delay / 1000, (delay % 1000) * 1000000L };
+      nanosleep(&wait, NULL);
+    }
+  if ( coalesceNoDelay(file) == -1 )
+    { fprintf(stderr, "setsockopt() failure at client with message %s\n", strerror(errno)); exitOut(1); }
+  channels[0].discarding = 0; // the server's answer to a ^C may have been lost along with the connection
+  forgetPredictions(); // and so may the echo of keys we drew
+  resized = 1;
+  return file;
+}
 
 void pollInputs(int file)
 {
@@ -202,28 +635,55 @@ void pollInputs(int file)
   while(1==1)
     {
 
-      if ( (res = poll(fds,2,-1)) < 0 )
-	{ fprintf(stderr, "Poll failure with message %s\n", strerror(errno)); exitOut(1); }
+      if (connectionLost) // a read or write found it broken
+	fds[1].fd = file = resumeConnection(file);
+      if (resized && !compressSpec.watch) // a viewer's terminal is none of the shell's business
+	sendSize(file);
+      fds[0].events = compressSpec.mux && channels[active].sendWindow <= 0 ? 0 : POLLIN; // keystrokes wait for window
+      if ( (res = poll(fds,2,codecIdleTimeout(&session))) < 0 ) // wake up when the compressor should be released
+	{
+	  if (errno == EINTR) // SIGWINCH
+	    continue;
+	  fprintf(stderr, "Poll failure with message %s\n", strerror(errno)); exitOut(1);
+	}
       else if (res==0)
-	continue;
+	{
+	  char notice [FRAME_HEADER_SIZE];
+	  int noticeSize = codecIdle(&session, notice, sizeof(notice)); // tell the server we dropped our compressor state
+	  if (noticeSize > 0)
+	    mywrite(file, notice, noticeSize);
+	  continue;
+	}
 
       if (fds[0].revents & POLLIN) // stdin
 	{
 	  // read normally from stdin and then write (using compression if specified) to server, handling
 	  // cr/lf to crlf mappings as necessary
 	  readSize = myread(0, buf, 256); 
-	  for (int i=0; i<readSize; i++)
-	    { 
-	      if (buf[i]==cr || buf[i]==lf)
-		{ mywrite(1, &cr, 1); mywrite(1, &lf, 1); }
-	      else
-		mywrite(1, &buf[i], 1); 
-	      write_compress(file, &buf[i], 1);
+	  if (compressSpec.watch) // read only, typing goes nowhere
+	    {
+	      if ( memchr(buf, INTERRUPT_KEY, readSize) || memchr(buf, EOF_KEY, readSize) )
+		exitOut(0);
+	      continue;
+	    }
+	  char keys [256];
+	  int keyCount = terminalInput(file, buf, readSize, keys);
+	  if (predicting) // the server echoes, we only draw ahead of it
+	    predictKeys(keys, keyCount);
+	  else // cr/lf to crlf mappings as necessary
+	    {
+	      char echo [512];
+	      int echoSize;
+	      translate(keys, keyCount, TRANSLATE_TO_TERMINAL, echo, &echoSize);
+	      mywrite(1, echo, echoSize);
 	    }
+	  sendInput(file, keys, keyCount);
 	}
       else if (fds[1].revents & POLLIN) // received server data
 	{
-	  readSize = read_uncompress(file, buf, 256); // read from server (using compression if specified)
+	  readSize = read_uncompress(file, buf, FEED_MAX); // read from server (using compression if specified)
+	  if (connectionLost)
+	    continue;
 	  if (readSize==0) // if server stops sending us data for some reason unexpectedly (ie without eof), begin exit process
 	  { 
 	    if ( close(file) == -1 )
@@ -231,8 +691,21 @@ void pollInputs(int file)
 	      exitOut(0); 
 	  };
 
-	  for (int i=0; i<readSize; i++) // write data from server to stdout normally, character-at-a-time.
-	    mywrite(1, &buf[i], 1);
+	  char data [FRAME_MAX];
+	  int dataSize;
+	  while ( (dataSize = codecNextFrame(&session, data, sizeof(data))) > 0 ) // write every fully received frame to stdout
+	    {
+	      if (compressSpec.mux || session.urgent)
+		channelOutput(file, data, dataSize);
+	      else
+		{
+		  outputReceived += dataSize; // shown or dropped, a resumed session picks up after it
+		  if (!channels[0].discarding)
+		    serverOutput(data, dataSize);
+		}
+	    }
+	  if (dataSize == -1)
+	    { fprintf(stderr, "%s decode failure at client \n", session.codec->name); exitOut(1); }
 	}
     }
 }
@@ -244,19 +717,64 @@ int main ( int argc, char *argv[] )
   static struct option long_options[] = {
     {"port", required_argument, 0, 'p'}, // port number requisites an string destination port passed in
     {"log", required_argument, 0, 'l'}, // log requisites a filename to which TCP communication will be saved. 
-    {"compress", no_argument, 0, 'c'}, // no argument for compress
+    {"compress", optional_argument, 0, 'c'}, // optional codec: interactive, bulk, none, lz or zlib[:level]
+    {"dict", required_argument, 0, 'd'}, // preset compression dictionary, used if the server has the same one
+    {"window-bits", required_argument, 0, 'w'}, // largest zlib window (9-15) we are willing to use
+    {"mem-level", required_argument, 0, 'm'}, // largest zlib memLevel (1-9) we are willing to use
+    {"mux", no_argument, 0, 'x'}, // run shells on channels of one connection, switched between with ^] 0-9
+    {"log-format", required_argument, 0, 'f'}, // text (default) or binary
+    {"log-size", required_argument, 0, 's'}, // rotate the log once it reaches this many bytes, 0 never
+    {"log-keep", required_argument, 0, 'k'}, // rotated logs to keep
+    {"predict", no_argument, 0, 'P'}, // the server echoes, and we draw keys ahead of its echo
+    {"tcp", no_argument, 0, 'T'}, // don't use the server's same-host socket
+    {"watch", required_argument, 0, 'W'}, // watch the server's shell with this pid read-only, instead of starting one
+    {"reconnect", required_argument, 0, 'R'}, // seconds to keep trying to resume the session once the connection breaks, 0 never
     {0,0,0,0}
   };
 
-  int in; char* port=NULL; char* logFile = NULL;
+  int in; char* logFile = NULL; char* dictFile = NULL;
+  int windowBits = WINDOW_BITS_MAX, memLevel = MEM_LEVEL_DEFAULT;
+  int logFormat = LOG_TEXT, logKeep = LOG_KEEP_DEFAULT; long logSize = LOG_ROTATE_DEFAULT;
   while ( ( in = getopt_long(argc,argv, "", long_options, NULL) ) != -1 )
     {
       if (in == 'p') // read in port
         port=optarg;
       else if (in == 'l') // read in log filename
 	logFile=optarg;
+      else if (in == 'd') // read in dictionary filename
+	dictFile=optarg;
+      else if (in == 'w') // read in zlib window size
+	windowBits=atoi(optarg);
+      else if (in == 'm') // read in zlib memory level
+	memLevel=atoi(optarg);
+      else if (in == 'x') // multiplex channels
+	compressSpec.mux = 1;
+      else if (in == 'P') // predictive echo
+	predicting = compressSpec.echo = 1;
+      else if (in == 'T') // tcp only
+	tcpOnly = 1;
+      else if (in == 'W') // watch another session's shell
+	compressSpec.watch = strtoul(optarg, NULL, 10);
+      else if (in == 'R') // reconnect window
+	reconnectSeconds = atoi(optarg);
+      else if (in == 'f') // read in log format
+	{
+	  if (strcmp(optarg, "text") == 0)
+	    logFormat = LOG_TEXT;
+	  else if (strcmp(optarg, "binary") == 0)
+	    logFormat = LOG_BINARY;
+	  else
+	    { fprintf(stderr, "Unrecognized --log-format %s\n", optarg); exit(1); }
+	}
+      else if (in == 's') // read in log rotation size
+	logSize=atol(optarg);
+      else if (in == 'k') // read in number of rotated logs to keep
+	logKeep=atoi(optarg);
       else if (in == 'c') // compression option on 
-	setCompress=1;
+	{
+	  if ( codecParseSpec(optarg, &compressSpec) == -1 )
+	    { fprintf(stderr, "Unrecognized --compress codec %s\n", optarg); exit(1); }
+	}
       else if (in == '?') // unknown arg
 	{
 	  fprintf(stderr,"Unrecognized argument with message %s\n", strerror(errno));
@@ -265,19 +783,53 @@ int main ( int argc, char *argv[] )
     }
   if (port==NULL) // port needs to be specified
     { fprintf(stderr, "Need to specify a --port ' ' argument\n"); exit(1); }
-  if (setCompress)
-    initializeCompression(); // initialize compression paradigms
-  if (logFile!=NULL) // if log file specified 
+  if (predicting && compressSpec.mux) // the echo would have to fit the channel windows, which it doesn't
+    { fprintf(stderr, "--predict needs a connection of its own, it can't be used with --mux\n"); exit(1); }
+  if (compressSpec.watch && (predicting || compressSpec.mux)) // a viewer sends nothing to be echoed or multiplexed
+    { fprintf(stderr, "--watch can't be used with --predict or --mux\n"); exit(1); }
+  if (windowBits < WINDOW_BITS_MIN || windowBits > WINDOW_BITS_MAX || memLevel < MEM_LEVEL_MIN || memLevel > MEM_LEVEL_MAX)
+    { fprintf(stderr, "--window-bits must be in %d-%d and --mem-level in %d-%d\n", WINDOW_BITS_MIN, WINDOW_BITS_MAX, MEM_LEVEL_MIN, MEM_LEVEL_MAX); exit(1); }
+  compressSpec.windowBits = windowBits;
+  compressSpec.memLevel = memLevel;
+  if (dictFile!=NULL) // offer the dictionary to the server, identified by its checksum
+    {
+      if ( codecLoadDictionary(dictFile, &dictionary) == -1 )
+	{ fprintf(stderr, "Unable to load dictionary %s with message %s\n", dictFile, strerror(errno)); exit(1); }
+      compressSpec.dictId = dictionary.id;
+    }
+  if (reconnectSeconds < 0)
+    { fprintf(stderr, "--reconnect can't be negative\n"); exit(1); }
+  if (logSize < 0 || logKeep < 0)
+    { fprintf(stderr, "--log-size and --log-keep can't be negative\n"); exit(1); }
+  if (logFile!=NULL) // if log file specified, start its writer thread; rotation bounds its size
     { 
-      if ( ulimit(UL_SETFSIZE, 10000) == -1 ) // sets an upper bound on the case of log file, in case we write to log file infinitely say
-	{ fprintf(stderr, "ulimit() failure with message %s\n", strerror(errno)); exitOut(1); }
-      fdLog = open(logFile, O_CREAT|O_RDWR|O_TRUNC, 0777); // open log file with given permissions 
+      if ( logOpen(logFile, logFormat, logSize, logKeep) == -1 )
+	{ fprintf(stderr, "Unable to open log %s with message %s\n", logFile, strerror(errno)); exit(1); }
+      logging = 1;
     }
 
 
   setTerminalModes(ISTRIP,0,0); // set non-cannonical terminal modes
 
-  int file = connectToServer(port); // open connection to specified port on server ('localhost') for now
+  int file = connectToServer(); // open connection to specified port on server ('localhost') for now
+  if (file == -1)
+    { fprintf(stderr, "connect() failure at client with message %s\n", strerror(errno)); exitOut(1); }
+
+  if ( initializeCompression(file) == -1 ) // agree on a codec with the server and initialize compression paradigms
+    exitOut(1);
+
+  if ( coalesceNoDelay(file) == -1 ) // all we send is keystrokes, none should wait for the ack of the one before
+    { fprintf(stderr, "setsockopt() failure at client with message %s\n", strerror(errno)); exitOut(1); }
+  if (compressSpec.mux) // start out on channel 0
+    switchChannel(file, 0);
+  else
+    channels[0].open = 1;
+
+  struct sigaction onResize = { .sa_handler = noteResize, .sa_flags = SA_RESTART }; // only poll() sees EINTR
+  if ( signal(SIGPIPE, SIG_IGN) == SIG_ERR ) // a server which hung up shows up as EPIPE instead, see mywrite()
+    { fprintf(stderr, "Error setting up signal, with message %s\n", strerror(errno)); exitOut(1); }
+  if ( sigaction(SIGWINCH, &onResize, NULL) == -1 )
+    { fprintf(stderr, "Error setting up signal, with message %s\n", strerror(errno)); exitOut(1); }
 
   pollInputs(file); // poll inputs from stdin and server
 
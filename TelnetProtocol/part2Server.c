@@ -5,7 +5,7 @@ NAME: Mihir Arya
 /* 
 
 This aspect of the telnet project is a continuation of part 1. This file contains all server side acitivites 
-needed to process user-input sent from the client on the specified port using TCP. We (the server) process 
+needed to process user-input sent from clients on the specified port using TCP. We (the server) process 
 (uncompress, map cr/lf to <cr><lf>) this data as necessary, and then send it to a child shell via interprocess 
 communication methods (pipes, as was done in part 1). The child then does mappings of <lf> to <cr><lf> as necessary 
 and sends this data back to the main server routing via pipes. The server finally performs compression on this data
@@ -13,13 +13,49 @@ as needed and sends it back to the client via TCP. Edge cases relating to ^C or
 process are appropriately handled, bearing in mind proper close down procedures of open pipes or compression streams
 if these commands are received. 
 
-The first few functions in this file are helper methods relating to safe reads/writes/exits. The middle portion
-pertains to appropriately initializing and using compression streams, creating a TCP connection to the client, and 
-polling/sending input from the client, and the child process. Finally, the main function handles user arguments like 
-port number, child process name, compression scheme, etc. 
+Every client gets its own session (its connection and compression state) with one shell, or with as many as it
+opens if it multiplexes channels (mux.h), and all sessions are served by a single poll loop in which no file
+descriptor ever blocks. Data moves through ring buffers, one per direction: output translated and compressed for
+the client queues in the session's toClient until the socket takes it, and input from the client queues in each
+channel's toShell until its pipe takes it. Once a ring fills past its high watermark we stop polling its producer
+for input (the shells' output, or the client's socket), and only start again once it has drained below its low
+watermark; on a multiplexed connection the channel windows do that job for each shell, so one stalled shell never
+holds up the others. A client which stops reading therefore just pauses its own shells, the memory a session holds
+is bounded by its rings, and a slow session never delays any other one.
+
+^C, ^D and terminal size changes come as urgent control frames (mux.h), which are taken out of the received data
+as soon as it is read, even while the data frames ahead of them wait for room in toShell. An interrupt signals the
+shell's whole process group, and throws away the input queued for the shell, what it wrote that we haven't read,
+and the frames in toClient the socket hasn't started on, so that it takes effect within one round trip no matter
+how much output was pending.
+
+A client which asks for echo in the hello (part2Client --predict) gets its lines edited and echoed here
+(lineEdit.h), since the shell has no terminal to do it: keys go into the channel's line editor, their echo goes
+straight back to the client, and the shell is handed each line once it is ended. Input is then only decoded
+while toClient has room for the echo of a whole frame.
+
+A client may instead ask to watch a running shell read-only, by its pid (part2Client --watch). Its session runs
+no shell and throws away what it types; it joins the shell's viewGroup, whose one encoder compresses each chunk of
+the shell's output once, already translated for the shell's own client, and whose frames are queued as they are
+into every viewer's toClient, and into the shell's own session's too if the viewers could take its codec. So a
+viewer costs a memcpy per frame, not a translation and a compression. A viewer whose toClient has no room for a
+frame falls behind and misses frames rather than hold up the shell; once it has drained (or when it has just
+joined) it waits for the next resync, where the shared encoder starts a fresh stream and every viewer is told to
+reset its decoder, as after an interrupt.
+
+With --detach, a session running one shell outlives its connection: once that breaks, the socket and compressor
+go but the shell runs on for detachSeconds, its output going into the session's scrollback (scrollback.h), where
+all of its output goes anyway. A client which comes back with the session's token in its hello takes the session
+over, and is sent the output from the last byte it received on out of the scrollback, ahead of anything newer.
+
+The first few functions in this file are helper methods relating to safe closes/exits. The middle portion
+pertains to appropriately initializing and using compression streams, accepting TCP connections from clients, 
+starting their shells, and moving data between the two with backpressure. Finally, the main function handles user
+arguments like port number, child process name, compression scheme, etc. 
 */
 
 
+#define _GNU_SOURCE // accept4(), pipe2()
 #include <termios.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -30,57 +66,155 @@ port number, child process name, compression scheme, etc.
 #include <sys/wait.h>
 #include <errno.h>
 #include <string.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
 #include <fcntl.h>
+#include <sys/random.h>
 #include <zlib.h>
+#include "codec.h"
+#include "ring.h"
+#include "stats.h"
+#include "mux.h"
+#include "lineEdit.h"
+#include "translate.h"
+#include "record.h"
+#include "local.h"
+#include "coalesce.h"
+#include "scrollback.h"
 
-z_stream out_stream;
-z_stream in_stream;
-char cr = 0x0D; // constants 
-char lf = 0x0A; 
-int eof = 0; // global vars
-int childKilled=2;
-pid_t ChildID;
-int setCompress=0;
-
+#define SHELL_READ 4096 // most bytes taken from a shell per read, twice that once every lf became <cr><lf>
+#define TO_CLIENT_RING 65536
+#define CONTROL_RESERVE (MUX_CHANNELS*32) // room kept in toClient for the credit and close messages of every channel
+#define TO_CLIENT_HIGH (TO_CLIENT_RING - FRAME_HEADER_SIZE - FRAME_WIRE_MAX - CONTROL_RESERVE) // stop reading shells: the next frame might not fit
+#define TO_CLIENT_LOW (TO_CLIENT_RING/4)
+#define TO_SHELL_RING 32768 // at least MUX_WINDOW, which a multiplexed client may fill a channel's ring with
+#define TO_SHELL_HIGH (TO_SHELL_RING - FRAME_MAX) // stop decoding (and reading) client frames: the next one might not fit
+#define TO_SHELL_LOW (TO_SHELL_RING/4)
+#define ACCEPT_BURST 16 // connections accepted per wakeup, so a connection storm can't starve running sessions
+#define REAP_INTERVAL 50 // ms between checks on a shell which was told to exit but hasn't yet
+#define REAP_GRACE 2 // seconds a shell gets to exit after SIGINT before it is killed outright
+#define STATS_CLIENTS 8 // stats requests served at once, more are turned away
+#define CLIENT_MARKS 64 // frame boundaries remembered in toClient, where an interrupt may cut it
+#define CLIENT_MARK_SPACING (TO_CLIENT_RING/CLIENT_MARKS) // so the marks cover the whole ring
+#define DISCARD_READS 16 // reads of shell output thrown away on an interrupt, a whole pipe's worth
+#define UNSENT_LOWAT TO_CLIENT_RING // most output the kernel holds for a client before it is sent, the rest waits in toClient
+#define ECHO_ROOM (EDIT_ECHO_MAX*(FRAME_HEADER_SIZE+FRAME_WIRE_MAX)) // toClient space the echo of one client frame may need
+#define SCROLLBACK_DEFAULT 65536 // --scrollback: compressed output a detachable session keeps, 120-380 KB of terminal output
 
-void exitOut(int exitCode)
-{ 
-  // code to safetly exit out 
-  if (childKilled==0) // if child was already killed then dont kill                                                                              
-    if ( kill(ChildID,SIGINT) < 0 )
-      { fprintf(stderr, "Failure when killing child with message %s\n", strerror(errno)); exit(1); }
+struct channel // one shell of a session
+{
+  int id; // channel number on the wire, 0 on a connection which isn't multiplexed
+  int pipeToShell, pipeFromShell; // our ends of the pipes to the shell, -1 once closed
+  pid_t shell;
+  int shellKilled;
+  struct ring toShell; // translated client input waiting for the pipe to take it
+  int inputDone; // ^D seen, or the client closed the channel or is gone: close the pipe once toShell has drained
+  int outputDone; // shell closed its output or sent ^D
+  int hungUp; // the client closed the channel, stop the shell without waiting for it
+  int eofPending; // ^D came ahead of input still waiting to be decoded, set inputDone once that is through
+  struct lineEditor* editor; // echo sessions: the line being typed, which the shell hasn't seen yet. NULL otherwise
+  struct recorder recorder; // --record: the shell's input and output, for replaying later
+  struct viewGroup* viewers; // sessions watching the shell read-only, NULL while there are none
+  int sendWindow; // multiplexed: output the client has room for, in bytes
+  int creditOwed; // multiplexed: input the shell took (or which was dropped) that the client hasn't been credited for
+  struct timespec reapDeadline; // once set, SIGKILL the shell if it is still around by then
+  int pollFromShell, pollToShell; // index of each pipe in this round's pollfd array, -1 if not polled
+};
 
-  if(setCompress) // close compression paradigms if they were opened
-    {
-      if ( deflateEnd(&out_stream) == Z_STREAM_ERROR ) // not technically a sys call
-        fprintf(stderr, "deflateEnd() failure at server \n");
-      if ( inflateEnd(&in_stream) == Z_STREAM_ERROR )
-        fprintf(stderr, "inflateEnd() failure at server \n");
-    }
-  exit(exitCode);
-}
+struct shellSession // one client connection, and the shells it runs
+{
+  int socket; // connection to the client, tcp or a same-host UNIX socket (local.h)
+  int local; // on the same-host socket
+  struct coalescer coalesce; // tcp: whether output is interactive or bulk, and the socket options to match
+  unsigned char hello [HELLO_SIZE]; // handshake received so far
+  int helloLen;
+  int ready; // handshake done
+  int mux; // frames carry channel headers (mux.h), and the client opens shells itself
+  int echo; // we edit and echo the client's lines (lineEdit.h)
+  struct codecSession codec; // compression state for this client, settled by the handshake and shared by its channels
+  struct ring toClient; // frames waiting for the socket to take them
+  unsigned long long queuedTotal, sentTotal; // bytes ever put into toClient, and written out of it
+  unsigned long long marks [CLIENT_MARKS]; // queuedTotal at frame boundaries still in toClient, oldest first
+  unsigned long long markOutput [CLIENT_MARKS]; // --detach: replayed at each of them
+  int markCount;
+  struct channel* channels [MUX_CHANNELS]; // the open ones, in no particular order
+  int channelCount;
+  int readingClient, readingShells; // poll interest in input, off above the high watermark until back under the low one
+  int framesWaiting; // not multiplexed: complete frames left in the codec because toShell (or toClient, for their echo) had no room for them
+  int clientGone; // client hung up or its socket failed, anything meant for it is dropped
+  int pollSocket; // index of the socket in this round's pollfd array, -1 if not polled
+  int rows, cols; // size of the client's terminal, 0 until it tells us
+  unsigned long number; // sessionsStarted when it started, names its recordings
+  struct codecSpec spec; // what the handshake settled on
+  int viewer; // watches another session's shell (part2Client --watch) instead of running its own
+  struct channel* viewing; // viewer: the shell watched, NULL once it is gone
+  int behind; // takes a view group's frames: one didn't fit toClient, so frames are skipped until the next resync
+  int resync; // takes a view group's frames: joined, or caught up after falling behind, and waits for the next resync
+  unsigned long token; // --detach: names the session to a client resuming it, 0 if it can't be resumed
+  struct scrollback scroll; // --detach: the latest output, numbered in the order it was queued for the client
+  unsigned long long replayed; // --detach: output queued for the client so far, behind scroll.end while a resumed client catches up
+  int detached; // the connection dropped: the shell runs on until a client resumes the session or detachDeadline passes
+  struct timespec detachDeadline;
+  struct statsCounters counters;
+};
 
-int myread(int fd, void *buf, size_t count)
+struct viewGroup // every viewer of one shell, and the frames of its output they share
 {
-  // read bytes from file descriptor into buffer
-  int x = read(fd,buf,count);
-  if ( x==-1 )
-    { fprintf(stderr, "read() failure at server with message %s\n", strerror(errno)); exitOut(1); }
-  return x;
-}
+  struct codecSpec spec; // what the first viewer agreed to, later ones are answered with it too
+  struct codecSession codec; // encodes each chunk of output once, for all viewers
+  struct shellSession** members; // the viewers
+  int count, slots;
+  struct shellSession* owner; // the shell's own session if its client takes the shared frames as well, else NULL
+  int resyncing; // members (and owner) waiting for the next resync
+};
+
+struct shellSession** sessions; // every live session, in no particular order
+int sessionCount=0;
+int sessionSlots=0;
+int channelTotal=0; // over all sessions
+int viewerTotal=0; // sessions watching a shell, over all shells
+char* prog; // shell every session runs
+char* recordDir = NULL; // --record: directory for a recording of every shell
+unsigned allowedCodecs = 1<<CODEC_NONE; // codecs we agree to during the handshake, set by --compress
+struct codecDictionary dictionary; // preset dictionary, if --dict was given
+struct codecLimits limits = { WINDOW_BITS_MAX, MEM_LEVEL_MAX, 0, 0 }; // most memory a client may ask for per session
+int haveDictionary=0;
+unsigned long sessionsStarted=0; // stats, see stats.h
+struct statsCounters endedCounters; // of every session that has ended
+struct histogram wakeupToWrite = { .name = "wakeup_to_write_ns" }; // from poll returning to the data it woke us for going out to a client
+struct histogram shellReadSize = { .name = "shell_read_bytes" };
+struct histogram encodeTime = { .name = "encode_ns" }; // per frame
+struct histogram decodeTime = { .name = "decode_ns" };
+struct histogram frameRatio = { .name = "frame_ratio_permille" }; // encoded size of a frame over its data size
+struct timespec wakeup; // when poll last returned
+int statsListener=-1; // --stats endpoint
+int localListener=-1; // same-host clients, see local.h
+int coalesceMode = COALESCE_ADAPTIVE; // --coalesce, for tcp clients (coalesce.h)
+int detachSeconds = 0; // --detach: how long a session outlives its client's connection, 0 not at all
+long scrollbackLimit = SCROLLBACK_DEFAULT; // --scrollback
+struct statsClient statsClients [STATS_CLIENTS];
+int statsClientCount=0;
 
-int mywrite(int fd, void *buf, size_t count)
+
+void exitOut(int exitCode)
 {
-  // write bytes from buffer into file descriptor
-  int x = write(fd,buf,count);
-  if ( x==-1 )
-    { fprintf(stderr, "write() failure in server with message %s\n",strerror(errno)); exitOut(1); }
-  return x;
+  // code to safetly exit out: interrupt every shell (and what it runs) still running, and close compression paradigms
+  for (int i=0; i<sessionCount; i++)
+    {
+      for (int j=0; j<sessions[i]->channelCount; j++)
+	{
+	  struct channel* c = sessions[i]->channels[j];
+	  if (c->shell > 0 && !c->shellKilled) // if child was already killed then dont kill
+	    kill(-c->shell, SIGINT); // on the way out anyway, nothing more to do if it fails
+	}
+      codecEnd(&sessions[i]->codec);
+    }
+  exit(exitCode);
 }
 
 void myclose(int fd)
@@ -99,133 +233,132 @@ void mydup(int fd)
     { fprintf(stderr, "dup() failure at server with message %s\n", strerror(errno)); exitOut(1); }
 }
 
-void handleSig()
-{
-  eof=1; // indication that the shell has shut down, so exit while loop
-}
-
-void finishExit(int file)
+void setNonBlocking(int fd)
 {
-  // function to handle normal exists (unexpected exits are handled by exitOut())
-  int state;
-  if ( waitpid(ChildID, &state, 0) == -1 ) // wait for the child process terminate
-    { fprintf(stderr, "waitpid() failure at server with message %s\n", strerror(errno)); exitOut(1); }
-  if (WIFEXITED(state)) // if the child has terminated notify the user 
-    {
-      fprintf(stderr, "SHELL EXIT SIGNAL=%d", (state)&0xff);
-      fprintf(stderr, " STATUS=%d\n", (state>>8)&0xff); // could also find 0...01111111100000000 number?
-    }
-  if ( shutdown(file,SHUT_WR) == -1 ) // close server side of tcp connection on port
-    { fprintf(stderr, "shutdown() failure at server with message %s\n", strerror(errno)); exitOut(1); }
-  exitOut(0);
+  // make reads and writes on fd fail with EAGAIN instead of waiting, so one session can never hold up the loop
+  int flags = fcntl(fd, F_GETFL);
+  if ( flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1 )
+    { fprintf(stderr, "fcntl() failure at server with message %s\n", strerror(errno)); exitOut(1); }
 }
 
 int establishConnection (int port)
 {
-  // open a TCP socket connection on the specified port. analogous to the function of the same name on client side
+  // open a TCP socket listening on the specified port. analogous to the function of the same name on client side,
+  // except that connections are accepted by the poll loop, as clients arrive
   int sockfd;
-  if ( (sockfd = socket(AF_INET, SOCK_STREAM, 0)) == -1 )
+  if ( (sockfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1 )
     { fprintf(stderr, "socket() failure at server with message %s\n", strerror(errno)); exitOut(1); }
   struct sockaddr_in connectionDetails = { AF_INET, htons(port), {INADDR_ANY}, {0,0,0,0,0,0,0,0} };
   int length = sizeof(connectionDetails);
   bzero(&(connectionDetails.sin_zero), sizeof(connectionDetails.sin_zero) );
+  int reuse = 1; // restart on the same port while connections of the last run are in TIME_WAIT
+  setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
 
   if ( bind(sockfd, (struct sockaddr *) &connectionDetails, length ) == -1 )
     { fprintf(stderr, "bind() failure at server with message %s\n", strerror(errno)); exitOut(1); }
-  
-  if ( listen(sockfd, 5) == -1 )
-    { fprintf(stderr, "listen() failure at server with message %s\n", strerror(errno)); exitOut(1); }
-  
-  int file;
-  if ( (file = accept(sockfd, (struct sockaddr *) &connectionDetails, (socklen_t *) &length )) == -1 )
-    { fprintf(stderr, "accept() failure at server with message %s\n", strerror(errno)); exitOut(1); }
-    
-  return file;
-}
-
-void initializeCompression()
-{
-  // initialize uncompression stream (to get compressed data from client) and compression scheme (so that said data can be sent to client).
-  // this is done without loss of generality from how compression/uncompression schemes are set up on the client.
-  out_stream.zalloc=Z_NULL;
-  in_stream.zalloc=Z_NULL;
-  out_stream.zfree=Z_NULL;
-  in_stream.zfree=Z_NULL;
-  out_stream.opaque=Z_NULL;
-  in_stream.opaque=Z_NULL;
-  if ( deflateInit(&out_stream, Z_DEFAULT_COMPRESSION) != Z_OK ) // if this fails then doesn't make sense to continue execution
-    { fprintf(stderr, "deflateInit() failure i n server with message \n"); exitOut(1); }
-  if ( inflateInit(&in_stream) != Z_OK )
-    { fprintf(stderr, "inflateInit() failure at server with message \n"); exitOut(1); }
-}
-
-int write_compress(int file, char* buf)
-{
-  // write data from buffer to file (client, using compression if specified), analogous to the method of the same name on client.
-  int writeSize=1; // character-at-a-time
-  char bufOut[128];
-  if (!setCompress)
-    writeSize = mywrite(file, buf, 1);
-  else
-    {
-      out_stream.avail_in = (uInt)(writeSize);
-      out_stream.next_in = (Bytef *)buf;
-      out_stream.next_out = (Bytef *)bufOut;                            
-      out_stream.avail_out = (uInt)128;
 
-      while (out_stream.avail_in>0)
-        if ( deflate(&out_stream, Z_SYNC_FLUSH) == Z_STREAM_ERROR)
-	  fprintf(stderr, "deflate() failure at server \n");
+  if ( listen(sockfd, SOMAXCONN) == -1 )
+    { fprintf(stderr, "listen() failure at server with message %s\n", strerror(errno)); exitOut(1); }
+  setNonBlocking(sockfd);
+  return sockfd;
+}
 
-      writeSize = mywrite(file, bufOut, 128-out_stream.avail_out);
-    }
-  return writeSize;
+void hangUp(struct shellSession* s)
+{
+  // the client is gone: drop what was queued for it, and let every shell see eof
+  s->clientGone = 1;
+  s->framesWaiting = 0;
+  ringDiscard(&s->toClient);
+  s->queuedTotal = s->sentTotal;
+  s->markCount = 0;
+  for (int j=0; j<s->channelCount; j++)
+    s->channels[j]->inputDone = 1;
 }
 
+struct channel* findChannel(struct shellSession* s, int id)
+{
+  for (int j=0; j<s->channelCount; j++)
+    if (s->channels[j]->id == id)
+      return s->channels[j];
+  return NULL;
+}
 
-int read_uncompress(int file, char* buf, int readSize)
-{ 
-  // read data from buffer to file (from client, using decompression if specified), analogous to the method of the same name on client. 
-  readSize = myread(file, buf, readSize); // read of 256 is current def.
-  if (setCompress)
+void acceptClients(int listener, int local)
+{
+  // take on every waiting client (up to ACCEPT_BURST) of the tcp or the same-host listener, each as a new session
+  // waiting for its hello
+  for (int n=0; n<ACCEPT_BURST; n++)
     {
-      in_stream.avail_in = (uInt)readSize;
-      in_stream.next_in = (Bytef *)buf;
-      in_stream.next_out = (Bytef *)buf;
-      in_stream.avail_out = (uInt)1024;
-      
-      while(in_stream.avail_in>0)
-	if ( inflate(&in_stream, Z_SYNC_FLUSH) == Z_STREAM_ERROR )
-	  fprintf(stderr, "inflate() failure at client \n");
-
-      readSize= 1024-in_stream.avail_out;
-    }                                                                                                                    
-  return readSize;
+      int file = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (file == -1)
+	{
+	  if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED) // e.g. out of fds: keep serving the sessions we have
+	    fprintf(stderr, "accept() failure at server with message %s\n", strerror(errno));
+	  return;
+	}
+      struct shellSession* s = calloc(1, sizeof(struct shellSession));
+      if (s == NULL)
+	{ fprintf(stderr, "Memory allocation issue!\n"); close(file); return; }
+      if (sessionCount == sessionSlots)
+	{
+	  int slots = sessionSlots ? 2*sessionSlots : 16;
+	  struct shellSession** grown = realloc(sessions, slots * sizeof(struct shellSession*));
+	  if (grown == NULL)
+	    { fprintf(stderr, "Memory allocation issue!\n"); free(s); close(file); return; }
+	  sessions = grown;
+	  sessionSlots = slots;
+	}
+      s->socket = file;
+      s->local = local;
+      int lowat = UNSENT_LOWAT; // output we still hold can be thrown away on an interrupt, once the kernel has it it can't
+      if (local) // a UNIX socket has no unsent data apart from its buffer, so keep that small instead
+	setsockopt(file, SOL_SOCKET, SO_SNDBUF, &lowat, sizeof(lowat)); // only an optimization if it fails
+      else
+	setsockopt(file, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat));
+      if ( coalesceInit(&s->coalesce, file, local ? COALESCE_OFF : coalesceMode) == -1 )
+	fprintf(stderr, "setsockopt() failure at server with message %s\n", strerror(errno));
+      ringInit(&s->toClient, TO_CLIENT_RING);
+      s->readingClient = s->readingShells = 1;
+      sessions[sessionCount++] = s;
+      s->number = ++sessionsStarted;
+    }
 }
 
-
-void shellArgCase(char* prog, int file)
+int startShell(struct shellSession* s, struct channel* c)
 {
-
-  // open unidirectional pipe to child process (shell) 
+  // fork the shell for a channel, its stdin/stdout/stderr being pipes whose other ends the poll loop owns. it
+  // leads a process group of its own, so an interrupt reaches the commands it runs as well
   int pipeEnteringChild [2];
   int pipeExitingChild [2];
-  if ( pipe(pipeEnteringChild) < 0 )
-    { fprintf(stderr, "Pipe creation failure with message %s\n",strerror(errno)); exitOut(1); }
-  if ( pipe(pipeExitingChild) < 0 )
-    { fprintf(stderr, "Pipe creation error %s\n",strerror(errno)); exitOut(1); }
- 
-  ChildID = fork(); // fork a child process (shell)
-  if (ChildID < 0) // fork was unsuccessful
-    { fprintf(stderr, "Fork failure with msg %s\n",strerror(errno)); exitOut(1); }
-  else if (ChildID==0) // we are in the child process 
-    { 
-      childKilled=0; // child is alive
-	  
-      // rearrange pipes to be able to send and receive outputs from the parent process (terminal) (inter-process-communication)
-      myclose( pipeEnteringChild[1] );
-      myclose ( pipeExitingChild[0] );
+  if ( pipe2(pipeEnteringChild, O_CLOEXEC) < 0 ) // cloexec: no shell may hold on to another session's pipes
+    { fprintf(stderr, "Pipe creation failure with message %s\n",strerror(errno)); return -1; }
+  if ( pipe2(pipeExitingChild, O_CLOEXEC) < 0 )
+    { fprintf(stderr, "Pipe creation error %s\n",strerror(errno)); close(pipeEnteringChild[0]); close(pipeEnteringChild[1]); return -1; }
+
+  c->shell = fork(); // fork a child process (shell)
+  if (c->shell < 0) // fork was unsuccessful
+    {
+      fprintf(stderr, "Fork failure with msg %s\n",strerror(errno));
+      close(pipeEnteringChild[0]); close(pipeEnteringChild[1]); close(pipeExitingChild[0]); close(pipeExitingChild[1]);
+      c->shell = 0;
+      return -1;
+    }
+  else if (c->shell==0) // we are in the child process
+    {
+      sessionCount=0; // the sessions belong to the server, not to us
+      setsid(); // can't fail, a child never leads a process group yet
+      signal(SIGINT, SIG_DFL); // we ignore SIGPIPE, and may have been started ignoring SIGINT (e.g. with &), the shell must not
+      signal(SIGPIPE, SIG_DFL);
+      if (s->rows > 0) // there is no tty to ask, so pass on what the client's terminal looked like
+	{
+	  char size [16];
+	  snprintf(size, sizeof(size), "%d", s->rows);
+	  setenv("LINES", size, 1);
+	  snprintf(size, sizeof(size), "%d", s->cols);
+	  setenv("COLUMNS", size, 1);
+	}
 
+      // rearrange pipes to be able to send and receive outputs from the parent process (terminal) (inter-process-communication)
       myclose(0);
       mydup( pipeEnteringChild[0] );
 
@@ -235,90 +368,1210 @@ void shellArgCase(char* prog, int file)
       mydup( pipeExitingChild[1] );
 
       if ( execl(prog, prog, (char*)NULL )  == -1 ) // runs the specified binary executable
-	{ fprintf(stderr, "Error in executing specified program %s\n", strerror(errno)); exitOut(1); }
-    }
-  else if (ChildID>0) // then we in parent with child id stored
-    {
-      // child is alive, rearrange pipes to be able to send and receive data via IPC to the child shell. 
-      childKilled=0;
-      myclose( pipeEnteringChild[0] );
-      myclose( pipeExitingChild[1] );
-      
-      struct pollfd fds[] = { // poll on input from the user via stdin (which has come from the client since we're 
-	      		      // on the server technically) and from the shell process
-	{ file, POLLIN, 0 },
-	{ pipeExitingChild[0], POLLIN, 0 }
-      };
-
-      if ( signal(SIGPIPE,handleSig) == SIG_ERR )
-	{ fprintf(stderr, "Error setting up signal, with message %s\n", strerror(errno)); exitOut(1); }
-      
+	{ fprintf(stderr, "Error in executing specified program %s\n", strerror(errno)); _exit(1); } // exit() would flush the server's recordings a second time
+    }
+
+  // child is alive, keep our ends of the pipes to send and receive data via IPC to the child shell
+  myclose( pipeEnteringChild[0] );
+  myclose( pipeExitingChild[1] );
+  c->pipeToShell = pipeEnteringChild[1];
+  c->pipeFromShell = pipeExitingChild[0];
+  setNonBlocking(c->pipeToShell);
+  setNonBlocking(c->pipeFromShell);
+  return 0;
+}
+
+int queueForClient(struct shellSession* s, const char* buf, int len)
+{
+  // put a whole frame (or the hello) into toClient, remembering where it ends every CLIENT_MARK_SPACING bytes or so
+  if ( ringPut(&s->toClient, buf, len) == -1 )
+    return -1;
+  s->queuedTotal += len;
+  if ( s->markCount == 0 || (s->markCount < CLIENT_MARKS && s->queuedTotal - s->marks[s->markCount-1] >= CLIENT_MARK_SPACING) )
+    {
+      s->markOutput[s->markCount] = s->replayed;
+      s->marks[s->markCount++] = s->queuedTotal;
+    }
+  return 0;
+}
+
+void encodeForClient(struct shellSession* s, const char* buf, int writeSize)
+{
+  // encode data with the negotiated codec and queue it as one frame. the caller made sure a whole frame fits
+  char bufOut[FRAME_HEADER_SIZE+FRAME_WIRE_MAX];
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  int wireSize = codecEncode(&s->codec, buf, writeSize, bufOut, sizeof(bufOut));
+  if (wireSize == -1)
+    { fprintf(stderr, "%s encode failure at server \n", s->codec.codec->name); hangUp(s); return; }
+  long long ns = statsElapsedNs(&start);
+  s->counters.encodeNs += ns;
+  s->counters.dataOut += writeSize;
+  s->counters.framesOut++;
+  histRecord(&encodeTime, ns);
+  histRecord(&frameRatio, wireSize*1000L/writeSize);
+  if ( queueForClient(s, bufOut, wireSize) == -1 )
+    { fprintf(stderr, "Memory allocation issue!\n"); hangUp(s); }
+}
+
+void write_compress(struct shellSession* s, char* buf, int writeSize)
+{
+  // queue data from buffer for the client (using the negotiated codec), analogous to the method of the same name on
+  // client. the caller made sure a whole frame fits in toClient. a session which can be resumed keeps it in its
+  // scrollback too, where it waits while the client is away or still catching up (see replayOutput())
+  if (s->token)
+    {
+      int behind = s->replayed < s->scroll.end;
+      if ( scrollAdd(&s->scroll, buf, writeSize) == -1 ) // a resumed client gets nothing from before this
+	fprintf(stderr, "Memory allocation issue!\n");
+      if (behind || s->clientGone)
+	return;
+      s->replayed = s->scroll.end;
+    }
+  if (s->clientGone) // nobody to send it to
+    return;
+  encodeForClient(s, buf, writeSize);
+}
+
+struct channel* findShell(unsigned long pid, struct shellSession** owner)
+{
+  // the channel running shell pid, and the session it belongs to
+  for (int i=0; i<sessionCount; i++)
+    for (int j=0; j<sessions[i]->channelCount; j++)
+      if ((unsigned long)sessions[i]->channels[j]->shell == pid)
+	{
+	  *owner = sessions[i];
+	  return sessions[i]->channels[j];
+	}
+  return NULL;
+}
+
+int viewGroupSize(const struct viewGroup* g)
+{
+  // sessions the group's frames go to: its viewers, then the shell's own session if it shares them
+  return g->count + (g->owner != NULL);
+}
+
+struct shellSession* viewGroupMember(const struct viewGroup* g, int i)
+{
+  return i < g->count ? g->members[i] : g->owner;
+}
+
+int joinViewers(struct shellSession* v, struct codecSpec* agreed)
+{
+  // make v a viewer of the shell its hello asked for, answering the hello with the spec of the frames its viewers
+  // share. the first viewer sets that spec: the one the shell's own client uses if v can decode it, in which case
+  // that client gets the shared frames too, otherwise v's own. v gets frames from the next resync on. -1 if there
+  // is no such shell, or v can't decode the frames
+  struct shellSession* owner;
+  struct channel* c = findShell(agreed->watch, &owner);
+  if (c == NULL || c->outputDone || c->hungUp)
+    { fprintf(stderr, "no shell %lu to watch at server\n", agreed->watch); return -1; }
+  if (c->viewers == NULL)
+    {
+      struct viewGroup* g = calloc(1, sizeof(struct viewGroup));
+      if (g == NULL)
+	{ fprintf(stderr, "Memory allocation issue!\n"); return -1; }
+      int shared = !owner->mux && !owner->echo && !owner->clientGone && owner->replayed == owner->scroll.end && codecJoinHello(v->hello, &owner->spec, agreed) == 0;
+      g->spec = *agreed;
+      if ( codecInit(&g->codec, agreed, &dictionary) == -1 )
+	{ fprintf(stderr, "codecInit() failure at server for codec %s\n", codecFind(agreed->id)->name); free(g); return -1; }
+      if (shared) // from the next resync on its client decodes the shared stream, so its own compressor goes
+	{
+	  char notice [FRAME_HEADER_SIZE];
+	  codecRestart(&owner->codec, notice, sizeof(notice)); // no need for the notice, the resync resets its decoder
+	  g->owner = owner;
+	  owner->resync = 1;
+	  g->resyncing++;
+	}
+      c->viewers = g;
+    }
+  else if ( codecJoinHello(v->hello, &c->viewers->spec, agreed) == -1 )
+    { fprintf(stderr, "viewer of shell %lu can't decode its frames at server\n", agreed->watch); return -1; }
+  struct viewGroup* g = c->viewers;
+  if (g->count == g->slots)
+    {
+      int slots = g->slots ? 2*g->slots : 4;
+      struct shellSession** grown = realloc(g->members, slots * sizeof(struct shellSession*));
+      if (grown == NULL)
+	{ fprintf(stderr, "Memory allocation issue!\n"); return -1; }
+      g->members = grown;
+      g->slots = slots;
+    }
+  g->members[g->count++] = v;
+  g->resyncing++;
+  v->viewer = v->resync = 1;
+  v->viewing = c;
+  viewerTotal++;
+  return 0;
+}
+
+void freeViewers(struct channel* c)
+{
+  codecEnd(&c->viewers->codec);
+  free(c->viewers->members);
+  free(c->viewers);
+  c->viewers = NULL;
+}
+
+void leaveViewers(struct shellSession* v)
+{
+  // v is done watching. the last viewer to go takes the shared encoder with it, and the shell's own client goes
+  // back to frames of its own, starting with a fresh stream
+  struct viewGroup* g = v->viewing->viewers;
+  for (int i=0; i<g->count; i++)
+    if (g->members[i] == v)
+      {
+	g->members[i] = g->members[--g->count];
+	break;
+      }
+  if (v->resync)
+    g->resyncing--;
+  if (g->count == 0)
+    {
+      struct shellSession* owner = g->owner;
+      char reset [FRAME_HEADER_SIZE];
+      if ( owner && !owner->clientGone && queueForClient(owner, reset, codecResetFrame(reset, sizeof(reset))) == -1 )
+	{ fprintf(stderr, "Memory allocation issue!\n"); hangUp(owner); }
+      if (owner)
+	owner->behind = owner->resync = 0;
+      freeViewers(v->viewing);
+    }
+  v->viewing = NULL;
+  viewerTotal--;
+}
+
+void endViewers(struct channel* c)
+{
+  // the shell is gone: its viewers hang up once they have been sent what they were queued
+  if (c->viewers == NULL)
+    return;
+  for (int i=0; i<c->viewers->count; i++)
+    c->viewers->members[i]->viewing = NULL;
+  viewerTotal -= c->viewers->count;
+  freeViewers(c);
+}
+
+int sharesFrames(const struct shellSession* s, const struct channel* c)
+{
+  // the session's client gets the frames of the shell's viewers, not frames of its own
+  return c->viewers != NULL && c->viewers->owner == s;
+}
+
+void queueForViewer(struct shellSession* v, const char* wire, int wireSize, int dataSize)
+{
+  // a frame for a member of a view group which is in step with the shared stream. one that doesn't fit makes a
+  // viewer fall behind instead of holding up the shell: it misses frames until it has drained, and the next
+  // resync. (the shell's own session only reads the shell while it has room, so it keeps up)
+  if (v->clientGone)
+    return;
+  if ( v->behind || ringSpace(&v->toClient) < wireSize || queueForClient(v, wire, wireSize) == -1 )
+    {
+      v->behind = 1;
+      v->counters.discarded += dataSize;
+      return;
+    }
+  v->counters.dataOut += dataSize;
+  if (dataSize > 0)
+    v->counters.framesOut++;
+}
+
+void restartViewers(struct viewGroup* g)
+{
+  // start the shared stream over, telling every member in step with it; the others get a reset when they resync
+  char notice [FRAME_HEADER_SIZE];
+  int noticeSize = codecRestart(&g->codec, notice, sizeof(notice));
+  for (int i=0; i<viewGroupSize(g) && noticeSize > 0; i++)
+    if (!viewGroupMember(g, i)->resync)
+      queueForViewer(viewGroupMember(g, i), notice, noticeSize, 0);
+}
+
+void showViewers(struct shellSession* s, struct channel* c, const char* buf, int len)
+{
+  // encode a chunk of the shell's output once and queue the frame for every viewer of it (and for the shell's own
+  // client, if it shares the frames). members which joined, or have caught up since falling behind, come in at a
+  // resync: the shared compressor starts over right before this frame, and every member is told to start
+  // decoding afresh
+  struct viewGroup* g = c->viewers;
+  if (g == NULL || len == 0)
+    return;
+  for (int i=0; i<viewGroupSize(g); i++)
+    {
+      struct shellSession* v = viewGroupMember(g, i);
+      if ( v->behind && !v->clientGone && ringLen(&v->toClient) <= TO_CLIENT_LOW )
+	{
+	  v->behind = 0;
+	  v->resync = 1;
+	  g->resyncing++;
+	}
+    }
+  if (g->resyncing > 0)
+    {
+      char reset [FRAME_HEADER_SIZE];
+      int resetSize = codecResetFrame(reset, sizeof(reset)); // whatever stream a member which fell behind was decoding is over
+      restartViewers(g);
+      for (int i=0; i<viewGroupSize(g); i++)
+	{
+	  struct shellSession* v = viewGroupMember(g, i);
+	  if (v->resync)
+	    queueForViewer(v, reset, resetSize, 0);
+	  v->resync = 0;
+	}
+      g->resyncing = 0;
+    }
+
+  char wire [FRAME_HEADER_SIZE+FRAME_WIRE_MAX];
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  int wireSize = codecEncode(&g->codec, buf, len, wire, sizeof(wire));
+  if (wireSize == -1) // every member would need a resync, and the next one could fail all the same
+    {
+      fprintf(stderr, "%s encode failure for the viewers of shell %d at server\n", g->codec.codec->name, (int)c->shell);
+      for (int i=0; i<viewGroupSize(g); i++)
+	hangUp(viewGroupMember(g, i));
+      return;
+    }
+  long long ns = statsElapsedNs(&start); // the shell's session pays for it, once, however many watch
+  s->counters.encodeNs += ns;
+  histRecord(&encodeTime, ns);
+  histRecord(&frameRatio, wireSize*1000L/len);
+  if (g->owner) // its traffic, as far as codecIdleTimeout() is concerned
+    g->owner->codec.lastActivity = g->codec.lastActivity;
+  if ( g->owner && g->owner->token ) // and its output, which write_compress() would have kept
+    {
+      if ( scrollAdd(&g->owner->scroll, buf, len) == -1 )
+	fprintf(stderr, "Memory allocation issue!\n");
+      g->owner->replayed = g->owner->scroll.end;
+    }
+  for (int i=0; i<viewGroupSize(g); i++)
+    queueForViewer(viewGroupMember(g, i), wire, wireSize, len);
+}
+
+void sendUrgent(struct shellSession* s, int type, int id)
+{
+  // queue a control message for the client in an urgent frame, which doesn't go through the codec
+  char message [MUX_CONTROL_MAX];
+  char wire [FRAME_HEADER_SIZE+MUX_CONTROL_MAX];
+  if (s->clientGone)
+    return;
+  int wireSize = codecEncodeUrgent(&s->codec, message, muxControl(message, type, id, 0, 0), wire, sizeof(wire));
+  s->counters.framesOut++;
+  if ( wireSize == -1 || queueForClient(s, wire, wireSize) == -1 )
+    { fprintf(stderr, "Memory allocation issue!\n"); hangUp(s); }
+}
+
+void sendControl(struct shellSession* s, int type, int id, unsigned long value, int valueLen)
+{
+  // queue a channel message without data for the client; CONTROL_RESERVE keeps room for it
+  char frame [MUX_CONTROL_MAX];
+  write_compress(s, frame, muxControl(frame, type, id, value, valueLen));
+}
+
+void creditClient(struct shellSession* s, struct channel* c, int consumed)
+{
+  // give the client back the window its input no longer takes up, once there is enough of it to be worth a frame
+  if (!s->mux)
+    return;
+  c->creditOwed += consumed;
+  if (c->creditOwed >= MUX_CREDIT_BATCH)
+    {
+      sendControl(s, MUX_CREDIT, c->id, c->creditOwed, 4);
+      c->creditOwed = 0;
+    }
+}
+
+struct channel* openChannel(struct shellSession* s, int id)
+{
+  // start a shell for a new channel, NULL if that didn't work out
+  struct channel* c = calloc(1, sizeof(struct channel));
+  if (c == NULL)
+    { fprintf(stderr, "Memory allocation issue!\n"); return NULL; }
+  c->id = id;
+  c->pipeToShell = c->pipeFromShell = -1;
+  c->sendWindow = MUX_WINDOW;
+  ringInit(&c->toShell, TO_SHELL_RING);
+  if ( s->echo && (c->editor = calloc(1, sizeof(struct lineEditor))) == NULL )
+    { fprintf(stderr, "Memory allocation issue!\n"); free(c); return NULL; }
+  if ( startShell(s, c) == -1 )
+    { free(c->editor); free(c); return NULL; }
+  if (recordDir)
+    {
+      char path [4096];
+      snprintf(path, sizeof(path), "%s/session%lu.%d.rec", recordDir, s->number, id);
+      if ( recordOpen(&c->recorder, path) == -1 )
+	fprintf(stderr, "Unable to record to %s with message %s\n", path, strerror(errno)); // the session goes on without
+    }
+  s->channels[s->channelCount++] = c;
+  channelTotal++;
+  return c;
+}
+
+unsigned long newToken(void)
+{
+  // a token no other session has, random so that a client can't resume someone else's session by counting up
+  unsigned long token = 0;
+  for (unsigned tries=0; token == 0; tries++)
+    {
+      unsigned r;
+      if ( getrandom(&r, sizeof(r), GRND_NONBLOCK) != sizeof(r) ) // no entropy yet, so early after boot
+	r = (unsigned)(sessionsStarted + tries) * 2654435761u ^ (unsigned)wakeup.tv_nsec;
+      token = r;
+      for (int i=0; i<sessionCount && token; i++)
+	if (sessions[i]->token == token)
+	  token = 0;
+    }
+  return token;
+}
+
+int detachTimeout(const struct shellSession* s)
+{
+  // milliseconds until a detached session gives up on its client (poll timeout format)
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  long left = (s->detachDeadline.tv_sec - now.tv_sec)*1000 + (s->detachDeadline.tv_nsec - now.tv_nsec)/1000000;
+  return left > 0 ? (int)left : 0;
+}
+
+void loseClient(struct shellSession* s)
+{
+  // the connection broke, or the client closed it while its shell still runs. a session which can be resumed
+  // closes the socket and lets go of its compressor, but keeps its shell, whose output goes on into the
+  // scrollback, until a client resumes it or detachSeconds pass. any other session hangs up
+  if (s->token == 0)
+    { hangUp(s); return; }
+  for (int j=0; j<s->channelCount; j++)
+    if ( sharesFrames(s, s->channels[j]) ) // its viewers go on without it, a resumed client gets frames of its own
+      {
+	s->channels[j]->viewers->resyncing -= s->resync;
+	s->channels[j]->viewers->owner = NULL;
+      }
+  s->behind = s->resync = 0;
+  s->clientGone = s->detached = 1;
+  s->framesWaiting = 0;
+  ringDiscard(&s->toClient);
+  ringRelease(&s->toClient);
+  s->queuedTotal = s->sentTotal;
+  s->markCount = 0;
+  myclose(s->socket);
+  s->socket = s->pollSocket = -1;
+  coalesceInit(&s->coalesce, -1, COALESCE_OFF);
+  codecEnd(&s->codec);
+  clock_gettime(CLOCK_MONOTONIC, &s->detachDeadline);
+  s->detachDeadline.tv_sec += detachSeconds;
+}
+
+void replayOutput(struct shellSession* s)
+{
+  // a resumed client catching up: queue the output it missed, out of the scrollback, for as long as toClient has
+  // room for a frame. what the shell writes meanwhile goes into the scrollback behind it
+  char buf [FRAME_MAX];
+  if ( s->replayed < scrollStart(&s->scroll) ) // it outran us, the oldest of it is gone
+    s->replayed = scrollStart(&s->scroll);
+  while ( !s->clientGone && s->replayed < s->scroll.end && ringSpace(&s->toClient) >= FRAME_HEADER_SIZE + FRAME_WIRE_MAX + CONTROL_RESERVE )
+    {
+      int len = scrollCopy(&s->scroll, s->replayed, buf, sizeof(buf));
+      if (len <= 0)
+	{ fprintf(stderr, "scrollback decode failure at server\n"); hangUp(s); return; }
+      s->replayed += len;
+      encodeForClient(s, buf, len);
+    }
+}
+
+int resumeSession(struct shellSession* s, const struct codecSpec* agreed)
+{
+  // s's hello asked to resume a detached session: its connection moves over to that session, and the answer to
+  // the hello with it, which tells the client where the output it gets next starts. that is the first byte it is
+  // missing, or the oldest the scrollback still has. s is left without a client, and ends. returns 0 if there is
+  // no such session, or the hello doesn't fit it, so s goes on as a new one
+  struct shellSession* d = NULL;
+  for (int i=0; i<sessionCount; i++)
+    if ( sessions[i]->detached && sessions[i]->token == agreed->resume )
+      d = sessions[i];
+  if ( d == NULL || agreed->mux || agreed->watch || agreed->echo != d->echo )
+    return 0;
+  if ( codecInit(&d->codec, agreed, &dictionary) == -1 )
+    { fprintf(stderr, "codecInit() failure at server for codec %s\n", codecFind(agreed->id)->name); hangUp(s); return 1; }
+  d->codec.memoryCap = limits.sessionMemory;
+  d->spec = *agreed;
+  d->socket = s->socket;
+  d->local = s->local;
+  d->coalesce = s->coalesce;
+  d->clientGone = d->detached = 0;
+  d->readingClient = 1;
+  unsigned long long start = scrollStart(&d->scroll);
+  d->replayed = agreed->offset < start ? start : agreed->offset > d->scroll.end ? d->scroll.end : agreed->offset;
+  d->counters.resumes++;
+  codecResumeHello(s->hello, d->token, d->replayed);
+  if ( queueForClient(d, (char*)s->hello, HELLO_SIZE) == -1 )
+    { fprintf(stderr, "Memory allocation issue!\n"); hangUp(d); }
+  replayOutput(d);
+  s->socket = -1;
+  s->clientGone = 1;
+  coalesceInit(&s->coalesce, -1, COALESCE_OFF);
+  return 1;
+}
+
+void initializeCompression(struct shellSession* s)
+{
+  // answer the client's hello with the codec we will use (limited to allowedCodecs), initialize the compression
+  // scheme for data sent to the client and the uncompression stream for data coming from it, and unless the
+  // client multiplexes (and opens its own channels) or watches another shell start its shell. a client back to
+  // resume a detached session gets that instead
+  struct codecSpec agreed;
+  if ( codecAnswerHello(s->hello, allowedCodecs, haveDictionary ? &dictionary : NULL, &limits, &agreed) == -1 )
+    { fprintf(stderr, "handshake failure at server with message %s\n", strerror(errno)); hangUp(s); return; }
+  if ( agreed.resume && resumeSession(s, &agreed) )
+    return;
+  if ( agreed.watch && joinViewers(s, &agreed) == -1 )
+    { hangUp(s); return; }
+  if ( codecInit(&s->codec, &agreed, &dictionary) == -1 )
+    { fprintf(stderr, "codecInit() failure at server for codec %s\n", codecFind(agreed.id)->name); hangUp(s); return; }
+  s->codec.memoryCap = limits.sessionMemory; // the handshake sized the streams to fit, this only guards against surprises
+  s->spec = agreed;
+  s->mux = agreed.mux;
+  s->echo = agreed.echo;
+  s->ready = 1;
+  if ( s->mux && coalesceNoDelay(s->socket) == -1 ) // even with --coalesce=off: Nagle would hold every channel's echoes behind another's output
+    fprintf(stderr, "setsockopt() failure at server with message %s\n", strerror(errno));
+  if ( detachSeconds > 0 && !s->mux && !s->viewer ) // one shell, whose output the client can be sent again
+    {
+      s->token = newToken();
+      scrollInit(&s->scroll, scrollbackLimit);
+      codecResumeHello(s->hello, s->token, 0);
+    }
+  if ( queueForClient(s, (char*)s->hello, HELLO_SIZE) == -1 || (!s->mux && !s->viewer && openChannel(s, 0) == NULL) )
+    hangUp(s);
+}
+
+void echoInput(struct shellSession* s, struct channel* c, const char* data, int x, char* out, int* outSize)
+{
+  // run input through the channel's line editor, echoing it to the client, and add every line it ends to out.
+  // takeFrames() made sure toClient has room for the echo
+  char echo [FRAME_MAX];
+  int echoSize = 0;
+  for (int i=0; i<x; i++)
+    {
+      if (echoSize > FRAME_MAX - EDIT_ECHO_MAX)
+	{
+	  write_compress(s, echo, echoSize);
+	  showViewers(s, c, echo, echoSize);
+	  echoSize = 0;
+	}
+      int echoLen;
+      if ( lineKey(c->editor, data[i], echo+echoSize, &echoLen) ) // a whole line for the shell
+	{
+	  memcpy(out+*outSize, c->editor->line, c->editor->len);
+	  *outSize += c->editor->len;
+	  lineReset(c->editor);
+	}
+      echoSize += echoLen;
+    }
+  if (echoSize > 0)
+    {
+      write_compress(s, echo, echoSize);
+      showViewers(s, c, echo, echoSize);
+    }
+}
+
+void channelInput(struct shellSession* s, struct channel* c, const char* data, int x)
+{
+  // translate input for a channel's shell into its toShell
+  char out [FRAME_MAX+EDIT_LINE_MAX];
+  int outSize = 0;
+  int lineBefore = c->editor ? c->editor->len : 0;
+  if (c->inputDone)
+    x = 0;
+  if (c->editor)
+    echoInput(s, c, data, x, out, &outSize);
+  else // ^C and ^D come as control messages, here they are just bytes
+    translate(data, x, TRANSLATE_TO_SHELL, out, &outSize);
+  if ( s->mux && outSize > ringSpace(&c->toShell) )
+    { fprintf(stderr, "client overran the window of channel %d\n", c->id); hangUp(s); return; }
+  if ( outSize > 0 && ringPut(&c->toShell, out, outSize) == -1 )
+    { fprintf(stderr, "Memory allocation issue!\n"); hangUp(s); return; }
+  recordAdd(&c->recorder, RECORD_INPUT, out, outSize);
+  int held = c->editor ? c->editor->len - lineBefore : 0; // typed onto a line the shell hasn't got yet
+  creditClient(s, c, x - outSize - held); // what never made it into toShell (or the line) is consumed already
+}
+
+void endInput(struct shellSession* s, struct channel* c)
+{
+  // ^D, with all input before it through: like a terminal, give the shell what is on the line without waiting for
+  // its end, then close its input once toShell has drained
+  if ( c->editor && c->editor->len > 0 && !c->inputDone )
+    {
+      if ( ringPut(&c->toShell, c->editor->line, c->editor->len) == -1 )
+	{ fprintf(stderr, "Memory allocation issue!\n"); hangUp(s); return; }
+      recordAdd(&c->recorder, RECORD_INPUT, c->editor->line, c->editor->len);
+      lineReset(c->editor);
+    }
+  c->inputDone = 1;
+}
+
+void discardClientOutput(struct shellSession* s)
+{
+  // cut toClient at the first frame boundary the socket hasn't got to yet. whatever a stream codec encoded into
+  // the frames thrown away is gone, so the compressor starts over and tells the client to do the same. the
+  // scrollback loses that output as well (and whatever a resumed client had still to catch up on), or the
+  // client would get it after all if it resumed
+  for (int i=0; i<s->markCount; i++)
+    if (s->marks[i] >= s->sentTotal)
+      {
+	int keep = s->marks[i] - s->sentTotal;
+	if ( s->token && scrollTruncate(&s->scroll, s->markOutput[i]) == -1 )
+	  fprintf(stderr, "Memory allocation issue!\n"); // a resumed client gets nothing from before the cut
+	if (s->token)
+	  s->replayed = s->markOutput[i];
+	if (keep == ringLen(&s->toClient))
+	  return;
+	s->counters.discarded += ringLen(&s->toClient) - keep;
+	ringTruncate(&s->toClient, keep);
+	s->queuedTotal = s->marks[i];
+	s->marks[0] = s->marks[i];
+	s->markOutput[0] = s->markOutput[i];
+	s->markCount = 1;
+	if ( s->channelCount > 0 && sharesFrames(s, s->channels[0]) ) // the stream is the viewers' as well, they start over too
+	  {
+	    restartViewers(s->channels[0]->viewers);
+	    return;
+	  }
+	char notice [FRAME_HEADER_SIZE];
+	int noticeSize = codecRestart(&s->codec, notice, sizeof(notice));
+	if ( noticeSize > 0 && queueForClient(s, notice, noticeSize) == -1 )
+	  { fprintf(stderr, "Memory allocation issue!\n"); hangUp(s); }
+	return;
+      }
+}
+
+void interruptChannel(struct shellSession* s, struct channel* c)
+{
+  // ^C: interrupt whatever the shell is running and, like a terminal, throw away its input and output still on
+  // the way, or the client would go on scrolling through output from before the interrupt long after it. output
+  // of other channels shares toClient, so that is only cut when there are none. our reply tells the client
+  // where the output written after the interrupt starts, it drops what was already in flight up to there
+  if ( kill(-c->shell,SIGINT)<0 )
+    fprintf(stderr, "Kill to child failure, with message %s\n", strerror(errno));
+  else
+    c->shellKilled=1; // mark killed
+  s->counters.interrupts++;
+  creditClient(s, c, ringLen(&c->toShell) + (c->editor ? c->editor->len : 0));
+  ringDiscard(&c->toShell);
+  if (c->editor) // the line being typed goes as well
+    lineReset(c->editor);
+  char buf [SHELL_READ];
+  for (int n=0; n<DISCARD_READS && c->pipeFromShell != -1 && !c->outputDone; n++)
+    {
+      int y = read(c->pipeFromShell, buf, sizeof(buf));
+      if (y <= 0) // emptied it (or the shell is gone already)
+	{ c->outputDone = y == 0; break; }
+      s->counters.discarded += y;
+    }
+  if (!s->mux)
+    discardClientOutput(s);
+  sendUrgent(s, MUX_INTERRUPT, c->id);
+}
+
+void channelMessage(struct shellSession* s, const char* data, int x)
+{
+  // act on one message of a multiplexed client, or a control message of any client
+  struct muxMessage m;
+  if ( muxUnpack(data, x, &m) == -1 )
+    { fprintf(stderr, "bad channel message at server\n"); hangUp(s); return; }
+  if (m.type == MUX_RESIZE) // about the terminal, not any one channel
+    {
+      const unsigned char* p = (const unsigned char*)m.payload;
+      s->rows = (p[0] << 8) | p[1];
+      s->cols = (p[2] << 8) | p[3];
+      return;
+    }
+  struct channel* c = findChannel(s, m.channel);
+  if (m.type == MUX_OPEN)
+    {
+      if (c != NULL) // only ever reopened after we said it was closed
+	{ fprintf(stderr, "channel %d opened twice at server\n", m.channel); hangUp(s); }
+      else if ( openChannel(s, m.channel) == NULL )
+	sendControl(s, MUX_CLOSE, m.channel, 0, 0);
+    }
+  else if (c == NULL) // crossed our MUX_CLOSE
+    return;
+  else if (m.type == MUX_DATA)
+    channelInput(s, c, m.payload, m.len);
+  else if (m.type == MUX_CLOSE)
+    c->inputDone = c->hungUp = 1;
+  else if (m.type == MUX_CREDIT)
+    c->sendWindow = c->sendWindow > MUX_WINDOW - m.credit ? MUX_WINDOW : c->sendWindow + m.credit; // 1..MUX_WINDOW, see muxUnpack()
+  else if (m.type == MUX_INTERRUPT)
+    interruptChannel(s, c);
+  else if (m.type == MUX_EOF)
+    c->eofPending = 1;
+}
+
+void takeUrgent(struct shellSession* s)
+{
+  // act on the client's control events as soon as they are read, ahead of the data frames still waiting for room
+  // in toShell
+  char data [MUX_CONTROL_MAX];
+  int x = 0;
+  while ( !s->clientGone && (x = codecNextUrgent(&s->codec, data, sizeof(data))) > 0 )
+    {
+      if (x < MUX_HEADER_SIZE || data[0] < MUX_INTERRUPT) // only control events may jump the queue
+	{ fprintf(stderr, "bad urgent frame at server\n"); hangUp(s); return; }
+      channelMessage(s, data, x);
+    }
+  if (x == -1)
+    { fprintf(stderr, "bad urgent frame at server\n"); hangUp(s); }
+}
+
+void takeFrames(struct shellSession* s)
+{
+  // decode client frames and hand them to their channel. not multiplexed, there is just channel 0 and we only
+  // decode for as long as a whole frame is sure to fit its toShell; multiplexed, the channel windows see to that
+  char data [FRAME_MAX];
+  while (!s->clientGone)
+    {
+      struct channel* c = s->channelCount > 0 ? s->channels[0] : NULL;
+      if ( !s->mux && (c == NULL || c->inputDone || ringSpace(&c->toShell) < FRAME_MAX + (c->editor ? c->editor->len : 0)
+		       || (s->echo && ringSpace(&s->toClient) < ECHO_ROOM)) )
+	{ s->framesWaiting = c != NULL && !c->inputDone; return; } // stopped for lack of room, pick up again once toShell (or toClient) drains
+      struct timespec start;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      int x = codecNextFrame(&s->codec, data, sizeof(data));
+      if (x == 0) // nothing complete left, so any ^D has all the input which came before it behind it
+	{
+	  s->framesWaiting = 0;
+	  for (int j=0; j<s->channelCount; j++)
+	    if (s->channels[j]->eofPending)
+	      endInput(s, s->channels[j]);
+	  return;
+	}
+      if (x == -1)
+	{ fprintf(stderr, "%s decode failure at server \n", s->codec.codec->name); hangUp(s); return; }
+      long long ns = statsElapsedNs(&start);
+      s->counters.decodeNs += ns;
+      s->counters.dataIn += x;
+      s->counters.framesIn++;
+      histRecord(&decodeTime, ns);
+
+      if (s->mux || s->codec.urgent)
+	channelMessage(s, data, x);
+      else
+	channelInput(s, c, data, x);
+    }
+}
+
+void read_uncompress(struct shellSession* s)
+{
+  // read data from the client and queue it for decoding, analogous to the method of the same name on client. until
+  // the handshake is done, only the hello is read
+  char buf [FEED_MAX];
+  int readSize = !s->ready ? HELLO_SIZE - s->helloLen : FEED_MAX; // frames may follow the hello right away
+  if ( s->ready && readSize > codecFeedRoom(&s->codec) ) // reading ahead for control events, see serveSessions()
+    readSize = codecFeedRoom(&s->codec);
+  int x = read(s->socket, buf, readSize);
+  if ( x == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) )
+    return;
+  if (x <= 0) // hung up (or failed): the shells get eof, unless the session waits for the client to resume it
+    {
+      if (x == -1)
+	fprintf(stderr, "read() failure at server with message %s\n", strerror(errno));
+      loseClient(s);
+      return;
+    }
+  s->counters.wireIn += x;
+  coalesceInput(&s->coalesce); // whatever it was, its answer shouldn't wait behind a cork
+
+  if (!s->ready)
+    {
+      memcpy(s->hello+s->helloLen, buf, x);
+      s->helloLen += x;
+      if (s->helloLen == HELLO_SIZE)
+	initializeCompression(s);
+      return;
+    }
+  if (s->viewer) // read only: what a viewer types goes nowhere, we read it just to notice it hanging up
+    return;
+  if ( codecFeed(&s->codec, buf, x) == -1 )
+    { fprintf(stderr, "frame overflow at server \n"); hangUp(s); return; }
+  takeUrgent(s);
+  takeFrames(s);
+}
+
+int shellReadRoom(const struct shellSession* s, const struct channel* c)
+{
+  // most we may read from a shell right now: multiplexed, half the window, as every byte may become two
+  if (!s->mux)
+    return SHELL_READ;
+  return c->sendWindow/2 < SHELL_READ ? c->sendWindow/2 : SHELL_READ;
+}
+
+void readShell(struct shellSession* s, struct channel* c)
+{
+  // read data from a shell, translate it and queue it as one frame for the client
+  char buf [SHELL_READ];
+  if ( ringSpace(&s->toClient) < FRAME_HEADER_SIZE + FRAME_WIRE_MAX + CONTROL_RESERVE ) // another channel filled it this round
+    return;
+  int y = read(c->pipeFromShell, buf, shellReadRoom(s, c)); // perform read of data from shell
+  if ( y == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) )
+    return;
+  if (y <= 0) // shell closed its end (or the pipe failed): it has exited
+    { c->outputDone = 1; return; }
+  s->counters.shellReads++;
+  s->counters.shellBytes += y;
+  histRecord(&shellReadSize, y);
+  s->counters.corks += coalesceOutput(&s->coalesce, y);
+  recordAdd(&c->recorder, RECORD_OUTPUT, buf, y);
+
+  char out [MUX_HEADER_SIZE + 2*SHELL_READ];
+  int outSize;
+  if ( translate(buf, y, TRANSLATE_FROM_SHELL|TRANSLATE_STOP_EOF, out + MUX_HEADER_SIZE, &outSize) < y ) // eof received
+    c->outputDone = 1;
+  showViewers(s, c, out + MUX_HEADER_SIZE, outSize); // translated once for the client and every viewer
+  if (outSize > 0 && s->mux) // write the translated read back to client as one frame (using compression if specified)
+    {
+      muxHeader(out, MUX_DATA, c->id);
+      c->sendWindow -= outSize;
+      write_compress(s, out, MUX_HEADER_SIZE + outSize);
+    }
+  else if (outSize > 0 && !sharesFrames(s, c)) // otherwise showViewers() queued the shared frame for us as well
+    write_compress(s, out + MUX_HEADER_SIZE, outSize);
+}
+
+void flushClient(struct shellSession* s)
+{
+  int x = ringFlush(&s->toClient, s->socket);
+  if (x > 0)
+    {
+      s->sentTotal += x;
+      int gone = 0; // marks behind what was written are no use any more
+      while (gone < s->markCount && s->marks[gone] < s->sentTotal)
+	gone++;
+      memmove(s->marks, s->marks+gone, (s->markCount-gone) * sizeof(s->marks[0]));
+      memmove(s->markOutput, s->markOutput+gone, (s->markCount-gone) * sizeof(s->markOutput[0]));
+      s->markCount -= gone;
+      s->counters.wireOut += x;
+      histRecord(&wakeupToWrite, statsElapsedNs(&wakeup));
+      if (s->echo && s->framesWaiting) // maybe there is room for their echo now
+	takeFrames(s);
+    }
+  else if (x == -1)
+    {
+      if (errno != EPIPE && errno != ECONNRESET)
+	fprintf(stderr, "write() failure in server with message %s\n", strerror(errno));
+      loseClient(s);
+    }
+}
+
+void flushShell(struct shellSession* s, struct channel* c)
+{
+  int x = ringFlush(&c->toShell, c->pipeToShell);
+  if (x == -1) // shell stopped reading its input, so it won't get any more
+    {
+      creditClient(s, c, ringLen(&c->toShell));
+      ringDiscard(&c->toShell);
+      c->inputDone = 1;
+      s->framesWaiting = 0;
+    }
+  else
+    creditClient(s, c, x);
+  if (s->framesWaiting)
+    takeFrames(s);
+  if ( c->inputDone && ringLen(&c->toShell) == 0 && c->pipeToShell != -1 ) // everything before the ^D is through, now the eof
+    {
+      myclose(c->pipeToShell);
+      c->pipeToShell = -1;
+    }
+}
+
+void updateInterest(struct shellSession* s)
+{
+  // watermarks: stop taking input from a producer whose ring is too full to be sure of the next chunk, resume
+  // once it has drained well below that, so that we don't wake up for every few bytes the consumer takes. a
+  // multiplexed client is always read from, its channel windows keep it from overrunning any toShell
+  if ( s->readingShells && ringLen(&s->toClient) > TO_CLIENT_HIGH )
+    s->readingShells = 0;
+  else if ( !s->readingShells && ringLen(&s->toClient) <= TO_CLIENT_LOW )
+    s->readingShells = 1;
+  if (s->mux || s->channelCount == 0)
+    return;
+  struct channel* c = s->channels[0];
+  if ( s->readingClient && ringLen(&c->toShell) > TO_SHELL_HIGH )
+    s->readingClient = 0;
+  else if ( !s->readingClient && ringLen(&c->toShell) <= TO_SHELL_LOW )
+    s->readingClient = 1;
+}
+
+int finishChannel(struct shellSession* s, struct channel* c)
+{
+  // once the shell is done (or the client closed the channel, or is gone), reap it and tell a multiplexed client.
+  // returns 1 once the channel can be freed, 0 to be called again later
+  c->inputDone = 1;
+  flushShell(s, c); // last chance for input still queued, which the shell may well take before it sees eof
+  if ( c->pipeToShell != -1 ) // ensures that write fd to shell is closed if not already (case where shell exits due to ^C)
+    {
+      myclose(c->pipeToShell);
+      c->pipeToShell = -1;
+    }
+  int state = 0;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (c->reapDeadline.tv_sec == 0) // first time around
+    {
+      if ( !c->shellKilled && kill(-c->shell,SIGINT) < 0 ) // if child was already killed then dont kill
+	fprintf(stderr, "Failure when killing child with message %s\n", strerror(errno));
+      c->shellKilled = 1;
+      c->reapDeadline = now;
+      c->reapDeadline.tv_sec += REAP_GRACE;
+    }
+  else if (now.tv_sec > c->reapDeadline.tv_sec || (now.tv_sec == c->reapDeadline.tv_sec && now.tv_nsec >= c->reapDeadline.tv_nsec))
+    kill(-c->shell, SIGKILL); // ignored SIGINT and its stdin closing, so no more asking nicely
+
+  pid_t x = waitpid(c->shell, &state, WNOHANG); // has the child process terminated yet
+  if (x == 0)
+    return 0;
+  if (x == -1)
+    fprintf(stderr, "waitpid() failure at server with message %s\n", strerror(errno));
+  else if (WIFEXITED(state)) // if the child has terminated notify the user
+    {
+      fprintf(stderr, "SHELL EXIT SIGNAL=%d", (state)&0xff);
+      fprintf(stderr, " STATUS=%d\n", (state>>8)&0xff);
+    }
+
+  if (c->pipeFromShell != -1)
+    myclose(c->pipeFromShell);
+  recordClose(&c->recorder);
+  ringDiscard(&c->toShell);
+  ringRelease(&c->toShell);
+  if (s->mux) // the client may open the channel again once it has seen this
+    sendControl(s, MUX_CLOSE, c->id, state & 0xffff, 2);
+  return 1;
+}
+
+void finishSession(struct shellSession* s)
+{
+  // all shells are gone and their output delivered (or the client is gone): hang up and tear the session down
+  if ( !s->clientGone && shutdown(s->socket,SHUT_WR) == -1 ) // close server side of tcp connection
+    fprintf(stderr, "shutdown() failure at server with message %s\n", strerror(errno));
+  if (s->socket != -1) // -1 once a detached session's client is gone, or it moved to the session it resumed
+    myclose(s->socket);
+  codecEnd(&s->codec); // close compression paradigms if they were opened
+  if (s->viewing)
+    leaveViewers(s);
+  ringDiscard(&s->toClient);
+  ringRelease(&s->toClient);
+  scrollFree(&s->scroll);
+  statsAddCounters(&endedCounters, &s->counters);
+  free(s);
+}
+
+int pollTimeout(void)
+{
+  // sleep until the first session needs attention without any traffic: to release its compressor, to check on
+  // a shell which is exiting, or to give up on a detached session
+  int timeout = -1;
+  for (int i=0; i<sessionCount; i++)
+    {
+      struct shellSession* s = sessions[i];
+      int t = -1;
+      for (int j=0; j<s->channelCount; j++)
+	if (s->channels[j]->reapDeadline.tv_sec != 0)
+	  t = REAP_INTERVAL;
+      if (t == -1 && s->ready && ringLen(&s->toClient) == 0) // not idle while frames are still waiting to go out
+	t = codecIdleTimeout(&s->codec);
+      int detach = s->detached ? detachTimeout(s) : -1;
+      if ( detach != -1 && (t == -1 || detach < t) )
+	t = detach;
+      int flush = coalesceTimeout(&s->coalesce);
+      if ( flush != -1 && (t == -1 || flush < t) )
+	t = flush;
+      if ( t != -1 && (timeout == -1 || t < timeout) )
+	timeout = t;
+    }
+  return timeout;
+}
+
+void idleSession(struct shellSession* s)
+{
+  // no traffic for a while: hand the session's compression state and ring storage back
+  char notice [FRAME_HEADER_SIZE];
+  int noticeSize = codecIdle(&s->codec, notice, sizeof(notice));
+  if ( noticeSize > 0 && queueForClient(s, notice, noticeSize) == -1 )
+    { fprintf(stderr, "Memory allocation issue!\n"); hangUp(s); return; }
+  for (int j=0; j<s->channelCount; j++)
+    if ( sharesFrames(s, s->channels[j]) ) // and the stream it shares with the shell's viewers
+      restartViewers(s->channels[j]->viewers);
+  flushClient(s);
+  ringRelease(&s->toClient);
+  for (int j=0; j<s->channelCount; j++)
+    ringRelease(&s->channels[j]->toShell);
+}
+
+long sessionMemory(const struct shellSession* s)
+{
+  // bytes a session holds: its structs, its compression state, whatever ring storage is allocated and its scrollback
+  long memory = sizeof(*s) - sizeof(s->codec) + codecSessionMemory(&s->codec) + (s->toClient.data ? s->toClient.cap : 0) + scrollMemory(&s->scroll);
+  for (int j=0; j<s->channelCount; j++)
+    {
+      struct channel* c = s->channels[j];
+      memory += sizeof(struct channel) + (c->toShell.data ? c->toShell.cap : 0) + (c->editor ? sizeof(struct lineEditor) : 0);
+      if (c->viewers) // the shared encoder, which the shell's output pays for
+	memory += sizeof(struct viewGroup) - sizeof(c->viewers->codec) + codecSessionMemory(&c->viewers->codec) + c->viewers->slots * sizeof(struct shellSession*);
+    }
+  return memory;
+}
+
+int watchedShell(const struct shellSession* s)
+{
+  return s->viewing ? (int)s->viewing->shell : 0;
+}
+
+const char* sessionCodecName(const struct shellSession* s)
+{
+  if (s->detached)
+    return "detached";
+  return s->codec.codec ? s->codec.codec->name : "handshake";
+}
+
+int sessionQueuedToShells(const struct shellSession* s)
+{
+  int queued = 0;
+  for (int j=0; j<s->channelCount; j++)
+    queued += ringLen(&s->channels[j]->toShell);
+  return queued;
+}
+
+void buildReport(struct statsReport* r, int json)
+{
+  // everything --stats reports: totals over all sessions, the histograms, the compression pool, and every live session
+  struct statsCounters total = endedCounters;
+  for (int i=0; i<sessionCount; i++)
+    statsAddCounters(&total, &sessions[i]->counters);
+  struct codecPoolStats pool;
+  codecGetPoolStats(&pool);
+  struct histogram* histograms[] = { &wakeupToWrite, &shellReadSize, &encodeTime, &decodeTime, &frameRatio };
+  int histogramCount = sizeof(histograms)/sizeof(histograms[0]);
+
+  if (json)
+    {
+      reportPrintf(r, "{\"sessions_active\":%d,\"sessions_started\":%lu,\"channels_active\":%d,\"viewers_active\":%d,\"pool\":{\"in_use\":%ld,\"cached\":%ld,\"allocations\":%ld,\"reuses\":%ld},\"totals\":{",
+		   sessionCount, sessionsStarted, channelTotal, viewerTotal, pool.inUse, pool.cached, pool.allocations, pool.reuses);
+      reportCounters(r, &total, 1);
+      reportPrintf(r, "},\"histograms\":{");
+      for (int i=0; i<histogramCount; i++)
+	{
+	  reportPrintf(r, i ? "," : "");
+	  reportHistogram(r, histograms[i], 1);
+	}
+      reportPrintf(r, "},\"sessions\":[");
+      for (int i=0; i<sessionCount; i++)
+	{
+	  struct shellSession* s = sessions[i];
+	  reportPrintf(r, "%s{\"pids\":[", i ? "," : "");
+	  for (int j=0; j<s->channelCount; j++)
+	    reportPrintf(r, "%s%d", j ? "," : "", (int)s->channels[j]->shell);
+	  reportPrintf(r, "],\"watching\":%d,\"codec\":\"%s\",\"mux\":%d,\"local\":%d,\"detached\":%d,\"memory\":%ld,\"queued_to_client\":%d,\"queued_to_shell\":%d,",
+		       watchedShell(s), sessionCodecName(s), s->mux, s->local, s->detached, sessionMemory(s), ringLen(&s->toClient), sessionQueuedToShells(s));
+	  reportCounters(r, &s->counters, 1);
+	  reportPrintf(r, "}");
+	}
+      reportPrintf(r, "]}\n");
+    }
+  else
+    {
+      reportPrintf(r, "sessions: %d active, %lu started, %d channels, %d viewers\npool: %ld bytes in use, %ld cached, %ld allocations, %ld reuses\ntotal: ",
+		   sessionCount, sessionsStarted, channelTotal, viewerTotal, pool.inUse, pool.cached, pool.allocations, pool.reuses);
+      reportCounters(r, &total, 0);
+      reportPrintf(r, "\n");
+      for (int i=0; i<histogramCount; i++)
+	reportHistogram(r, histograms[i], 0);
+      for (int i=0; i<sessionCount; i++)
+	{
+	  struct shellSession* s = sessions[i];
+	  if (s->viewer)
+	    reportPrintf(r, "session watching %d", watchedShell(s));
+	  else
+	    reportPrintf(r, "session pids");
+	  for (int j=0; j<s->channelCount; j++)
+	    reportPrintf(r, "%s%d", j ? "," : " ", (int)s->channels[j]->shell);
+	  reportPrintf(r, " codec %s%s%s memory %ld queued to client %d to shell %d: ", sessionCodecName(s),
+		       s->mux ? " (mux)" : "", s->local ? " (local)" : "", sessionMemory(s), ringLen(&s->toClient), sessionQueuedToShells(s));
+	  reportCounters(r, &s->counters, 0);
+	  reportPrintf(r, "\n");
+	}
+    }
+}
+
+void acceptStatsClients(void)
+{
+  int fd;
+  while ( (fd = accept4(statsListener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1 )
+    {
+      if (statsClientCount == STATS_CLIENTS) // busy, the stats are not worth more memory than this
+	{ close(fd); continue; }
+      memset(&statsClients[statsClientCount], 0, sizeof(struct statsClient));
+      statsClients[statsClientCount++].fd = fd;
+    }
+}
+
+int serveStatsClient(struct statsClient* c)
+{
+  // take the request, then build the report in one go and write it out without blocking. returns 1 when done with c
+  if (!c->replying)
+    {
+      int x = statsRead(c);
+      if (x != 1)
+	return x == -1;
+      buildReport(&c->report, strncmp(c->request, "json", 4) == 0);
+      c->replying = 1;
+    }
+  return statsFlush(c) != 0;
+}
+
+int sessionOver(const struct shellSession* s)
+{
+  // a multiplexed client may open more channels later, so only hanging up ends its session. a viewer's ends with
+  // the shell it watches, once it has had all of its output. a detached one waits for its client even once its
+  // shell is gone, to hand it the last of the output
+  if (s->viewer)
+    return s->clientGone || (s->viewing == NULL && ringLen(&s->toClient) == 0);
+  if (s->channelCount > 0 || s->detached)
+    return 0;
+  return s->clientGone || (!s->mux && s->ready && ringLen(&s->toClient) == 0 && s->replayed == s->scroll.end);
+}
+
+void serveSessions(int listener)
+{
+  // poll on new clients, and for every session on its client socket and its channels' shell pipes, reading only
+  // from producers whose ring has room and writing only where something is queued
+  struct pollfd* fds = NULL;
+  int fdSlots = 0;
+  if ( signal(SIGPIPE,SIG_IGN) == SIG_ERR ) // a client that went away shows up as EPIPE on its own socket instead
+    { fprintf(stderr, "Error setting up signal, with message %s\n", strerror(errno)); exitOut(1); }
+
+  while (1)
+    {
+      if (fdSlots < 3 + STATS_CLIENTS + sessionCount + 2*channelTotal)
+	{
+	  fdSlots = 2 * (3 + STATS_CLIENTS + sessionCount + 2*channelTotal);
+	  if ( (fds = realloc(fds, fdSlots * sizeof(struct pollfd))) == NULL )
+	    { fprintf(stderr, "Memory allocation issue!\n"); exitOut(1); }
+	}
+      int n = 0;
+      fds[n++] = (struct pollfd){ listener, POLLIN, 0 };
+      int localSlot = -1;
+      if (localListener != -1)
+	{ localSlot = n; fds[n++] = (struct pollfd){ localListener, POLLIN, 0 }; }
+      int statsStart = n; // the stats endpoint and its clients, if any
+      if (statsListener != -1)
+	fds[n++] = (struct pollfd){ statsListener, POLLIN, 0 };
+      for (int i=0; i<statsClientCount; i++)
+	fds[n++] = (struct pollfd){ statsClients[i].fd, statsClients[i].replying ? POLLOUT : POLLIN, 0 };
+      for (int i=0; i<sessionCount; i++)
+	{
+	  struct shellSession* s = sessions[i];
+	  short events = 0; // even with no interest, polling the socket reports a hang up
+	  int inputOpen = s->mux || s->viewer || !s->ready || (s->channelCount > 0 && !s->channels[0]->inputDone);
+	  int room = s->ready ? codecFeedRoom(&s->codec) : HELLO_SIZE;
+	  int readAhead = room >= FEED_MAX; // input is held up for its shell, but a control event behind it may still be found
+	  if ( !s->clientGone && inputOpen && room > 0 && ((s->readingClient && !s->framesWaiting) || readAhead) ) // read from client
+	    events |= POLLIN;
+	  if ( ringLen(&s->toClient) > 0 ) // write to client
+	    events |= POLLOUT;
+	  s->pollSocket = -1;
+	  if (!s->clientGone)
+	    { s->pollSocket = n; fds[n++] = (struct pollfd){ s->socket, events, 0 }; }
+	  for (int j=0; j<s->channelCount; j++)
+	    {
+	      struct channel* c = s->channels[j];
+	      c->pollFromShell = c->pollToShell = -1;
+	      if ( c->pipeFromShell != -1 && s->readingShells && !c->outputDone && shellReadRoom(s, c) > 0 ) // read from shell
+		{ c->pollFromShell = n; fds[n++] = (struct pollfd){ c->pipeFromShell, POLLIN, 0 }; }
+	      if ( c->pipeToShell != -1 && ringLen(&c->toShell) > 0 ) // write to shell
+		{ c->pollToShell = n; fds[n++] = (struct pollfd){ c->pipeToShell, POLLOUT, 0 }; }
+	    }
+	}
+
       int res;
-      char buf [1024];
-      int eof=0;
-      while(!eof) // while no end of file char received
+      if ( (res = poll(fds,n,pollTimeout())) < 0 ) // time out when a session has to release its compressor
 	{
-	    if ( (res = poll(fds,2,-1)) < 0 )
-	      { fprintf(stderr, "Poll failure with message %s\n", strerror(errno)); exitOut(1); }
-	    else if (res==0) // keep waiting, no one is ready
-	      continue;
+	  if (errno == EINTR)
+	    continue;
+	  fprintf(stderr, "Poll failure with message %s\n", strerror(errno)); exitOut(1);
+	}
+      clock_gettime(CLOCK_MONOTONIC, &wakeup);
 
-	    if ( fds[0].revents & POLLIN ) // read from client 
+      for (int i=0; i<sessionCount; i++)
+	{
+	  struct shellSession* s = sessions[i];
+	  if ( s->pollSocket != -1 && (fds[s->pollSocket].revents & (POLLOUT|POLLERR|POLLHUP)) && ringLen(&s->toClient) > 0 )
+	    flushClient(s);
+	  int queued = ringLen(&s->toClient);
+	  if ( s->pollSocket != -1 && (fds[s->pollSocket].revents & (POLLIN|POLLERR|POLLHUP)) && (fds[s->pollSocket].events & POLLIN) )
 	    {
-	      int x = read_uncompress(file, buf, 256); // read_uncompress performing actual uncompression if that option specified on client end
-	      for (int i=0; i<x; i++)
-	      { 
-		if (buf[i]==0x04)
-		  myclose(pipeEnteringChild[1]); // don't set eof here; only once eof from shell received
-		else if (buf[i]==0x03) // ^C
-		  {
-		    if ( kill(ChildID,SIGINT)<0 )
-		      { fprintf(stderr, "Kill to child failure, with message %s\n", strerror(errno)); exitOut(1); }
-		    else
-		      childKilled=1; // mark killed
-		  }
-		else if (buf[i]==cr || buf[i]==lf) // perform cr/lf mapping to <cr><lf>
-		    mywrite(pipeEnteringChild[1], &lf, 1);
-		else // if not cr/lf write character normally to child process
-		    mywrite(pipeEnteringChild[1], &(buf[i]), 1);
-	      }
+	      read_uncompress(s); // read_uncompress queues the data up for decoding with the negotiated codec
+	      for (int j=0; j<s->channelCount; j++) // try the pipes right away, poll only has to wait for them if they're full
+		flushShell(s, s->channels[j]);
 	    }
-          
-	    else if ( fds[1].revents & POLLIN ) // read data from the shell since its ready, and write back to client
-	   {	    
-	     int y = myread(pipeExitingChild[0], buf, 256); // perform read of data from shell
-	     for (int i=0; i<y; i++) 
-	     {
-	      if (buf[i]==0x04) // eof received
-		{ eof=1; break; }
-	      else if (buf[i]==lf) // lf received, map it to <cr><lf> and write to client (using compression if specified)
-		{ write_compress(file, &cr); write_compress(file, &lf); }
-	      else // normal character received write it normally to client (using compression if specified)
-		write_compress(file, &(buf[i]));
-	     }
-	     fds[1].revents = 0;
-	   }
-
-	    else if ( (fds[0].revents & POLLERR) || (fds[0].revents & POLLHUP) ) //|| (fds[1].revents & POLLERR) )
-	      myclose(pipeEnteringChild[1]); // if poll error from stdin 
-	    else if ( (fds[1].revents & POLLERR) || (fds[1].revents & POLLHUP) ) // if eof received from shell set eof bit
-	      eof=1;
-       }
- 
-     // ensures that write fd to shell is closed if not already (case where shell exits due to ^C)
-      if ( close(pipeEnteringChild[1])<0 )
-	if ( errno != EBADF && errno!=0 ) // if file has already been closed error, then ok
-	  { fprintf(stderr, "Close failure with message %s\n", strerror(errno)); exitOut(1); }
-
-      if (!childKilled) // if child was already killed then dont kill
+	  else if ( s->pollSocket != -1 && (fds[s->pollSocket].revents & (POLLERR|POLLHUP)) && !s->clientGone ) // hung up while we weren't reading
+	    loseClient(s);
+	  for (int j=0; j<s->channelCount; j++)
+	    {
+	      struct channel* c = s->channels[j];
+	      if ( c->pollToShell != -1 && fds[c->pollToShell].revents )
+		flushShell(s, c);
+	      if ( c->pollFromShell != -1 && fds[c->pollFromShell].revents ) // read data from the shell since its ready, and queue it for the client
+		readShell(s, c);
+	    }
+	  if ( s->token && s->replayed < s->scroll.end ) // a resumed client still catching up
+	    replayOutput(s);
+	  if ( ringLen(&s->toClient) > queued ) // output, credit or handshake queued this round, all in one write
+	    flushClient(s);
+	  coalesceCheck(&s->coalesce); // bulk output which has stopped: push out its tail
+	  if ( s->ready && ringLen(&s->toClient) == 0 && codecIdleTimeout(&s->codec) == 0 )
+	    idleSession(s);
+	  if ( s->detached && detachTimeout(s) == 0 ) // nobody came back for it
+	    {
+	      s->detached = 0;
+	      hangUp(s);
+	    }
+
+	  for (int j=0; j<s->channelCount; j++)
+	    {
+	      struct channel* c = s->channels[j];
+	      if ( ((s->clientGone && !s->detached) || c->hungUp || c->outputDone) && finishChannel(s, c) ) // gone, move the last channel into its slot
+		{
+		  endViewers(c);
+		  free(c->editor);
+		  free(c);
+		  s->channels[j--] = s->channels[--s->channelCount];
+		  channelTotal--;
+		}
+	    }
+	  updateInterest(s);
+
+	  if ( sessionOver(s) ) // gone, move the last session into its slot
+	    {
+	      finishSession(s);
+	      sessions[i--] = sessions[--sessionCount];
+	    }
+	}
+
+      if (statsListener != -1) // stats after the sessions, so they include this round
 	{
-	  if ( kill(ChildID,SIGINT) < 0 )
-	    { fprintf(stderr, "Failure when killing child with message %s\n", strerror(errno)); exitOut(1); }
-	  else
-	    childKilled=1;
+	  for (int i=statsClientCount-1; i>=0; i--)
+	    if ( fds[statsStart+1+i].revents && serveStatsClient(&statsClients[i]) )
+	      {
+		close(statsClients[i].fd);
+		reportFree(&statsClients[i].report);
+		statsClients[i] = statsClients[--statsClientCount];
+	      }
+	  if (fds[statsStart].revents & POLLIN)
+	    acceptStatsClients();
 	}
 
-      finishExit(file); // go obtain exit code and set terminal modes
+      if (fds[0].revents & POLLIN) // after the sessions, since accepting moves them around
+	acceptClients(listener, 0);
+      if (localSlot != -1 && (fds[localSlot].revents & POLLIN))
+	acceptClients(localListener, 1);
     }
 }
 
@@ -327,12 +1580,21 @@ int main( int argc, char *argv[] )
 {
 
   // set/fill argument struct
-  char* prog=NULL;
   char* port=NULL;
   static struct option long_options[] = {
     {"shell", required_argument, 0, 's'}, // shell option means we will send all data from ourselves to a shell (child)
     {"port", required_argument, 0, 'p' }, // port number which the server should listen on, and expect client to write data to
-    {"compress", no_argument, 0, 'c' }, // specifies whether client sends/expects-to-receive compressed data from server (us)
+    {"compress", optional_argument, 0, 'c' }, // allows compression, optionally limited to a comma separated list of codecs (zlib,lz)
+    {"dict", required_argument, 0, 'd' }, // preset compression dictionary, used for clients which have the same one
+    {"window-bits", required_argument, 0, 'w' }, // largest zlib window (9-15) a session may use
+    {"mem-level", required_argument, 0, 'm' }, // largest zlib memLevel (1-9) a session may use
+    {"session-memory", required_argument, 0, 'M' }, // cap in bytes on the compression memory of one session
+    {"idle-release", required_argument, 0, 'i' }, // seconds without traffic before a session's compressor is released
+    {"stats", required_argument, 0, 'S' }, // UNIX socket path serving counters and histograms as text or json
+    {"record", required_argument, 0, 'r' }, // directory to record every shell's input and output in, see record.h
+    {"coalesce", required_argument, 0, 'C' }, // adaptive (default): switch tcp clients between TCP_NODELAY and TCP_CORK, off: kernel defaults
+    {"detach", required_argument, 0, 'D' }, // seconds a session with one shell outlives a dropped connection, for its client to resume it
+    {"scrollback", required_argument, 0, 'B' }, // compressed bytes of output a detached session keeps for its client
     {0,0,0,0}
   };
 
@@ -343,8 +1605,45 @@ int main( int argc, char *argv[] )
 	prog=optarg; 
       else if (in == 'p') // port number
 	port=optarg;
+      else if (in == 'd') // load the dictionary up front, every session shares it
+      {
+	if ( codecLoadDictionary(optarg, &dictionary) == -1 )
+	  { fprintf(stderr, "Unable to load dictionary %s with message %s\n", optarg, strerror(errno)); exit(1); }
+	haveDictionary=1;
+      }
+      else if (in == 'w') // zlib window size
+	limits.windowBits=atoi(optarg);
+      else if (in == 'm') // zlib memory level
+	limits.memLevel=atoi(optarg);
+      else if (in == 'M') // session memory cap
+	limits.sessionMemory=atol(optarg);
+      else if (in == 'i') // idle release period
+	limits.idleSeconds=atoi(optarg);
+      else if (in == 'S') // stats endpoint
+      {
+	if ( (statsListener = statsListen(optarg)) == -1 )
+	  { fprintf(stderr, "Unable to listen on %s with message %s\n", optarg, strerror(errno)); exit(1); }
+      }
+      else if (in == 'r') // record sessions
+	recordDir=optarg;
+      else if (in == 'C') // tcp coalescing policy
+      {
+	if ( strcmp(optarg, "adaptive") == 0 )
+	  coalesceMode = COALESCE_ADAPTIVE;
+	else if ( strcmp(optarg, "off") == 0 )
+	  coalesceMode = COALESCE_OFF;
+	else
+	  { fprintf(stderr, "--coalesce must be adaptive or off\n"); exit(1); }
+      }
+      else if (in == 'D') // detach grace period
+	detachSeconds=atoi(optarg);
+      else if (in == 'B') // scrollback size
+	scrollbackLimit=atol(optarg);
       else if (in == 'c') // compression specified
-	setCompress=1;
+      {
+	if ( codecParseAllowed(optarg, &allowedCodecs) == -1 )
+	  { fprintf(stderr, "Unrecognized --compress codec list %s\n", optarg); exit(1); }
+      }
       else if (in == '?') // unknown arg
       {
 	fprintf(stderr,"Unrecognized argument with message %s\n", strerror(errno));
@@ -353,13 +1652,15 @@ int main( int argc, char *argv[] )
   }
   if (port==NULL || prog==NULL) // if no port specified or shell option not (unlike in part 1, we wish to send data to shell process everytime)
     { fprintf(stderr, "Must enter arguments --port ' ' and --shell ' ' \n"); exit(1); }
+  if (limits.windowBits < WINDOW_BITS_MIN || limits.windowBits > WINDOW_BITS_MAX || limits.memLevel < MEM_LEVEL_MIN || limits.memLevel > MEM_LEVEL_MAX || limits.idleSeconds < 0 || limits.idleSeconds > 0xffff)
+    { fprintf(stderr, "--window-bits must be in %d-%d, --mem-level in %d-%d and --idle-release in 0-65535\n", WINDOW_BITS_MIN, WINDOW_BITS_MAX, MEM_LEVEL_MIN, MEM_LEVEL_MAX); exit(1); }
+  if (detachSeconds < 0 || scrollbackLimit < SCROLL_CHUNK)
+    { fprintf(stderr, "--detach can't be negative, and --scrollback must be at least %d\n", SCROLL_CHUNK); exit(1); }
   // set/fill argument struct
   
-  if (setCompress) // initialize compression scheme if option specified
-    initializeCompression();
-  
-  int file = establishConnection(atoi(port)); // create a tcp socket connection on specified port we are expecting to receive data on
+  int listener = establishConnection(atoi(port)); // listen for tcp connections on the port we are expecting to receive data on
+  if ( (localListener = localListen(atoi(port))) == -1 ) // and for clients on this host, which would rather skip tcp. not fatal even if someone else holds the name: clients won't talk to them (see localConnect())
+    fprintf(stderr, "Unable to listen for same-host clients with message %s, they will use tcp\n", strerror(errno));
 
-  shellArgCase(prog,file); // create child process, write data to it from client, receive said data back from shell, and then forward it back to client
- 
+  serveSessions(listener); // for every client: agree on a codec, create a child process, write data to it from the client, receive said data back from shell, and then forward it back to client
 }
@@ -0,0 +1,126 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Implementation of the session recordings declared in record.h. A recording is loaded whole, it is read before a
+replay starts and not while it runs.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include "record.h"
+
+static void putLittleEndian(unsigned char* p, uint64_t value, int bytes)
+{
+  for (int i=0; i<bytes; i++)
+    p[i] = (unsigned char)(value >> (8*i));
+}
+
+static uint64_t getLittleEndian(const unsigned char* p, int bytes)
+{
+  uint64_t value = 0;
+  for (int i=bytes-1; i>=0; i--)
+    value = (value << 8) | p[i];
+  return value;
+}
+
+int recordOpen(struct recorder* r, const char* path)
+{
+  // start a recording at path, replacing any file there. returns -1 with errno set if it can't be created
+  if ( (r->file = fopen(path, "we")) == NULL )
+    return -1;
+  setvbuf(r->file, NULL, _IOFBF, RECORD_BUFFER);
+  clock_gettime(CLOCK_MONOTONIC, &r->start);
+  if ( fwrite(RECORD_MAGIC, 1, RECORD_MAGIC_SIZE, r->file) != RECORD_MAGIC_SIZE )
+    {
+      int saved = errno;
+      fclose(r->file);
+      r->file = NULL;
+      errno = saved;
+      return -1;
+    }
+  return 0;
+}
+
+void recordAdd(struct recorder* r, int type, const char* buf, int len)
+{
+  if (r->file == NULL || len <= 0)
+    return;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  unsigned char header [RECORD_HEADER_SIZE] = { 0 };
+  header[0] = (unsigned char)type;
+  putLittleEndian(header+4, len, 4);
+  putLittleEndian(header+8, (now.tv_sec - r->start.tv_sec)*1000000000LL + now.tv_nsec - r->start.tv_nsec, 8);
+  if ( fwrite(header, 1, RECORD_HEADER_SIZE, r->file) != RECORD_HEADER_SIZE || (int)fwrite(buf, 1, len, r->file) != len )
+    {
+      fprintf(stderr, "Recording failure with message %s, no longer recording this shell\n", strerror(errno));
+      fclose(r->file);
+      r->file = NULL;
+    }
+}
+
+void recordClose(struct recorder* r)
+{
+  if (r->file != NULL && fclose(r->file) == EOF)
+    fprintf(stderr, "Recording failure with message %s\n", strerror(errno));
+  r->file = NULL;
+}
+
+int recordLoad(const char* path, struct recording* rec)
+{
+  // read a whole recording into rec. returns -1 with errno set if it can't be read, EINVAL if it isn't one
+  memset(rec, 0, sizeof(*rec));
+  FILE* f = fopen(path, "re");
+  if (f == NULL)
+    return -1;
+  long size = -1;
+  errno = 0;
+  if ( fseek(f, 0, SEEK_END) == 0 )
+    size = ftell(f);
+  if ( size < 0 || fseek(f, 0, SEEK_SET) != 0 || (rec->data = malloc(size > 0 ? size : 1)) == NULL
+       || (long)fread(rec->data, 1, size, f) != size )
+    {
+      int saved = errno ? errno : EIO;
+      fclose(f);
+      recordFree(rec);
+      errno = saved;
+      return -1;
+    }
+  fclose(f);
+  if ( size < RECORD_MAGIC_SIZE || memcmp(rec->data, RECORD_MAGIC, RECORD_MAGIC_SIZE) != 0 )
+    { recordFree(rec); errno = EINVAL; return -1; }
+
+  int slots = 0;
+  for (long at = RECORD_MAGIC_SIZE; at < size; )
+    {
+      const unsigned char* header = (const unsigned char*)rec->data + at;
+      long len = size - at >= RECORD_HEADER_SIZE ? (long)getLittleEndian(header+4, 4) : -1;
+      if ( len < 0 || len > size - at - RECORD_HEADER_SIZE || header[0] > RECORD_OUTPUT ) // cut short, or not a recording
+	{ recordFree(rec); errno = EINVAL; return -1; }
+      if (rec->count == slots)
+	{
+	  slots = slots ? 2*slots : 256;
+	  struct recordStep* grown = realloc(rec->steps, slots * sizeof(struct recordStep));
+	  if (grown == NULL)
+	    { recordFree(rec); errno = ENOMEM; return -1; }
+	  rec->steps = grown;
+	}
+      rec->steps[rec->count++] = (struct recordStep){ header[0], (long long)getLittleEndian(header+8, 8),
+						      rec->data + at + RECORD_HEADER_SIZE, (int)len };
+      at += RECORD_HEADER_SIZE + len;
+    }
+  return 0;
+}
+
+void recordFree(struct recording* rec)
+{
+  free(rec->steps);
+  free(rec->data);
+  memset(rec, 0, sizeof(*rec));
+}
@@ -0,0 +1,62 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Session recordings, for replaying a real workload against part2Server without a live shell or a person typing.
+part2Server --record=DIR writes one for every shell it starts, loadGenerator --script=replay plays a recording's
+input back to a server, and replayShell, run by that server as its --shell, plays back the recorded output.
+
+A recording is a RECORD_MAGIC header followed by records laid out like those of a binary session log
+(sessionLog.h): a 16 byte little endian header (RECORD_INPUT or RECORD_OUTPUT, 3 bytes padding, payload length,
+nanoseconds since the shell started) and the payload. Input is recorded as it is handed to the shell, after the
+server translated (and, for echo sessions, line edited) it, and output as the shell wrote it, before translation,
+so replayShell can count the bytes it is handed against the recording exactly.
+
+recordAdd() only copies into a stdio buffer, so the server's poll loop only ever waits on the disk when that
+buffer is written out. A recording which fails to write is closed and abandoned, the session carries on.
+
+*/
+
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdio.h>
+#include <time.h>
+
+#define RECORD_INPUT 0
+#define RECORD_OUTPUT 1
+#define RECORD_MAGIC "TNREC\0\0\1" // 8 bytes, starts every recording
+#define RECORD_MAGIC_SIZE 8
+#define RECORD_HEADER_SIZE 16
+#define RECORD_BUFFER 65536 // stdio buffer of a recording being written
+
+struct recorder // a recording being written, file is NULL if there is none
+{
+  FILE* file;
+  struct timespec start;
+};
+
+struct recordStep // one record of a loaded recording
+{
+  int type;
+  long long at; // ns since the shell started
+  const char* data;
+  int len;
+};
+
+struct recording
+{
+  struct recordStep* steps;
+  int count;
+  char* data; // the whole file, which the steps point into
+};
+
+int recordOpen(struct recorder* r, const char* path);
+void recordAdd(struct recorder* r, int type, const char* buf, int len);
+void recordClose(struct recorder* r);
+int recordLoad(const char* path, struct recording* rec);
+void recordFree(struct recording* rec);
+
+#endif
@@ -0,0 +1,103 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Stand-in shell for replaying a session recording (record.h) against part2Server, so the server can be measured
+on a recorded workload without a real shell, and without the noise of whatever the shell ran. Run the server with
+--shell=./replayShell and the recording named in the environment, which the server passes on to its shells:
+
+	REPLAY_FILE=session1.0.rec [REPLAY_FAST=1] part2Server --port=PORT --shell=./replayShell
+
+It writes the recorded output back in order, and where the recording has input it waits until it has read as
+many bytes of input as were recorded up to there, so every reply comes after the input it answered, just like in
+the recorded session. Output keeps the delay it had after that input (the time the real shell took), unless
+REPLAY_FAST is set, in which case it is written as soon as the input it waits for has arrived. At the end of the
+recording it reads its input until eof, like a shell waiting for ^D, and exits.
+
+*/
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include "record.h"
+
+long long nsSince(const struct timespec* t)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - t->tv_sec)*1000000000LL + now.tv_nsec - t->tv_nsec;
+}
+
+int readInput(long long* seen)
+{
+  // read whatever input is there (waiting for some), returns 0 at eof
+  char buf [4096];
+  int x;
+  while ( (x = read(0, buf, sizeof(buf))) == -1 && errno == EINTR )
+    ;
+  if (x == -1)
+    { fprintf(stderr, "read() failure in replayShell with message %s\n", strerror(errno)); exit(1); }
+  *seen += x;
+  return x;
+}
+
+void writeOutput(const char* buf, int len)
+{
+  for (int done=0; done<len; )
+    {
+      int x = write(1, buf+done, len-done);
+      if (x == -1 && errno == EINTR)
+	continue;
+      if (x == -1)
+	{ fprintf(stderr, "write() failure in replayShell with message %s\n", strerror(errno)); exit(1); }
+      done += x;
+    }
+}
+
+int main(void)
+{
+  const char* path = getenv("REPLAY_FILE");
+  const char* fastSetting = getenv("REPLAY_FAST");
+  int fast = fastSetting != NULL && strcmp(fastSetting, "0") != 0;
+  struct recording rec;
+  if (path == NULL)
+    { fprintf(stderr, "replayShell needs REPLAY_FILE to name a recording\n"); exit(1); }
+  if ( recordLoad(path, &rec) == -1 )
+    { fprintf(stderr, "Unable to load recording %s with message %s\n", path, strerror(errno)); exit(1); }
+
+  long long needed = 0, seen = 0; // input bytes the recording has had so far, and that we have read
+  struct timespec released; // when the input the next output waits for arrived, at recorded time releasedAt
+  long long releasedAt = 0;
+  clock_gettime(CLOCK_MONOTONIC, &released);
+  for (int i=0; i<rec.count; i++)
+    {
+      struct recordStep* step = &rec.steps[i];
+      if (step->type == RECORD_INPUT)
+	{
+	  needed += step->len;
+	  while (seen < needed)
+	    if ( !readInput(&seen) ) // hung up early, no one is left to answer
+	      exit(0);
+	  clock_gettime(CLOCK_MONOTONIC, &released);
+	  releasedAt = step->at;
+	  continue;
+	}
+      long long wait = step->at - releasedAt - nsSince(&released);
+      if (!fast && wait > 0)
+	{
+	  struct timespec t = { wait / 1000000000LL, wait % 1000000000LL };
+	  while ( nanosleep(&t, &t) == -1 && errno == EINTR )
+	    ;
+	}
+      writeOutput(step->data, step->len);
+    }
+  while ( readInput(&seen) ) // done, wait for eof
+    ;
+  recordFree(&rec);
+  exit(0);
+}
@@ -0,0 +1,100 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Implementation of the ring buffer declared in ring.h. ringPut() is all or nothing, so a caller which checked
+ringSpace() first never has to deal with half a frame queued; ringFlush() writes out as much as the (non-blocking)
+file descriptor takes, both wrapped segments in one writev().
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "ring.h"
+
+void ringInit(struct ring* r, int cap)
+{
+  r->data = NULL;
+  r->cap = cap;
+  r->start = 0;
+  r->len = 0;
+}
+
+int ringLen(const struct ring* r)
+{
+  return r->len;
+}
+
+int ringSpace(const struct ring* r)
+{
+  return r->cap - r->len;
+}
+
+int ringPut(struct ring* r, const char* buf, int len)
+{
+  // queue len bytes, or none at all if they don't fit (or the storage can't be allocated)
+  if (len > r->cap - r->len)
+    { errno = ENOBUFS; return -1; }
+  if (r->data == NULL && (r->data = malloc(r->cap)) == NULL)
+    return -1;
+  int end = (r->start + r->len) % r->cap;
+  int first = r->cap - end < len ? r->cap - end : len; // up to the end of the storage, the rest wraps around
+  memcpy(r->data+end, buf, first);
+  memcpy(r->data, buf+first, len-first);
+  r->len += len;
+  return len;
+}
+
+int ringFlush(struct ring* r, int fd)
+{
+  // write queued bytes to fd until it would block, returning how many went out (-1 on a real error)
+  if (r->len == 0)
+    return 0;
+  struct iovec iov[2];
+  int first = r->cap - r->start < r->len ? r->cap - r->start : r->len;
+  iov[0].iov_base = r->data + r->start;
+  iov[0].iov_len = first;
+  iov[1].iov_base = r->data;
+  iov[1].iov_len = r->len - first;
+  ssize_t x;
+  while ( (x = writev(fd, iov, iov[1].iov_len ? 2 : 1)) == -1 && errno == EINTR )
+    ;
+  if (x == -1)
+    return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+  r->start = (r->start + x) % r->cap;
+  r->len -= x;
+  if (r->len == 0) // keep the next put contiguous
+    r->start = 0;
+  return x;
+}
+
+void ringDiscard(struct ring* r)
+{
+  r->start = 0;
+  r->len = 0;
+}
+
+void ringTruncate(struct ring* r, int len)
+{
+  // keep only the oldest len bytes, throwing away what was queued after them
+  if (len < r->len)
+    r->len = len;
+  if (r->len == 0)
+    r->start = 0;
+}
+
+void ringRelease(struct ring* r)
+{
+  // give the storage back while nothing is queued, the next put allocates it again
+  if (r->len == 0)
+    {
+      free(r->data);
+      r->data = NULL;
+      r->start = 0;
+    }
+}
@@ -0,0 +1,36 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Fixed capacity byte ring buffer, used by part2Server.c to queue data between a non-blocking socket and a
+non-blocking shell pipe. Storage is only allocated when the first byte is queued, and can be handed back
+with ringRelease() once the ring has drained, so an idle session holds nothing but the struct.
+
+The owner decides when to stop producing: ringSpace() against a high watermark turns reading off, and
+ringLen() against a low watermark turns it back on, so the ring never has to grow.
+
+*/
+
+#ifndef RING_H
+#define RING_H
+
+struct ring
+{
+  char* data; // cap bytes, NULL until something is queued
+  int cap;
+  int start; // offset of the oldest byte
+  int len;
+};
+
+void ringInit(struct ring* r, int cap);
+int ringLen(const struct ring* r);
+int ringSpace(const struct ring* r);
+int ringPut(struct ring* r, const char* buf, int len);
+int ringFlush(struct ring* r, int fd);
+void ringDiscard(struct ring* r);
+void ringTruncate(struct ring* r, int len);
+void ringRelease(struct ring* r);
+
+#endif
@@ -0,0 +1,191 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Implementation of the scrollback declared in scrollback.h. Chunks are compressed on their own, without a
+dictionary, so any of them can be decoded (or thrown away) without the ones before it. A chunk which doesn't
+shrink is kept as it is, and copied out without decoding.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "scrollback.h"
+#include "lz.h"
+
+void scrollInit(struct scrollback* b, long limit)
+{
+  memset(b, 0, sizeof(*b));
+  b->limit = limit;
+}
+
+unsigned long long scrollStart(const struct scrollback* b)
+{
+  // offset of the oldest byte held, end if there is none
+  return b->count > 0 ? b->chunks[0]->offset : b->end - b->tailLen;
+}
+
+static void scrollClear(struct scrollback* b)
+{
+  // drop everything held, end stays where it is
+  for (int i=0; i<b->count; i++)
+    free(b->chunks[i]);
+  b->count = 0;
+  b->held = 0;
+  b->tailLen = 0;
+}
+
+static int packTail(struct scrollback* b)
+{
+  // compress the full tail into a chunk of its own, then drop the oldest chunks while they take more than the limit
+  if (b->count == b->slots)
+    {
+      int slots = b->slots ? 2*b->slots : 16;
+      struct scrollChunk** grown = realloc(b->chunks, slots * sizeof(struct scrollChunk*));
+      if (grown == NULL)
+	return -1;
+      b->chunks = grown;
+      b->slots = slots;
+    }
+  struct scrollChunk* c = malloc(sizeof(struct scrollChunk) + b->tailLen);
+  if (c == NULL)
+    return -1;
+  c->offset = b->end - b->tailLen;
+  c->len = b->tailLen;
+  c->packedLen = lzCompress(b->tail, b->tailLen, c->data, b->tailLen-1, NULL); // has to come out smaller to be worth it
+  if (c->packedLen == -1)
+    {
+      memcpy(c->data, b->tail, b->tailLen);
+      c->packedLen = b->tailLen;
+    }
+  else
+    {
+      struct scrollChunk* shrunk = realloc(c, sizeof(struct scrollChunk) + c->packedLen);
+      if (shrunk != NULL)
+	c = shrunk;
+    }
+  b->chunks[b->count++] = c;
+  b->held += c->packedLen;
+  b->tailLen = 0;
+
+  int gone = 0;
+  while (gone < b->count && b->held > b->limit)
+    {
+      b->held -= b->chunks[gone]->packedLen;
+      free(b->chunks[gone++]);
+    }
+  memmove(b->chunks, b->chunks+gone, (b->count-gone) * sizeof(struct scrollChunk*));
+  b->count -= gone;
+  return 0;
+}
+
+int scrollAdd(struct scrollback* b, const char* buf, int len)
+{
+  // keep len more bytes of output. -1 if memory ran out, in which case what was held before goes as well, so
+  // that the scrollback never has a hole in it
+  while (len > 0)
+    {
+      if ( b->tail == NULL && (b->tail = malloc(SCROLL_CHUNK)) == NULL )
+	break;
+      int n = SCROLL_CHUNK - b->tailLen < len ? SCROLL_CHUNK - b->tailLen : len;
+      memcpy(b->tail + b->tailLen, buf, n);
+      b->tailLen += n;
+      b->end += n;
+      buf += n;
+      len -= n;
+      if ( b->tailLen == SCROLL_CHUNK && packTail(b) == -1 )
+	break;
+    }
+  if (len == 0 && b->tailLen < SCROLL_CHUNK)
+    return 0;
+  scrollClear(b);
+  b->end += len;
+  return -1;
+}
+
+int scrollCopy(const struct scrollback* b, unsigned long long from, char* out, int cap)
+{
+  // copy the output from offset from on into out, as much as fits but out of one chunk (or the tail) at most.
+  // 0 if the scrollback doesn't hold from, -1 if its chunk didn't decode
+  if (from < scrollStart(b) || from >= b->end)
+    return 0;
+  char plain [SCROLL_CHUNK];
+  const char* data = b->tail;
+  unsigned long long at = b->end - b->tailLen;
+  int len = b->tailLen;
+  if (from < at)
+    {
+      int i = b->count-1;
+      while (b->chunks[i]->offset > from)
+	i--;
+      const struct scrollChunk* c = b->chunks[i];
+      data = c->data;
+      if ( c->packedLen < c->len )
+	{
+	  if ( lzDecompress(c->data, c->packedLen, plain, c->len, NULL) != c->len )
+	    return -1;
+	  data = plain;
+	}
+      at = c->offset;
+      len = c->len;
+    }
+  int n = len - (int)(from - at);
+  if (n > cap)
+    n = cap;
+  memcpy(out, data + (from - at), n);
+  return n;
+}
+
+int scrollTruncate(struct scrollback* b, unsigned long long offset)
+{
+  // forget the output from offset on, which the client is never going to be sent. the chunk it falls in becomes
+  // the tail again, up to offset. -1 if that chunk didn't decode, in which case everything before offset goes too
+  if (offset >= b->end)
+    return 0;
+  unsigned long long tailStart = b->end - b->tailLen;
+  b->end = offset;
+  if (offset >= tailStart)
+    {
+      b->tailLen = offset - tailStart;
+      return 0;
+    }
+  b->tailLen = 0;
+  while (b->count > 0 && b->chunks[b->count-1]->offset >= offset)
+    {
+      b->held -= b->chunks[--b->count]->packedLen;
+      free(b->chunks[b->count]);
+    }
+  if (b->count == 0) // offset was older than anything held
+    return 0;
+  struct scrollChunk* c = b->chunks[b->count-1];
+  int keep = offset - c->offset;
+  if ( b->tail == NULL && (b->tail = malloc(SCROLL_CHUNK)) == NULL )
+    { scrollClear(b); return -1; }
+  if (c->packedLen == c->len)
+    memcpy(b->tail, c->data, keep);
+  else if ( lzDecompress(c->data, c->packedLen, b->tail, SCROLL_CHUNK, NULL) != c->len )
+    { scrollClear(b); return -1; }
+  b->tailLen = keep;
+  b->held -= c->packedLen;
+  free(c);
+  b->count--;
+  return 0;
+}
+
+long scrollMemory(const struct scrollback* b)
+{
+  // bytes held, apart from the struct
+  return b->held + b->count*(long)sizeof(struct scrollChunk) + b->slots*(long)sizeof(struct scrollChunk*) + (b->tail ? SCROLL_CHUNK : 0);
+}
+
+void scrollFree(struct scrollback* b)
+{
+  scrollClear(b);
+  free(b->chunks);
+  free(b->tail);
+  b->chunks = NULL;
+  b->tail = NULL;
+  b->slots = 0;
+}
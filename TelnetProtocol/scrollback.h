@@ -0,0 +1,49 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Bounded scrollback of a session's output, used by part2Server.c to keep what a shell printed around for a client
+whose connection dropped (--detach), so that once it is back it resumes from the last byte it got. Output is
+numbered from 0 in the order it was queued for the client, and the scrollback holds the most recent of it, from
+scrollStart() up to end. New output collects in a raw tail; every SCROLL_CHUNK bytes the tail is compressed with
+the lz codec (lz.h) into a chunk of its own, which terminal output shrinks to a fraction of, so the limit (on the
+bytes the chunks take) covers several times as much output. Past the limit the oldest chunks go. A chunk is only
+decoded again to send it to a resumed client, or when an interrupt cuts the output in the middle of it.
+
+*/
+
+#ifndef SCROLLBACK_H
+#define SCROLLBACK_H
+
+#define SCROLL_CHUNK 16384 // output compressed together: enough for lz to find repeats in, little enough to decode for a short replay
+
+struct scrollChunk
+{
+  unsigned long long offset; // of its first byte
+  int len; // bytes of output in it
+  int packedLen; // bytes of data, len if it is kept as is because it didn't compress
+  char data [];
+};
+
+struct scrollback
+{
+  long limit; // most bytes the chunks may take
+  long held; // bytes they take
+  struct scrollChunk** chunks; // oldest first
+  int count, slots;
+  char* tail; // SCROLL_CHUNK bytes of output not yet compressed, NULL until there is some
+  int tailLen;
+  unsigned long long end; // offset one past the newest byte
+};
+
+void scrollInit(struct scrollback* b, long limit);
+unsigned long long scrollStart(const struct scrollback* b);
+int scrollAdd(struct scrollback* b, const char* buf, int len);
+int scrollCopy(const struct scrollback* b, unsigned long long from, char* out, int cap);
+int scrollTruncate(struct scrollback* b, unsigned long long offset);
+long scrollMemory(const struct scrollback* b);
+void scrollFree(struct scrollback* b);
+
+#endif
@@ -0,0 +1,293 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Implementation of the session log declared in sessionLog.h. The ring is single producer (the session loop, in
+logRecord()) and single consumer (the writer thread), so it needs no lock: the producer only ever advances head
+and the writer only ever advances tail, both with release/acquire ordering so the bytes behind them are visible
+to the other side. Inside the ring every record is preceded by its length, which lets the writer batch whole
+records into LOG_CHUNK sized writes and rotate files between them.
+
+The producer only makes a system call when the ring is half full (to wake the writer early); otherwise the writer
+wakes up every LOG_FLUSH_MS on its own.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include "sessionLog.h"
+
+#define LOG_RING_SIZE (1<<20) // power of two, so offsets can run freely and be masked
+#define LOG_CHUNK 65536 // bytes per write() to the file
+#define LOG_FLUSH_MS 50 // longest a record waits in the ring
+
+static char* ring; // NULL unless the log is open
+static _Atomic uint64_t head; // bytes ever put into the ring, advanced by the producer
+static _Atomic uint64_t tail; // bytes ever taken out, advanced by the writer
+static atomic_int kicked; // the writer was already woken for the current backlog
+static atomic_int stopping;
+static uint64_t dropped; // records not logged for lack of room, producer only
+static int wakeFd = -1;
+static pthread_t writer;
+
+static int fd = -1; // everything below belongs to the writer thread once it runs
+static const char* logPath;
+static int logFormat;
+static long rotateSize;
+static int keepFiles;
+static long fileSize;
+static int failed;
+
+static void wakeWriter(void)
+{
+  uint64_t one = 1;
+  while ( write(wakeFd, &one, sizeof(one)) == -1 && errno == EINTR ) // nothing else can go wrong adding 1 to an eventfd
+    ;
+}
+
+static void copyIn(uint64_t at, const void* data, int len)
+{
+  int offset = at & (LOG_RING_SIZE-1);
+  int first = LOG_RING_SIZE - offset < len ? LOG_RING_SIZE - offset : len;
+  memcpy(ring+offset, data, first);
+  memcpy(ring, (const char*)data+first, len-first);
+}
+
+static void copyOut(uint64_t at, void* data, int len)
+{
+  int offset = at & (LOG_RING_SIZE-1);
+  int first = LOG_RING_SIZE - offset < len ? LOG_RING_SIZE - offset : len;
+  memcpy(data, ring+offset, first);
+  memcpy((char*)data+first, ring, len-first);
+}
+
+static void putLittleEndian(unsigned char* p, uint64_t value, int bytes)
+{
+  for (int i=0; i<bytes; i++)
+    p[i] = (unsigned char)(value >> (8*i));
+}
+
+static int append(int type, const char* buf, int size)
+{
+  // format one record straight into the ring, returns 0 if it doesn't fit
+  unsigned char header [64];
+  unsigned char count [8];
+  int headerLen, trailerLen = 0;
+  if (type == LOG_DROPPED) // the payload is the count
+    {
+      putLittleEndian(count, dropped, 8);
+      buf = (const char*)count;
+      size = logFormat == LOG_BINARY ? 8 : 0;
+    }
+  if (logFormat == LOG_BINARY)
+    {
+      struct timespec now;
+      clock_gettime(CLOCK_REALTIME, &now);
+      memset(header, 0, LOG_HEADER_SIZE);
+      header[0] = (unsigned char)type;
+      putLittleEndian(header+4, size, 4);
+      putLittleEndian(header+8, now.tv_sec*1000000000ULL + now.tv_nsec, 8);
+      headerLen = LOG_HEADER_SIZE;
+    }
+  else
+    {
+      if (type == LOG_DROPPED)
+	headerLen = snprintf((char*)header, sizeof(header), "DROPPED %llu records\n", (unsigned long long)dropped);
+      else
+	headerLen = snprintf((char*)header, sizeof(header), "%s %d bytes: ", type == LOG_RECEIVED ? "RECEIVED" : "SENT", size);
+      trailerLen = type == LOG_DROPPED ? 0 : 1;
+    }
+
+  uint32_t recordLen = headerLen + size + trailerLen;
+  uint64_t h = atomic_load_explicit(&head, memory_order_relaxed);
+  uint64_t t = atomic_load_explicit(&tail, memory_order_acquire);
+  if (sizeof(recordLen) + recordLen > LOG_RING_SIZE - (h - t))
+    return 0;
+  copyIn(h, &recordLen, sizeof(recordLen));
+  copyIn(h + sizeof(recordLen), header, headerLen);
+  copyIn(h + sizeof(recordLen) + headerLen, buf, size);
+  copyIn(h + sizeof(recordLen) + headerLen + size, "\n", trailerLen);
+  h += sizeof(recordLen) + recordLen;
+  atomic_store_explicit(&head, h, memory_order_release);
+
+  if ( h - t >= LOG_RING_SIZE/2 && !atomic_exchange(&kicked, 1) ) // getting full, don't wait for the writer's timer
+    wakeWriter();
+  return 1;
+}
+
+void logRecord(int type, const char* buf, int size)
+{
+  // log one record, never waiting: if the ring is full the record is counted as dropped instead
+  if (ring == NULL)
+    return;
+  if ( dropped > 0 && !append(LOG_DROPPED, NULL, 0) ) // say what was lost before logging anything newer
+    { dropped++; return; }
+  dropped = 0;
+  if ( !append(type, buf, size) )
+    dropped++;
+}
+
+static int openFile(void)
+{
+  if ( (fd = open(logPath, O_CREAT|O_WRONLY|O_TRUNC|O_CLOEXEC, 0666)) == -1 )
+    return -1;
+  fileSize = 0;
+  if (logFormat == LOG_BINARY)
+    {
+      if ( write(fd, LOG_MAGIC, LOG_MAGIC_SIZE) != LOG_MAGIC_SIZE )
+	return -1;
+      fileSize = LOG_MAGIC_SIZE;
+    }
+  return 0;
+}
+
+static void rotate(void)
+{
+  // FILE.keep-1 -> FILE.keep, ..., FILE -> FILE.1, and start a new FILE
+  char from [4096], to [4096];
+  close(fd);
+  for (int k=keepFiles; k>=1; k--)
+    {
+      snprintf(to, sizeof(to), "%s.%d", logPath, k);
+      if (k > 1)
+	snprintf(from, sizeof(from), "%s.%d", logPath, k-1);
+      else
+	snprintf(from, sizeof(from), "%s", logPath);
+      rename(from, to); // missing files just haven't been rotated into yet
+    }
+  if ( openFile() == -1 )
+    {
+      fprintf(stderr, "Unable to rotate log %s with message %s\n", logPath, strerror(errno));
+      failed = 1;
+    }
+}
+
+static void writeChunk(const char* chunk, int len)
+{
+  for (int done=0; done<len && !failed; )
+    {
+      int x = write(fd, chunk+done, len-done);
+      if (x == -1 && errno == EINTR)
+	continue;
+      if (x == -1) // stop logging, but never stop the session over it
+	{
+	  fprintf(stderr, "Log write failure with message %s\n", strerror(errno));
+	  failed = 1;
+	  return;
+	}
+      done += x;
+      fileSize += x;
+    }
+}
+
+static void drain(char* chunk)
+{
+  // take every complete record out of the ring, in writes of up to LOG_CHUNK bytes
+  uint64_t t = atomic_load_explicit(&tail, memory_order_relaxed);
+  uint64_t h = atomic_load_explicit(&head, memory_order_acquire);
+  int used = 0;
+  while (t < h)
+    {
+      uint32_t len;
+      copyOut(t, &len, sizeof(len));
+      long emptySize = logFormat == LOG_BINARY ? LOG_MAGIC_SIZE : 0;
+      if ( rotateSize > 0 && fileSize + used + len > rotateSize && fileSize + used > emptySize )
+	{
+	  writeChunk(chunk, used);
+	  used = 0;
+	  if (!failed)
+	    rotate();
+	}
+      if (used + len > LOG_CHUNK)
+	{
+	  writeChunk(chunk, used);
+	  used = 0;
+	}
+      copyOut(t + sizeof(len), chunk+used, len);
+      used += len;
+      t += sizeof(len) + len;
+      atomic_store_explicit(&tail, t, memory_order_release);
+    }
+  writeChunk(chunk, used);
+}
+
+static void* writerMain(void* unused)
+{
+  (void)unused;
+  char* chunk = malloc(LOG_CHUNK);
+  if (chunk == NULL)
+    {
+      fprintf(stderr, "Memory allocation issue!\n");
+      failed = 1;
+    }
+  while (1)
+    {
+      struct pollfd p = { wakeFd, POLLIN, 0 };
+      uint64_t count;
+      if ( poll(&p, 1, LOG_FLUSH_MS) > 0 ) // woken early, reset the eventfd
+	while ( read(wakeFd, &count, sizeof(count)) == -1 && errno == EINTR )
+	  ;
+      atomic_store(&kicked, 0);
+      int stop = atomic_load(&stopping); // read before draining, so everything logged before logClose() gets out
+      if (failed) // throw records away, the producer must never find the ring full because of us
+	atomic_store_explicit(&tail, atomic_load_explicit(&head, memory_order_acquire), memory_order_release);
+      else
+	drain(chunk);
+      if (stop)
+	break;
+    }
+  free(chunk);
+  return NULL;
+}
+
+int logOpen(const char* path, int format, long size, int keep)
+{
+  // open (truncate) the log and start its writer thread. -1 with errno set on failure
+  logPath = path;
+  logFormat = format;
+  rotateSize = size;
+  keepFiles = keep;
+  if ( openFile() == -1 )
+    return -1;
+  if ( (wakeFd = eventfd(0, EFD_CLOEXEC)) == -1 )
+    return -1;
+  if ( (ring = malloc(LOG_RING_SIZE)) == NULL )
+    return -1;
+  int x = pthread_create(&writer, NULL, writerMain, NULL);
+  if (x != 0)
+    {
+      free(ring);
+      ring = NULL;
+      errno = x;
+      return -1;
+    }
+  return 0;
+}
+
+void logClose(void)
+{
+  // write out everything logged so far and stop the writer
+  if (ring == NULL)
+    return;
+  if (dropped > 0)
+    append(LOG_DROPPED, NULL, 0);
+  atomic_store(&stopping, 1);
+  wakeWriter();
+  pthread_join(writer, NULL);
+  close(fd);
+  close(wakeFd);
+  free(ring);
+  ring = NULL;
+}
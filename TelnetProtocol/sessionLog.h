@@ -0,0 +1,47 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Session log for part2Client --log. Every byte sent to or received from the server is recorded, without slowing
+down the session: logRecord() only copies the record into an in-memory ring buffer, and a background writer
+thread takes whole batches out of it and writes them to the file in large sequential writes. If the writer
+can't keep up and the ring fills, records are dropped (and counted in a DROPPED record) rather than making the
+session wait.
+
+Records are either text, the format part2Client always wrote (and trainDictionary --log reads):
+
+	SENT <n> bytes: <n raw bytes>\n
+	RECEIVED <n> bytes: <n raw bytes>\n
+	DROPPED <n> records\n
+
+or, with --log-format=binary, a LOG_MAGIC file header followed by records made of a 16 byte little endian
+header (LOG_SENT/LOG_RECEIVED/LOG_DROPPED, 3 bytes padding, payload length, CLOCK_REALTIME in nanoseconds) and
+the payload; a DROPPED record's payload is the 8 byte count.
+
+Instead of a fixed cap, the log rotates: once the file would grow past --log-size bytes it is renamed to
+FILE.1 (FILE.1 to FILE.2 and so on, keeping --log-keep old files) and a new FILE is started. Rotation only
+ever happens between records.
+
+*/
+
+#ifndef SESSION_LOG_H
+#define SESSION_LOG_H
+
+#define LOG_TEXT 0
+#define LOG_BINARY 1
+#define LOG_SENT 0
+#define LOG_RECEIVED 1
+#define LOG_DROPPED 2
+#define LOG_MAGIC "TNLOG\0\0\1" // 8 bytes, starts every binary log file
+#define LOG_MAGIC_SIZE 8
+#define LOG_HEADER_SIZE 16 // of a binary record
+#define LOG_ROTATE_DEFAULT (10L<<20)
+#define LOG_KEEP_DEFAULT 3
+
+int logOpen(const char* path, int format, long rotateSize, int keep);
+void logRecord(int type, const char* buf, int size);
+void logClose(void);
+
+#endif
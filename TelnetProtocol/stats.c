@@ -0,0 +1,216 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Implementation of the histograms, report formatting and stats endpoint declared in stats.h. Reports come in two
+formats from the same functions: "name value" lines for people, and JSON members for tools. The caller writes the
+enclosing braces and commas of the JSON around them.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "stats.h"
+
+static int bucketOf(unsigned long value)
+{
+  // values below HIST_SUB get a bucket each; above, the position of the top bit picks a group of HIST_SUB buckets
+  // and the HIST_SUB_BITS bits below it pick one within the group
+  if (value < HIST_SUB)
+    return (int)value;
+  int top = 63 - __builtin_clzl(value);
+  if (top >= HIST_MAX_BITS)
+    return HIST_BUCKETS-1;
+  int shift = top - HIST_SUB_BITS;
+  return (shift+1)*HIST_SUB + (int)((value >> shift) & (HIST_SUB-1));
+}
+
+static unsigned long bucketValue(int bucket)
+{
+  // the largest value a bucket holds, so percentiles err on the high side
+  if (bucket < HIST_SUB)
+    return bucket;
+  int shift = bucket/HIST_SUB - 1;
+  unsigned long low = (unsigned long)(HIST_SUB + bucket%HIST_SUB) << shift;
+  return low + (1UL << shift) - 1;
+}
+
+void histRecord(struct histogram* h, unsigned long value)
+{
+  h->counts[bucketOf(value)]++;
+  h->count++;
+  h->sum += value;
+  if (value > h->max)
+    h->max = value;
+}
+
+unsigned long histPercentile(const struct histogram* h, double percent)
+{
+  if (h->count == 0)
+    return 0;
+  unsigned long rank = (unsigned long)(percent/100 * h->count), seen = 0;
+  for (int i=0; i<HIST_BUCKETS; i++)
+    if ( (seen += h->counts[i]) > rank )
+      return bucketValue(i) < h->max ? bucketValue(i) : h->max;
+  return h->max;
+}
+
+void statsAddCounters(struct statsCounters* total, const struct statsCounters* c)
+{
+  total->wireIn += c->wireIn;
+  total->wireOut += c->wireOut;
+  total->dataIn += c->dataIn;
+  total->dataOut += c->dataOut;
+  total->framesIn += c->framesIn;
+  total->framesOut += c->framesOut;
+  total->shellReads += c->shellReads;
+  total->shellBytes += c->shellBytes;
+  total->encodeNs += c->encodeNs;
+  total->decodeNs += c->decodeNs;
+  total->interrupts += c->interrupts;
+  total->discarded += c->discarded;
+  total->corks += c->corks;
+  total->resumes += c->resumes;
+}
+
+long long statsElapsedNs(const struct timespec* since)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - since->tv_sec)*1000000000LL + (now.tv_nsec - since->tv_nsec);
+}
+
+void reportPrintf(struct statsReport* r, const char* format, ...)
+{
+  // append to the report, growing it as needed
+  va_list args;
+  while (!r->failed)
+    {
+      va_start(args, format);
+      int n = vsnprintf(r->text + r->len, r->cap - r->len, format, args);
+      va_end(args);
+      if (n < r->cap - r->len)
+	{
+	  r->len += n;
+	  return;
+	}
+      int cap = r->cap ? 2*r->cap : 4096;
+      while (cap - r->len <= n)
+	cap *= 2;
+      char* text = realloc(r->text, cap);
+      if (text == NULL)
+	r->failed = 1;
+      else
+	{ r->text = text; r->cap = cap; }
+    }
+}
+
+void reportCounters(struct statsReport* r, const struct statsCounters* c, int json)
+{
+  double ratio = c->dataOut ? (double)c->wireOut / c->dataOut : 1; // what the codec did to output, with framing
+  if (json)
+    reportPrintf(r, "\"wire_in\":%lu,\"wire_out\":%lu,\"data_in\":%lu,\"data_out\":%lu,\"frames_in\":%lu,\"frames_out\":%lu,"
+		 "\"shell_reads\":%lu,\"shell_bytes\":%lu,\"encode_ns\":%llu,\"decode_ns\":%llu,\"ratio_out\":%.4f,"
+		 "\"interrupts\":%lu,\"discarded\":%lu,\"corks\":%lu,\"resumes\":%lu",
+		 c->wireIn, c->wireOut, c->dataIn, c->dataOut, c->framesIn, c->framesOut,
+		 c->shellReads, c->shellBytes, c->encodeNs, c->decodeNs, ratio, c->interrupts, c->discarded, c->corks, c->resumes);
+  else
+    reportPrintf(r, "wire in %lu out %lu, data in %lu out %lu, frames in %lu out %lu, shell reads %lu (%lu bytes), "
+		 "encode %llu ns, decode %llu ns, output ratio %.4f, %lu interrupts (%lu bytes discarded), %lu corks, %lu resumes",
+		 c->wireIn, c->wireOut, c->dataIn, c->dataOut, c->framesIn, c->framesOut,
+		 c->shellReads, c->shellBytes, c->encodeNs, c->decodeNs, ratio, c->interrupts, c->discarded, c->corks, c->resumes);
+}
+
+void reportHistogram(struct statsReport* r, const struct histogram* h, int json)
+{
+  double mean = h->count ? (double)h->sum / h->count : 0;
+  if (json)
+    reportPrintf(r, "\"%s\":{\"count\":%lu,\"mean\":%.1f,\"p50\":%lu,\"p90\":%lu,\"p99\":%lu,\"p999\":%lu,\"max\":%lu}",
+		 h->name, h->count, mean, histPercentile(h, 50), histPercentile(h, 90), histPercentile(h, 99),
+		 histPercentile(h, 99.9), h->max);
+  else
+    reportPrintf(r, "%-22s count %lu mean %.1f p50 %lu p90 %lu p99 %lu p99.9 %lu max %lu\n",
+		 h->name, h->count, mean, histPercentile(h, 50), histPercentile(h, 90), histPercentile(h, 99),
+		 histPercentile(h, 99.9), h->max);
+}
+
+void reportFree(struct statsReport* r)
+{
+  free(r->text);
+  memset(r, 0, sizeof(*r));
+}
+
+int statsListen(const char* path)
+{
+  // listen on a UNIX socket at path, replacing a stale one from an earlier run; -1 with errno set on failure,
+  // EEXIST if something other than a socket is there (a mistyped path must not cost anyone a file)
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path))
+    { errno = ENAMETOOLONG; return -1; }
+  strcpy(address.sun_path, path);
+
+  struct stat existing;
+  if ( lstat(path, &existing) == 0 )
+    {
+      if (!S_ISSOCK(existing.st_mode))
+	{ errno = EEXIST; return -1; }
+      if ( unlink(path) == -1 )
+	return -1;
+    }
+  else if (errno != ENOENT)
+    return -1;
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd == -1)
+    return -1;
+  if ( bind(fd, (struct sockaddr *) &address, sizeof(address)) == -1 || listen(fd, 8) == -1 )
+    {
+      int saved = errno;
+      close(fd);
+      errno = saved;
+      return -1;
+    }
+  return fd;
+}
+
+int statsRead(struct statsClient* c)
+{
+  // read the request line: returns 1 once it is complete (or the client is done sending), 0 if more is to
+  // come, -1 if the client is gone
+  int x = read(c->fd, c->request + c->requestLen, STATS_REQUEST_MAX-1 - c->requestLen);
+  if ( x == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) )
+    return 0;
+  if (x == -1)
+    return -1;
+  c->requestLen += x;
+  c->request[c->requestLen] = '\0';
+  return ( x == 0 || memchr(c->request, '\n', c->requestLen) || c->requestLen == STATS_REQUEST_MAX-1 );
+}
+
+int statsFlush(struct statsClient* c)
+{
+  // write as much of the report as the client takes: returns 1 once all of it went out, 0 if there is more, -1
+  // if the client is gone
+  while (c->report.sent < c->report.len)
+    {
+      int x = write(c->fd, c->report.text + c->report.sent, c->report.len - c->report.sent);
+      if ( x == -1 && errno == EINTR )
+	continue;
+      if ( x == -1 && (errno == EAGAIN || errno == EWOULDBLOCK) )
+	return 0;
+      if (x == -1)
+	return -1;
+      c->report.sent += x;
+    }
+  return 1;
+}
@@ -0,0 +1,84 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Statistics for part2Server: counters kept per session, log-linear ("HDR style") histograms kept for the whole
+server, and the local UNIX socket endpoint (--stats=PATH) which reports them. A client connects, sends "text" or
+"json" on one line (or nothing, for text), and gets the report back before the server hangs up.
+
+The server is a single thread, so counters and histograms are plain memory updated by the poll loop, without any
+locks or atomics. The endpoint is served by the same loop: a report is formatted in one go (a few microseconds per
+session) and then written out without blocking, like any other session's data, so a slow reader of the stats never
+holds up the sessions.
+
+A histogram splits every power of two into HIST_SUB buckets, so any recorded value is reported within 1/HIST_SUB
+(6%) of what it was, from 1 up to 2^HIST_MAX_BITS, in a fixed 2 KB.
+
+*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <time.h>
+
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1<<HIST_SUB_BITS)
+#define HIST_MAX_BITS 36 // 2^36 ns is over a minute, anything larger is clamped
+#define HIST_BUCKETS ((HIST_MAX_BITS-HIST_SUB_BITS+1)*HIST_SUB)
+#define STATS_REQUEST_MAX 16
+
+struct histogram
+{
+  const char* name;
+  unsigned long count;
+  unsigned long long sum;
+  unsigned long max;
+  unsigned counts [HIST_BUCKETS];
+};
+
+struct statsCounters // per session, and the sum of every session which has ended
+{
+  unsigned long wireIn, wireOut; // bytes read from and written to the client's socket
+  unsigned long dataIn, dataOut; // the same before compression: decoded from the client, encoded for it
+  unsigned long framesIn, framesOut;
+  unsigned long shellReads, shellBytes; // reads of the shell's output
+  unsigned long long encodeNs, decodeNs; // time spent in the codec
+  unsigned long interrupts, discarded; // ^Cs from the client, and bytes of output they threw away
+  unsigned long corks; // times output went into the bulk phase and the socket was corked (coalesce.h)
+  unsigned long resumes; // times a client came back for the session after its connection dropped (--detach)
+};
+
+struct statsReport // text being built, or a report being written out to a stats client
+{
+  char* text;
+  int len, cap;
+  int sent;
+  int failed; // ran out of memory, the report is cut short
+};
+
+struct statsClient
+{
+  int fd;
+  char request [STATS_REQUEST_MAX]; // "text" or "json", up to a newline
+  int requestLen;
+  int replying; // request complete, report being written
+  struct statsReport report;
+};
+
+void histRecord(struct histogram* h, unsigned long value);
+unsigned long histPercentile(const struct histogram* h, double percent);
+void statsAddCounters(struct statsCounters* total, const struct statsCounters* c);
+long long statsElapsedNs(const struct timespec* since);
+
+void reportPrintf(struct statsReport* r, const char* format, ...) __attribute__ ((format (printf, 2, 3)));
+void reportCounters(struct statsReport* r, const struct statsCounters* c, int json);
+void reportHistogram(struct statsReport* r, const struct histogram* h, int json);
+void reportFree(struct statsReport* r);
+
+int statsListen(const char* path);
+int statsRead(struct statsClient* c);
+int statsFlush(struct statsClient* c);
+
+#endif
@@ -0,0 +1,344 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Builds a preset compression dictionary (see --dict on part2Client/part2Server) out of recorded terminal traffic.
+Input files are either raw captures of a session (e.g. a typescript from script(1)), or with --log, log files
+written by part2Client --log of uncompressed sessions (text or binary), in which case only the terminal data the
+logged frames carry is used: frame headers, and frames which are compressed or urgent, are left out.
+
+The dictionary is chosen the way zstd's "cover" trainer does it, simplified: count how often every 8 byte
+substring (dmer) occurs across all of the input, split the input into as many epochs as there are 64 byte
+segments in the dictionary, and take the segment of each epoch whose dmers are most frequent. Dmers are
+forgotten once they have been taken, so the dictionary doesn't repeat itself. The best segments go at the
+end of the dictionary, where they are the cheapest for deflate to refer to.
+
+Finally, the first 4 KB of every input (what a short session would send) is compressed with and without the
+new dictionary, to show what it buys.
+
+*/
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <getopt.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "codec.h"
+#include "sessionLog.h"
+
+#define DMER 8
+#define SEGMENT 64
+#define FREQ_LOG 20
+#define SHORT_SESSION 4096
+
+struct segment
+{
+  int start;
+  unsigned long score;
+};
+
+char* samples; // every input, back to back
+int samplesLen;
+int* sampleStarts; // offsets of each input in samples, plus one past the end
+int sampleCount;
+unsigned* freq; // hashed dmer -> occurences
+
+struct deframer // where one direction of a logged connection is in its frames, records split them anywhere
+{
+  unsigned char header [FRAME_HEADER_SIZE];
+  int headerHave;
+  int left; // payload bytes of the current frame still to come
+  int keep; // the current frame holds plain terminal data
+};
+struct deframer logStreams [2]; // LOG_SENT, LOG_RECEIVED
+
+unsigned dmerHash(const char* p)
+{
+  unsigned long long v;
+  memcpy(&v, p, DMER);
+  return (unsigned)((v * 0x9E3779B97F4A7C15ull) >> (64 - FREQ_LOG));
+}
+
+void appendSample(const char* data, int len)
+{
+  samples = realloc(samples, samplesLen + len);
+  if (samples == NULL && len > 0)
+    { fprintf(stderr, "Memory allocation issue!\n"); exit(1); }
+  memcpy(samples+samplesLen, data, len);
+  samplesLen += len;
+}
+
+char* readFile(const char* path, int* len)
+{
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if ( fd == -1 || fstat(fd, &st) == -1 )
+    { fprintf(stderr, "Unable to open %s with message %s\n", path, strerror(errno)); exit(1); }
+  char* data = malloc(st.st_size + 1);
+  if (data == NULL)
+    { fprintf(stderr, "Memory allocation issue!\n"); exit(1); }
+  int done = 0, x;
+  while ( done < st.st_size && (x = read(fd, data+done, st.st_size-done)) > 0 )
+    done += x;
+  if (done < st.st_size)
+    { fprintf(stderr, "read() failure on %s with message %s\n", path, strerror(errno)); exit(1); }
+  close(fd);
+  data[done] = '\0';
+  *len = done;
+  return data;
+}
+
+void addFramed(int direction, const char* data, int len)
+{
+  // append the data of the uncompressed, non-urgent frames in one logged record of the given direction
+  struct deframer* d = &logStreams[direction];
+  while (len > 0)
+    {
+      if (d->left == 0)
+	{
+	  d->header[d->headerHave++] = (unsigned char)*data++;
+	  len--;
+	  if (d->headerHave == FRAME_HEADER_SIZE)
+	    {
+	      d->left = d->header[1] << 8 | d->header[2];
+	      d->keep = d->header[0] == 0;
+	      d->headerHave = 0;
+	    }
+	  continue;
+	}
+      int take = len < d->left ? len : d->left;
+      if (d->keep)
+	appendSample(data, take);
+      data += take;
+      len -= take;
+      d->left -= take;
+    }
+}
+
+void addBinaryLog(const unsigned char* data, int len)
+{
+  // pull the payload of every SENT/RECEIVED record out of a --log-format=binary log
+  int i = LOG_MAGIC_SIZE;
+  while (i + LOG_HEADER_SIZE <= len)
+    {
+      int size = data[i+4] | data[i+5]<<8 | data[i+6]<<16 | data[i+7]<<24;
+      if (size < 0 || size > len-i-LOG_HEADER_SIZE) // cut short by a rotation or a crash
+	return;
+      if (data[i] == LOG_SENT || data[i] == LOG_RECEIVED)
+	addFramed(data[i], (const char*)data+i+LOG_HEADER_SIZE, size);
+      i += LOG_HEADER_SIZE + size;
+    }
+}
+
+int logHeader(const char* data, int len, int* direction, int* size)
+{
+  // the length of the "SENT n bytes: " / "RECEIVED n bytes: " header data starts with, setting *direction and
+  // *size, or 0 if it doesn't start with one. parsed by hand, as the payload may start with whitespace of its own
+  // and data isn't NUL terminated
+  int prefixLen;
+  if ( len > 5 && strncmp(data, "SENT ", 5) == 0 )
+    { *direction = LOG_SENT; prefixLen = 5; }
+  else if ( len > 9 && strncmp(data, "RECEIVED ", 9) == 0 )
+    { *direction = LOG_RECEIVED; prefixLen = 9; }
+  else
+    return 0;
+  int digits = 0;
+  long n = 0;
+  while ( prefixLen+digits < len && digits < 10 && data[prefixLen+digits] >= '0' && data[prefixLen+digits] <= '9' )
+    n = n*10 + (data[prefixLen+digits++] - '0');
+  int headerLen = prefixLen + digits + 8;
+  if ( digits == 0 || headerLen > len || memcmp(data+prefixLen+digits, " bytes: ", 8) != 0 || n > len-headerLen )
+    return 0;
+  *size = n;
+  return headerLen;
+}
+
+void addLog(const char* data, int len)
+{
+  // pull the payload of every "SENT n bytes: ...\n" / "RECEIVED n bytes: ...\n" record out of a part2Client log
+  memset(logStreams, 0, sizeof(logStreams)); // every log starts a new connection
+  if ( len >= LOG_MAGIC_SIZE && memcmp(data, LOG_MAGIC, LOG_MAGIC_SIZE) == 0 )
+    { addBinaryLog((const unsigned char*)data, len); return; }
+  int i = 0;
+  while (i < len)
+    {
+      int size, direction;
+      int headerLen = logHeader(data+i, len-i, &direction, &size);
+      if ( headerLen > 0 && size > 0 )
+	{
+	  addFramed(direction, data+i+headerLen, size); // exactly size bytes, whatever they are
+	  i += headerLen + size;
+	}
+      else // not at a record, skip to the next line
+	{
+	  const char* nl = memchr(data+i, '\n', len-i);
+	  i = nl ? (int)(nl-data) + 1 : len;
+	}
+    }
+}
+
+int byScore(const void* a, const void* b)
+{
+  unsigned long x = ((const struct segment*)a)->score, y = ((const struct segment*)b)->score;
+  return x < y ? -1 : x > y;
+}
+
+int train(char* dict, int dictSize)
+{
+  // fill dict with the most frequent content of samples, returning its size
+  if (samplesLen <= dictSize) // too little data to choose from, take it all
+    {
+      memcpy(dict, samples, samplesLen);
+      return samplesLen;
+    }
+
+  freq = calloc(1<<FREQ_LOG, sizeof(unsigned));
+  if (freq == NULL)
+    { fprintf(stderr, "Memory allocation issue!\n"); exit(1); }
+  for (int i=0; i+DMER <= samplesLen; i++)
+    freq[dmerHash(samples+i)]++;
+
+  int segments = dictSize / SEGMENT;
+  int epoch = samplesLen / segments;
+  struct segment* chosen = malloc(segments * sizeof(struct segment));
+  if (chosen == NULL)
+    { fprintf(stderr, "Memory allocation issue!\n"); exit(1); }
+  int chosenCount = 0;
+
+  for (int e=0; e<segments; e++)
+    {
+      int begin = e*epoch, end = begin + epoch;
+      if (end + SEGMENT > samplesLen)
+	end = samplesLen - SEGMENT;
+      if (end <= begin)
+	break;
+
+      unsigned long score = 0, bestScore = 0;
+      int best = begin;
+      for (int i=begin; i<begin+SEGMENT-DMER; i++) // score of the window starting at begin
+	score += freq[dmerHash(samples+i)];
+      for (int i=begin; ; i++) // slide the window through the epoch
+	{
+	  if (score > bestScore)
+	    { bestScore = score; best = i; }
+	  if (i+1 >= end)
+	    break;
+	  score += freq[dmerHash(samples+i+SEGMENT-DMER)];
+	  score -= freq[dmerHash(samples+i)];
+	}
+      if (bestScore == 0)
+	continue;
+
+      chosen[chosenCount].start = best;
+      chosen[chosenCount++].score = bestScore;
+      for (int i=best; i<best+SEGMENT-DMER; i++) // taken, so don't let later epochs pick the same content
+	freq[dmerHash(samples+i)] = 0;
+    }
+
+  qsort(chosen, chosenCount, sizeof(struct segment), byScore); // ascending, so the best end up last
+  int len = 0;
+  for (int i=0; i<chosenCount; i++, len += SEGMENT)
+    memcpy(dict+len, samples+chosen[i].start, SEGMENT);
+  free(chosen);
+  free(freq);
+  return len;
+}
+
+int compressedSize(const char* data, int len, const char* dict, int dictLen)
+{
+  // size of data after raw deflate at the default level, the way the zlib codec sends it
+  z_stream z;
+  char out [SHORT_SESSION*2];
+  memset(&z, 0, sizeof(z));
+  if ( deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK )
+    { fprintf(stderr, "deflateInit2() failure\n"); exit(1); }
+  if ( dictLen > 0 && deflateSetDictionary(&z, (const Bytef *)dict, dictLen) != Z_OK )
+    { fprintf(stderr, "deflateSetDictionary() failure\n"); exit(1); }
+  z.next_in = (Bytef *)data;
+  z.avail_in = len;
+  z.next_out = (Bytef *)out;
+  z.avail_out = sizeof(out);
+  deflate(&z, Z_SYNC_FLUSH);
+  int size = sizeof(out) - z.avail_out;
+  deflateEnd(&z);
+  return size;
+}
+
+void evaluate(const char* dict, int dictLen)
+{
+  long raw = 0, plain = 0, withDict = 0;
+  for (int i=0; i<sampleCount; i++)
+    {
+      int len = sampleStarts[i+1] - sampleStarts[i];
+      if (len > SHORT_SESSION)
+	len = SHORT_SESSION;
+      raw += len;
+      plain += compressedSize(samples+sampleStarts[i], len, NULL, 0);
+      withDict += compressedSize(samples+sampleStarts[i], len, dict, dictLen);
+    }
+  printf("first %d bytes of %d sessions: %ld bytes raw, %ld compressed, %ld compressed with dictionary\n",
+	 SHORT_SESSION, sampleCount, raw, plain, withDict);
+}
+
+int main(int argc, char* argv[])
+{
+  static struct option long_options[] = {
+    {"output", required_argument, 0, 'o'}, // dictionary file to write
+    {"size", required_argument, 0, 's'}, // dictionary size in bytes, at most DICT_MAX
+    {"log", no_argument, 0, 'l'}, // inputs are part2Client logs rather than raw captures
+    {0,0,0,0}
+  };
+
+  int in, isLog = 0, dictSize = 16384;
+  char* output = NULL;
+  while ( ( in = getopt_long(argc, argv, "", long_options, NULL) ) != -1 )
+    {
+      if (in == 'o')
+	output = optarg;
+      else if (in == 's')
+	dictSize = atoi(optarg);
+      else if (in == 'l')
+	isLog = 1;
+      else if (in == '?')
+	{ fprintf(stderr, "Unrecognized argument\n"); exit(1); }
+    }
+  if (output == NULL || optind >= argc || dictSize < SEGMENT || dictSize > DICT_MAX)
+    { fprintf(stderr, "Usage: trainDictionary --output=FILE [--size=%d..%d] [--log] FILE...\n", SEGMENT, DICT_MAX); exit(1); }
+
+  sampleCount = argc - optind;
+  sampleStarts = malloc((sampleCount+1) * sizeof(int));
+  if (sampleStarts == NULL)
+    { fprintf(stderr, "Memory allocation issue!\n"); exit(1); }
+  for (int i=0; i<sampleCount; i++)
+    {
+      int len;
+      char* data = readFile(argv[optind+i], &len);
+      sampleStarts[i] = samplesLen;
+      if (isLog)
+	addLog(data, len);
+      else
+	appendSample(data, len);
+      free(data);
+    }
+  sampleStarts[sampleCount] = samplesLen;
+  if (samplesLen == 0)
+    { fprintf(stderr, "No traffic found in the inputs\n"); exit(1); }
+
+  char dict [DICT_MAX];
+  int dictLen = train(dict, dictSize);
+
+  int fd = open(output, O_CREAT|O_WRONLY|O_TRUNC, 0644);
+  if ( fd == -1 || write(fd, dict, dictLen) != dictLen || close(fd) == -1 )
+    { fprintf(stderr, "Unable to write %s with message %s\n", output, strerror(errno)); exit(1); }
+  printf("wrote %d byte dictionary from %d bytes of traffic to %s\n", dictLen, samplesLen, output);
+  evaluate(dict, dictLen);
+  free(samples);
+  free(sampleStarts);
+  exit(0);
+}
@@ -0,0 +1,94 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Implementation of the newline translation declared in translate.h. The search tests 8 bytes at once for each byte
+value of interest with the usual bit trick, exact for every byte (so there is no need to care about endianness or
+false hits). Words without any such byte are copied whole, and only words which hold one are gone through a byte
+at a time, with a 256 entry table saying what each byte needs so that loop has a single test per byte.
+
+*/
+
+#include <string.h>
+#include <stdint.h>
+#include "translate.h"
+
+#define ONES 0x0101010101010101ull
+#define LOWS 0x7f7f7f7f7f7f7f7full
+#define MAPPING(mode) ((mode) & 0x0f) // the TRANSLATE_TO/FROM_* part of a mode
+#define COPY 0
+#define NEWLINE 1
+#define STOP 2
+
+static uint64_t bytesEqual(uint64_t v, unsigned char c)
+{
+  // high bit set in every byte of v which equals c, and in no other
+  uint64_t x = v ^ (ONES * c);
+  return ~(((x & LOWS) + LOWS) | x | LOWS);
+}
+
+static uint64_t needsWork(uint64_t v, int mode)
+{
+  // high bit set in every byte of v which translate() can't just copy
+  uint64_t hits = bytesEqual(v, '\n');
+  if (MAPPING(mode) != TRANSLATE_FROM_SHELL)
+    hits |= bytesEqual(v, '\r');
+  if (mode & TRANSLATE_STOP_EOF)
+    hits |= bytesEqual(v, 0x04);
+  if (mode & TRANSLATE_STOP_INTR)
+    hits |= bytesEqual(v, 0x03);
+  return hits;
+}
+
+int translate(const char* in, int len, int mode, char* out, int* outLen)
+{
+  // translate in into out, which needs room for 2*len bytes. returns how many bytes of in were used: all of them,
+  // or those before a stop byte, which is left for the caller
+  unsigned char work [256] = { 0 }; // what to do with each byte value, COPY for almost all of them
+  work['\n'] = NEWLINE;
+  if (MAPPING(mode) != TRANSLATE_FROM_SHELL)
+    work['\r'] = NEWLINE;
+  if (mode & TRANSLATE_STOP_EOF)
+    work[0x04] = STOP;
+  if (mode & TRANSLATE_STOP_INTR)
+    work[0x03] = STOP;
+  int crlf = MAPPING(mode) != TRANSLATE_TO_SHELL;
+
+  int i = 0, o = 0;
+  while (i < len)
+    {
+      if (i+8 <= len)
+	{
+	  uint64_t v;
+	  memcpy(&v, in+i, sizeof(v)); // unaligned safe load
+	  if ( !needsWork(v, mode) ) // the common case: 8 bytes copied as they are
+	    {
+	      memcpy(out+o, &v, sizeof(v));
+	      i += 8;
+	      o += 8;
+	      continue;
+	    }
+	}
+      for (int end = i+8 < len ? i+8 : len; i < end; i++) // a word with something to do, or the last few bytes
+	{
+	  unsigned char c = in[i];
+	  if (work[c] == COPY)
+	    out[o++] = c;
+	  else if (work[c] == NEWLINE)
+	    {
+	      if (crlf)
+		out[o++] = '\r';
+	      out[o++] = '\n';
+	    }
+	  else
+	    {
+	      *outLen = o;
+	      return i;
+	    }
+	}
+    }
+  *outLen = o;
+  return i;
+}
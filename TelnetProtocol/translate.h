@@ -0,0 +1,32 @@
+/*
+NAME: Mihir Arya
+*/
+
+/*
+
+Newline translation shared by part1.c, part2Server.c and part2Client.c. Terminal traffic is almost all ordinary
+bytes, with a newline every few dozen, so instead of looking at every byte on its own translate() searches a
+machine word at a time for the few bytes which need work, copies the runs between them whole, and fills a
+buffer the caller then writes with a single write(). Three mappings are needed:
+
+	TRANSLATE_TO_TERMINAL	CR or LF becomes CR LF (keys echoed to the screen)
+	TRANSLATE_TO_SHELL	CR or LF becomes LF (keys on their way to a shell)
+	TRANSLATE_FROM_SHELL	LF becomes CR LF (a shell's output, for a terminal with output processing off)
+
+Any of them may be combined with TRANSLATE_STOP_EOF and TRANSLATE_STOP_INTR, which make translation stop short of
+the first ^D or ^C, so the caller can act on it and carry on from the byte after.
+
+*/
+
+#ifndef TRANSLATE_H
+#define TRANSLATE_H
+
+#define TRANSLATE_TO_TERMINAL 0
+#define TRANSLATE_TO_SHELL 1
+#define TRANSLATE_FROM_SHELL 2
+#define TRANSLATE_STOP_EOF 0x10 // ^D
+#define TRANSLATE_STOP_INTR 0x20 // ^C
+
+int translate(const char* in, int len, int mode, char* out, int* outLen);
+
+#endif
@@ -0,0 +1,101 @@
+import {tiny} from './common.js';
+
+const {Texture} = tiny;
+
+export class Asset_Loader {                     // **Asset_Loader** fetches and decodes meshes and images in a pool of Web
+                                                // Workers (asset-worker.js), so that parsing models and decoding textures
+                                                // never holds up input or drawing.  The results come back transferred, not
+                                                // copied.  It counts what it was asked for and what has arrived, so scenes
+                                                // can draw placeholders and show progress while the assets stream in.
+    constructor(pool_size = Math.max(1, Math.min(4, (navigator.hardwareConcurrency || 2) - 1))) {
+        this.pool_size = pool_size;
+        this.workers = [];                      // started on the first request, each with its count of pending jobs
+        this.jobs = new Map();                  // job id -> {resolve, reject, worker}
+        this.next_id = 0;
+        this.requested = 0;
+        this.finished = 0;
+        this.listeners = [];
+    }
+
+    get progress() {                            // progress: Fraction of the requested assets that have arrived (or failed).
+        return this.requested ? this.finished / this.requested : 1;
+    }
+
+    on_progress(callback) {                     // on_progress(): Calls callback(progress, finished, requested) now and
+                                                // whenever a request is made or finishes.
+        this.listeners.push(callback);
+        callback(this.progress, this.finished, this.requested);
+    }
+
+    report() {
+        for (let callback of this.listeners)
+            callback(this.progress, this.finished, this.requested);
+    }
+
+    start_worker() {
+        const worker = new Worker(new URL("./asset-worker.js", import.meta.url));
+        worker.pending = 0;
+        worker.onmessage = ({data}) => this.finish(data);
+        worker.onerror = event => {             // The script itself failed; retire it and fail whatever it had been given.
+            event.preventDefault();
+            this.workers.splice(this.workers.indexOf(worker), 1);
+            for (let [id, job] of this.jobs)
+                if (job.worker == worker)
+                    this.finish({id, error: event.message});
+        };
+        this.workers.push(worker);
+        return worker;
+    }
+
+    request(type, url) {
+        // request(): Hands the job to the least busy worker, starting another while the pool isn't full.
+        let worker = this.workers.reduce((best, w) => !best || w.pending < best.pending ? w : best, null);
+        if (!worker || worker.pending > 0 && this.workers.length < this.pool_size)
+            worker = this.start_worker();
+        const id = this.next_id++;
+        const result = new Promise((resolve, reject) => this.jobs.set(id, {resolve, reject, worker}));
+        worker.pending++;
+        this.requested++;
+        worker.postMessage({id, type, url: new URL(url, document.baseURI).href});
+        this.report();
+        return result;
+    }
+
+    finish({id, error, buffer, image}) {
+        const job = this.jobs.get(id);
+        if (!job)
+            return;
+        this.jobs.delete(id);
+        job.worker.pending--;
+        this.finished++;
+        if (error !== undefined)
+            job.reject(error);
+        else
+            job.resolve(buffer || image);
+        this.report();
+    }
+
+    load_mesh(filename) {                       // load_mesh(): Resolves to an ArrayBuffer laid out as a .mesh file (see
+                                                // build-meshes.py), made from the .obj if there is no prebuilt .mesh.
+        return this.request("mesh", filename);
+    }
+
+    load_image(filename) {                      // load_image(): Resolves to an ImageBitmap, ready for texImage2D().
+        return this.request("image", filename);
+    }
+}
+
+export const asset_loader = new Asset_Loader();       // Shared by every scene, so the pool and the progress are too.
+
+export class Streamed_Texture extends Texture {       // **Streamed_Texture** is a Texture whose image is decoded by the
+                                                      // asset_loader's workers instead of on the main thread.  Until it
+                                                      // arrives, shapes using it draw without it, as with any Texture.
+    load_image(filename) {
+        asset_loader.load_image(filename)
+            .then(image => {
+                this.image = image;
+                this.ready = true;
+            })
+            .catch(error => console.log("Couldn't load " + filename + ": " + error));
+    }
+}
@@ -0,0 +1,155 @@
+// asset-worker.js - The script each of Asset_Loader's workers runs (see asset-loader.js).  It fetches and decodes
+// assets off the main thread and hands the results back as transferable objects, so nothing is copied on the way:
+//   {id, type: "mesh", url}   ->  {id, buffer}   an ArrayBuffer laid out as a .mesh file (see build-meshes.py),
+//                                                either the prebuilt .mesh or one made here from the .obj
+//   {id, type: "image", url}  ->  {id, image}    an ImageBitmap, flipped vertically as WebGL expects
+// A failed request answers {id, error}.
+
+const MESH_UINT32_INDICES = 1, MESH_FLOAT_TEXTURE_COORDS = 2;
+
+function parse_into_mesh(data) {                      // Adapted from the "webgl-obj-loader.js" library found online:
+    var verts = [], vertNormals = [], textures = [], unpacked = {};
+
+    unpacked.verts = [];
+    unpacked.norms = [];
+    unpacked.textures = [];
+    unpacked.hashindices = {};
+    unpacked.indices = [];
+    unpacked.index = 0;
+
+    var lines = data.split('\n');
+
+    var VERTEX_RE = /^v\s/;
+    var NORMAL_RE = /^vn\s/;
+    var TEXTURE_RE = /^vt\s/;
+    var FACE_RE = /^f\s/;
+    var WHITESPACE_RE = /\s+/;
+
+    for (var i = 0; i < lines.length; i++) {
+        var line = lines[i].trim();
+        var elements = line.split(WHITESPACE_RE);
+        elements.shift();
+
+        if (VERTEX_RE.test(line)) verts.push.apply(verts, elements);
+        else if (NORMAL_RE.test(line)) vertNormals.push.apply(vertNormals, elements);
+        else if (TEXTURE_RE.test(line)) textures.push.apply(textures, elements);
+        else if (FACE_RE.test(line)) {
+            var quad = false;
+            for (var j = 0, eleLen = elements.length; j < eleLen; j++) {
+                if (j === 3 && !quad) {
+                    j = 2;
+                    quad = true;
+                }
+                if (elements[j] in unpacked.hashindices)
+                    unpacked.indices.push(unpacked.hashindices[elements[j]]);
+                else {
+                    var vertex = elements[j].split('/');
+
+                    unpacked.verts.push(+verts[(vertex[0] - 1) * 3 + 0]);
+                    unpacked.verts.push(+verts[(vertex[0] - 1) * 3 + 1]);
+                    unpacked.verts.push(+verts[(vertex[0] - 1) * 3 + 2]);
+
+                    if (textures.length) {
+                        unpacked.textures.push(+textures[((vertex[1] - 1) || vertex[0]) * 2 + 0]);
+                        unpacked.textures.push(+textures[((vertex[1] - 1) || vertex[0]) * 2 + 1]);
+                    }
+
+                    unpacked.norms.push(+vertNormals[((vertex[2] - 1) || vertex[0]) * 3 + 0]);
+                    unpacked.norms.push(+vertNormals[((vertex[2] - 1) || vertex[0]) * 3 + 1]);
+                    unpacked.norms.push(+vertNormals[((vertex[2] - 1) || vertex[0]) * 3 + 2]);
+
+                    unpacked.hashindices[elements[j]] = unpacked.index;
+                    unpacked.indices.push(unpacked.index);
+                    unpacked.index += 1;
+                }
+                if (j === 3 && quad) unpacked.indices.push(unpacked.hashindices[elements[0]]);
+            }
+        }
+    }
+    return pack_mesh(unpacked);
+}
+
+function pack_mesh({verts, norms, textures, indices}) {
+    // Lay the unpacked mesh out the way build-meshes.py does:  positions normalized like
+    // Shape.normalize_positions(false), normals and texture coordinates quantized.
+    const vertex_count = verts.length / 3, index_count = indices.length;
+    let flags = vertex_count > 65536 ? MESH_UINT32_INDICES : 0;
+    if (textures.some(x => x < 0 || x > 1))
+        flags |= MESH_FLOAT_TEXTURE_COORDS;
+
+    const align = n => (n + 3) & ~3;
+    const sizes = [12 * vertex_count, 6 * vertex_count, (flags & MESH_FLOAT_TEXTURE_COORDS ? 8 : 4) * vertex_count,
+        (flags & MESH_UINT32_INDICES ? 4 : 2) * index_count];
+    const buffer = new ArrayBuffer(16 + sizes.reduce((total, size) => total + align(size), 0));
+    new Uint8Array(buffer, 0, 4).set([77, 83, 72, 49]);                        // "MSH1"
+    new Uint32Array(buffer, 4, 3).set([vertex_count, index_count, flags]);
+    let offset = 16;
+    const view = (type, length) => {
+        const array = new type(buffer, offset, length);
+        offset += align(array.byteLength);
+        return array;
+    };
+    const position = view(Float32Array, 3 * vertex_count), normal = view(Int16Array, 3 * vertex_count),
+        texture_coord = view(flags & MESH_FLOAT_TEXTURE_COORDS ? Float32Array : Uint16Array, 2 * vertex_count),
+        index = view(flags & MESH_UINT32_INDICES ? Uint32Array : Uint16Array, index_count);
+
+    // Summed, divided and rounded in exactly the order build-meshes.py uses, so the result is byte for byte its .mesh:
+    const norm = v => Math.sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    const average = [0, 0, 0], lengths = [0, 0, 0];
+    for (let i = 0; i < verts.length; i++)
+        average[i % 3] += verts[i];
+    for (let k = 0; k < 3; k++)
+        average[k] /= vertex_count || 1;
+    for (let i = 0; i < verts.length; i++)
+        lengths[i % 3] += Math.abs(verts[i] - average[i % 3]);
+    for (let k = 0; k < 3; k++)
+        lengths[k] /= vertex_count || 1;
+    const scale = norm(lengths) || 1;
+    for (let i = 0; i < verts.length; i++)
+        position[i] = (verts[i] - average[i % 3]) / scale;
+
+    for (let i = 0; i < verts.length; i += 3) {
+        const n = [norms[i] || 0, norms[i + 1] || 0, norms[i + 2] || 0], length = norm(n) || 1;
+        for (let k = 0; k < 3; k++)
+            normal[i + k] = Math.round(n[k] / length * 32767);
+    }
+    for (let i = 0; i < textures.length; i++)
+        texture_coord[i] = flags & MESH_FLOAT_TEXTURE_COORDS ? textures[i] : Math.round(textures[i] * 65535) || 0;
+    index.set(indices);
+    return buffer;
+}
+
+async function load_mesh(url) {
+    // The prebuilt .mesh if there is one, otherwise the .obj parsed here.
+    const response = await fetch(url.replace(/\.obj$/, ".mesh"));
+    if (response.ok) {
+        const buffer = await response.arrayBuffer();
+        if (buffer.byteLength >= 16 && new TextDecoder().decode(new Uint8Array(buffer, 0, 4)) == "MSH1")
+            return buffer;
+    }
+    const obj_response = await fetch(url);
+    if (!obj_response.ok)
+        throw obj_response.status;
+    return parse_into_mesh(await obj_response.text());
+}
+
+async function load_image(url) {
+    const response = await fetch(url);
+    if (!response.ok)
+        throw response.status;
+    return createImageBitmap(await response.blob(), {imageOrientation: "flipY"});
+}
+
+onmessage = async ({data: {id, type, url}}) => {
+    try {
+        if (type == "mesh") {
+            const buffer = await load_mesh(url);
+            postMessage({id, buffer}, [buffer]);
+        } else {
+            const image = await load_image(url);
+            postMessage({id, image}, [image]);
+        }
+    } catch (error) {
+        postMessage({id, error: String(error)});
+    }
+};
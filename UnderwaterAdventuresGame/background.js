@@ -56,13 +56,17 @@ export class Background extends Scene {
 
         // *** Materials
         const phong = new defs.Phong_Shader();
+        const instanced_phong = new (defs.Phong_Shader.prototype.make_instanced_version())();
         this.materials = {
 //             terrain: new Material(new Textured_Phong(),
 //                 {ambient: 0.5, diffusivity: 1, specularity: 0, color: color(.9, .5, .9, 1), texture: new Texture("assets/water.jpg")}),
             terrain: new Material(phong,
                 {ambient: 0.5, diffusivity: 1, specularity: 0, color: color(.9, .5, .9, 1)}),
-            seaweed: new Material(phong,
-                {ambient: 0.5, diffusivity: 1, specularity: 0.7, color: color(.9, .5, .9, 1)}),
+            //seaweed and rocks are drawn all at once, in these colors
+            seaweed: new Material(instanced_phong,
+                {ambient: 0.5, diffusivity: 1, specularity: 0.7, color: hex_color("#3a9485")}),
+            rock: new Material(instanced_phong,
+                {ambient: 0.5, diffusivity: 1, specularity: 0, color: hex_color("#3a809e")}),
             bubble: new Material(phong,
                 {ambient: 0.8, diffusivity: 1, specularity: 1, color: color(1, 1, 1, 1)})
         }
@@ -179,18 +183,23 @@ export class Background extends Scene {
             //draw background         
             this.shapes.sheet.draw(context, program_state, Mat4.identity().times(Mat4.translation(5, 5, -6 -24)).times(Mat4.scale(45, 20, 1)), this.materials.terrain.override({color: hex_color("#31738f")}));
 
-            //draw seaweed
-            this.draw_seaweed(context, program_state, this.seaweed_positions.s1, scroll_rate, this.number_loops_1);
-            this.draw_seaweed(context, program_state, this.seaweed_positions.s2, scroll_rate, this.number_loops_2);
-            this.draw_seaweed(context, program_state, this.seaweed_positions.s3, scroll_rate, this.number_loops_3);
+            //draw seaweed, then rocks, each in a single instanced draw
+            let seaweed_transforms = [];
+            this.place_seaweed(seaweed_transforms, this.seaweed_positions.s1, scroll_rate, this.number_loops_1);
+            this.place_seaweed(seaweed_transforms, this.seaweed_positions.s2, scroll_rate, this.number_loops_2);
+            this.place_seaweed(seaweed_transforms, this.seaweed_positions.s3, scroll_rate, this.number_loops_3);
+            this.shapes.seaweed.draw_instances(context, program_state, seaweed_transforms, null, this.materials.seaweed);
 
-            this.draw_rocks(context, program_state, this.rock_positions.r1, scroll_rate, this.number_loops_1);
-            this.draw_rocks(context, program_state, this.rock_positions.r2, scroll_rate, this.number_loops_2);
-            this.draw_rocks(context, program_state, this.rock_positions.r3, scroll_rate, this.number_loops_3);
+            let rock_transforms = [];
+            this.place_rocks(rock_transforms, this.rock_positions.r1, scroll_rate, this.number_loops_1);
+            this.place_rocks(rock_transforms, this.rock_positions.r2, scroll_rate, this.number_loops_2);
+            this.place_rocks(rock_transforms, this.rock_positions.r3, scroll_rate, this.number_loops_3);
+            this.shapes.sphere2.draw_instances(context, program_state, rock_transforms, null, this.materials.rock);
 
     }
 
-    draw_seaweed(context, program_state, positions_array, scroll_rate, terrain_number_loops){
+    //add the transform of each seaweed on a terrain piece to transforms
+    place_seaweed(transforms, positions_array, scroll_rate, terrain_number_loops){
             for(let i = 0; i < positions_array.length; i++)
             {
                 let flip_factor = 1
@@ -214,11 +223,12 @@ export class Background extends Scene {
                 .times(swaying_motion)
                 .times(Mat4.scale(8, 4 + 4*i/4, 4));
 
-                this.shapes.seaweed.draw(context, program_state, seaweed_transform, this.materials.seaweed.override({color: hex_color("#3a9485")}));
+                transforms.push(seaweed_transform);
             }
     }
 
-    draw_rocks(context, program_state, positions_array, scroll_rate, terrain_number_loops){
+    //add the transform of each rock on a terrain piece to transforms
+    place_rocks(transforms, positions_array, scroll_rate, terrain_number_loops){
 
             for(let i = 0; i < positions_array.length; i++)
             {
@@ -232,7 +242,7 @@ export class Background extends Scene {
                 .times(rock_position)
                 .times(Mat4.scale(4, 2*(i/4+2), 2));
 
-                this.shapes.sphere2.draw(context, program_state, rock_transform, this.materials.terrain.override({color: hex_color("#3a809e")}));
+                transforms.push(rock_transform);
 
             }
     }
@@ -0,0 +1,174 @@
+"""
+build-meshes.py - Converts the .obj models in assets/ into the binary .mesh files Shape_From_File loads.
+
+Run it from this folder (python3 build-meshes.py) whenever an .obj changes, or pass the .obj files to convert. The
+mesh is unpacked exactly as parse_into_mesh() in asset-worker.js does it, positions are normalized the same way, and
+the result is written out ready for the graphics card, so the page only has to fetch it and view it as typed arrays.
+
+A .mesh file is little-endian:
+
+    header    "MSH1", uint32 vertex count, uint32 index count, uint32 flags
+    position  float32 x, y, z per vertex
+    normal    int16 x, y, z per vertex, the unit normal times 32767 (read back as a normalized SHORT attribute)
+    texcoord  uint16 u, v per vertex, times 65535 (a normalized UNSIGNED_SHORT), or float32 u, v with
+              MESH_FLOAT_TEXCOORDS when some coordinate lies outside [0, 1]
+    index     uint16 per index, or uint32 with MESH_UINT32_INDICES when there are more than 65536 vertices
+
+Every section starts on a 4 byte boundary, zero padded.
+"""
+
+import glob
+import math
+import os
+import struct
+import sys
+from array import array
+
+MESH_MAGIC = b"MSH1"
+MESH_UINT32_INDICES = 1
+MESH_FLOAT_TEXCOORDS = 2
+
+
+def lookup(values, index, count):
+    # values[index * count ... + count], with 0 for whatever the file doesn't have
+    start = index * count
+    if start < 0 or start + count > len(values):
+        return [0.0] * count
+    return [float(values[start + k]) for k in range(count)]
+
+
+def attribute_index(field, vertex_index):
+    # the loader reads the texture and normal index as (field - 1) || vertex[0]; keep its quirks so the cached mesh
+    # looks exactly like the parsed one
+    if field is None:
+        return vertex_index
+    if field == "":
+        return -1
+    return int(field) - 1 or vertex_index
+
+
+def parse_obj(text):
+    verts, vert_normals, textures = [], [], []
+    positions, normals, texcoords, indices = [], [], [], []
+    hash_indices = {}
+
+    for line in text.split("\n"):
+        elements = line.split()
+        if len(elements) < 2:
+            continue
+        kind, elements = elements[0], elements[1:]
+
+        if kind == "v":
+            verts.extend(elements)
+        elif kind == "vn":
+            vert_normals.extend(elements)
+        elif kind == "vt":
+            textures.extend(elements)
+        elif kind == "f":
+            quad = False
+            j = 0
+            while j < len(elements):
+                if j == 3 and not quad:      # a quad is split into two triangles sharing the third corner
+                    j = 2
+                    quad = True
+                if elements[j] in hash_indices:
+                    indices.append(hash_indices[elements[j]])
+                else:
+                    vertex = elements[j].split("/")
+                    v = int(vertex[0])
+                    t = vertex[1] if len(vertex) > 1 else None
+                    n = vertex[2] if len(vertex) > 2 else None
+
+                    positions.append(lookup(verts, v - 1, 3))
+                    texcoords.append(lookup(textures, attribute_index(t, v), 2) if textures else [0.0, 0.0])
+                    normals.append(lookup(vert_normals, attribute_index(n, v), 3))
+
+                    hash_indices[elements[j]] = len(positions) - 1
+                    indices.append(len(positions) - 1)
+                if j == 3 and quad:
+                    indices.append(hash_indices[elements[0]])
+                j += 1
+
+    return positions, normals, texcoords, indices
+
+
+def js_round(x):
+    # Math.round(): halves go up, where Python's round() goes to even
+    whole = math.floor(x)
+    return whole + 1 if x - whole >= 0.5 else whole
+
+
+def norm(v):
+    # written out in this order, as pack_mesh() in asset-worker.js does, so both round the same way
+    return math.sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2])
+
+
+def normalize_positions(positions):
+    # Shape.normalize_positions(false): center the point cloud, then divide by the norm of its average extents.
+    # The sums are plain left to right loops, in the same order as pack_mesh() in asset-worker.js (sum() of floats
+    # compensates for rounding since Python 3.12), so a .mesh made by either is byte for byte the same.
+    count = len(positions) or 1
+    average = [0.0, 0.0, 0.0]
+    for p in positions:
+        for k in range(3):
+            average[k] += p[k]
+    average = [a / count for a in average]
+    lengths = [0.0, 0.0, 0.0]
+    for p in positions:
+        for k in range(3):
+            lengths[k] += abs(p[k] - average[k])
+    lengths = [length / count for length in lengths]
+    scale = norm(lengths) or 1
+    return [[(p[k] - average[k]) / scale for k in range(3)] for p in positions]
+
+
+def quantize_normal(n):
+    length = norm(n)
+    if length == 0:
+        return [0, 0, 0]
+    return [max(-32767, min(32767, js_round(x / length * 32767))) for x in n]
+
+
+def pad(data):
+    data.extend(b"\0" * (-len(data) % 4))
+
+
+def build_mesh(text):
+    positions, normals, texcoords, indices = parse_obj(text)
+    positions = normalize_positions(positions)
+
+    flags = 0
+    if len(positions) > 65536:
+        flags |= MESH_UINT32_INDICES
+    if any(x < 0 or x > 1 for uv in texcoords for x in uv):
+        flags |= MESH_FLOAT_TEXCOORDS
+
+    data = bytearray(MESH_MAGIC + struct.pack("<III", len(positions), len(indices), flags))
+    sections = [
+        array("f", [x for p in positions for x in p]),
+        array("h", [x for n in normals for x in quantize_normal(n)]),
+        array("f", [x for uv in texcoords for x in uv]) if flags & MESH_FLOAT_TEXCOORDS
+        else array("H", [js_round(x * 65535) for uv in texcoords for x in uv]),
+        array("I" if flags & MESH_UINT32_INDICES else "H", indices),
+    ]
+    for section in sections:
+        if sys.byteorder != "little":
+            section.byteswap()
+        data.extend(section.tobytes())
+        pad(data)
+    return bytes(data), len(positions), len(indices)
+
+
+def main(paths):
+    for path in paths or sorted(glob.glob(os.path.join("assets", "*.obj"))):
+        with open(path) as f:
+            data, vertex_count, index_count = build_mesh(f.read())
+        out = os.path.splitext(path)[0] + ".mesh"
+        with open(out, "wb") as f:
+            f.write(data)
+        print("%s: %d vertices, %d indices, %d -> %d bytes" % (out, vertex_count, index_count,
+                                                                 os.path.getsize(path), len(data)))
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
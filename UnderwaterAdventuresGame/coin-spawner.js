@@ -1,4 +1,6 @@
 import {defs, tiny} from './common.js';
+import {Spatial_Hash} from "./spatial-hash.js";
+import {Streamed_Texture} from "./asset-loader.js";
 const {Vector, Vector3, vec, vec3, vec4, color, hex_color, Shader, Matrix, Mat4, Light, Shape, Material, Scene, Texture} = tiny;
 const {Textured_Phong} = defs
 
@@ -47,11 +49,12 @@ export class Coin_Spawner extends Scene {
         // To show text you need a Material like this one:
         this.text_image = new Material(new defs.Textured_Phong(1), {
             ambient: 1, diffusivity: 0, specularity: 0,
-            texture: new Texture("assets/text.png")
+            texture: new Streamed_Texture("assets/text.png")
         });
 
         this.coins = [];
         this.score = 0;
+        this.grid = new Spatial_Hash(4); //coins on screen, rebuilt every frame for the player check
 
         this.next_spawn_time = 0;
         this.coin_obj = new Coin();
@@ -98,22 +101,29 @@ export class Coin_Spawner extends Scene {
 //         console.log(this.coins);
     }
 
-    //for all coins, check if player collides by getting their positions and seeing if the fall within a box area
+    //put all coins in the grid, then only check the ones sharing a cell with the player by seeing if they fall within a box area
     //if collided, add to a temp array of coins to delete, then delete them all and add to score
     check_collision(){
         let coins_to_delete = [];
 
         if (this.coins.length > 0)
         {
+            let player_pos = [this.submarine_transform[0][3] - 3.5, this.submarine_transform[1][3] - 1];
+            let player_width = 7;
+            let player_height = 2;
+
+            let coin_width = 1.5;
+            let coin_height = 1.5;
+
+            this.grid.clear();
             for(let i = 0; i < this.coins.length; i++)
             {
-                let player_pos = [this.submarine_transform[0][3] - 3.5, this.submarine_transform[1][3] - 1];
-                let player_width = 7;
-                let player_height = 2;
+                this.grid.insert(this.coins[i], this.coins[i][0], this.coins[i][1], coin_width, coin_height);
+            }
 
-                let coin_pos = [this.coins[i][0], this.coins[i][1]]; 
-                let coin_width = 1.5;
-                let coin_height = 1.5;
+            for (const coin of this.grid.query(player_pos[0], player_pos[1], player_width, player_height))
+            {
+                let coin_pos = [coin[0], coin[1]]; 
 
                 if (player_pos[0] > coin_width + coin_pos[0]
                     || coin_pos[0] > player_width + player_pos[0]
@@ -125,7 +135,7 @@ export class Coin_Spawner extends Scene {
 
                 else                    //collision
                 {
-                    coins_to_delete.push(this.coins[i]);
+                    coins_to_delete.push(coin);
                 }              
             }
         }
@@ -149,13 +159,10 @@ export class Coin_Spawner extends Scene {
 
         this.update_and_check_coins(program_state); //shift coins left and delete off-screen
         
-        //display coins
+        //display coins, all in one draw
         if (this.coins.length > 0 && this.coins.length < 6)
         {
-            for(let i = 0; i < this.coins.length; i++)
-            {
-                this.coin_obj.display(context, program_state, this.coins[i]);
-            }
+            this.coin_obj.display(context, program_state, this.coins);
         }
 
         //check for collision and add to score if any
@@ -181,12 +188,13 @@ export class Coin extends Scene {
 
 
         this.materials = {
-            coin: new Material(new defs.Phong_Shader(),
+            coin: new Material(new (defs.Phong_Shader.prototype.make_instanced_version())(),
                 {ambient: .4, diffusivity: .6, color: hex_color("#ffaabb")})
         };
     }
 
-    display(context, program_state, position) {
+    //draw a coin at each of the positions
+    display(context, program_state, positions) {
 
         if (!context.scratchpad.controls) {
             this.children.push(context.scratchpad.controls = new defs.Movement_Controls());
@@ -199,10 +207,9 @@ export class Coin extends Scene {
 
         program_state.lights = [new Light(vec4(3, 2, 10, 1),color(1, .7, .7, 1), 100000)];
 
-        let model_transform = Mat4.identity();
-
-        model_transform = model_transform.times(Mat4.translation(position[0], position[1], position[2])).times(Mat4.rotation(t/200,0,1,0));
+        let spin = Mat4.rotation(t/200,0,1,0);
+        let model_transforms = positions.map(position => Mat4.translation(position[0], position[1], position[2]).times(spin));
 
-        this.shapes.coin.draw(context,program_state,model_transform,this.materials.coin);
+        this.shapes.coin.draw_instances(context,program_state,model_transforms,null,this.materials.coin);
     }
 }
\ No newline at end of file
@@ -582,14 +582,27 @@ const Phong_Shader = defs.Phong_Shader =
             this.num_lights = num_lights;
         }
 
+        make_instanced_version() {
+            // make_instanced_version(): Auto-generate a new class that re-uses any Phong-based
+            // Shader, but takes each instance's model transform and color from per-instance
+            // attributes, as Shape.draw_instances() sends them, instead of from uniforms.
+            return class extends this.constructor {
+                constructor(...args) {
+                    super(...args);
+                    this.instanced = true;
+                }
+            }
+        }
+
         shared_glsl_code() {
             // ********* SHARED CODE, INCLUDED IN BOTH SHADERS *********
+            // An instanced shader passes each instance's color from the vertex shader instead.
             return ` precision mediump float;
                 const int N_LIGHTS = ` + this.num_lights + `;
                 uniform float ambient, diffusivity, specularity, smoothness;
                 uniform vec4 light_positions_or_vectors[N_LIGHTS], light_colors[N_LIGHTS];
                 uniform float light_attenuation_factors[N_LIGHTS];
-                uniform vec4 shape_color;
+                ` + (this.instanced ? "varying" : "uniform") + ` vec4 shape_color;
                 uniform vec3 squared_scale, camera_center;
         
                 // Specifier "varying" means a variable's final value will be passed from the vertex shader
@@ -628,22 +641,52 @@ const Phong_Shader = defs.Phong_Shader =
                   } `;
         }
 
-        vertex_glsl_code() {
-            // ********* VERTEX SHADER *********
-            return this.shared_glsl_code() + `
-                attribute vec3 position, normal;                            
-                // Position is expressed in object coordinates.
-                
+        transform_glsl_code() {
+            // ********* VERTEX SHADER CODE TO PLACE A VERTEX *********
+            // Defines place_vertex(), which sets the vertex's final position, normal and world
+            // space position from the model transform.  An instanced shader reads that (and the
+            // color) per instance, and works out the squared scale from it on the GPU.
+            if (!this.instanced)
+                return `
                 uniform mat4 model_transform;
                 uniform mat4 projection_camera_model_transform;
         
-                void main(){                                                                   
+                void place_vertex(){
                     // The vertex's final resting place (in NDCS):
                     gl_Position = projection_camera_model_transform * vec4( position, 1.0 );
                     // The final normal vector in screen space.
                     N = normalize( mat3( model_transform ) * normal / squared_scale);
                     vertex_worldspace = ( model_transform * vec4( position, 1.0 ) ).xyz;
                   } `;
+            return `
+                // Columns of this instance's model transform, and its color:
+                attribute vec4 instance_transform_0, instance_transform_1, instance_transform_2, instance_transform_3;
+                attribute vec4 instance_color;
+                uniform mat4 projection_camera_transform;
+        
+                void place_vertex(){
+                    mat4 model_transform = mat4( instance_transform_0, instance_transform_1,
+                                                 instance_transform_2, instance_transform_3 );
+                    vec3 instance_squared_scale = vec3( dot( instance_transform_0.xyz, instance_transform_0.xyz ),
+                                                        dot( instance_transform_1.xyz, instance_transform_1.xyz ),
+                                                        dot( instance_transform_2.xyz, instance_transform_2.xyz ) );
+                    vertex_worldspace = ( model_transform * vec4( position, 1.0 ) ).xyz;
+                    gl_Position = projection_camera_transform * vec4( vertex_worldspace, 1.0 );
+                    N = normalize( mat3( model_transform ) * normal / instance_squared_scale);
+                    shape_color = instance_color;
+                  } `;
+        }
+
+        vertex_glsl_code() {
+            // ********* VERTEX SHADER *********
+            return this.shared_glsl_code() + `
+                attribute vec3 position, normal;                            
+                // Position is expressed in object coordinates.
+                ` + this.transform_glsl_code() + `
+        
+                void main(){                                                                   
+                    place_vertex();
+                  } `;
         }
 
         fragment_glsl_code() {
@@ -684,9 +727,13 @@ const Phong_Shader = defs.Phong_Shader =
             // cache and send those.  They will be the same throughout this draw
             // call, and thus across each instance of the vertex shader.
             // Transpose them since the GPU expects matrices as column-major arrays.
-            const PCM = gpu_state.projection_transform.times(gpu_state.camera_inverse).times(model_transform);
-            gl.uniformMatrix4fv(gpu.model_transform, false, Matrix.flatten_2D_to_1D(model_transform.transposed()));
-            gl.uniformMatrix4fv(gpu.projection_camera_model_transform, false, Matrix.flatten_2D_to_1D(PCM.transposed()));
+            const PC = gpu_state.projection_transform.times(gpu_state.camera_inverse), PCM = PC.times(model_transform);
+            if (this.instanced)             // The model transforms come per instance instead.
+                gl.uniformMatrix4fv(gpu.projection_camera_transform, false, Matrix.flatten_2D_to_1D(PC.transposed()));
+            else {
+                gl.uniformMatrix4fv(gpu.model_transform, false, Matrix.flatten_2D_to_1D(model_transform.transposed()));
+                gl.uniformMatrix4fv(gpu.projection_camera_model_transform, false, Matrix.flatten_2D_to_1D(PCM.transposed()));
+            }
 
             // Omitting lights will show only the material color, scaled by the ambient term:
             if (!gpu_state.lights.length)
@@ -731,16 +778,10 @@ const Textured_Phong = defs.Textured_Phong =
                 attribute vec3 position, normal;                            
                 // Position is expressed in object coordinates.
                 attribute vec2 texture_coord;
-                
-                uniform mat4 model_transform;
-                uniform mat4 projection_camera_model_transform;
+                ` + this.transform_glsl_code() + `
         
                 void main(){                                                                   
-                    // The vertex's final resting place (in NDCS):
-                    gl_Position = projection_camera_model_transform * vec4( position, 1.0 );
-                    // The final normal vector in screen space.
-                    N = normalize( mat3( model_transform ) * normal / squared_scale);
-                    vertex_worldspace = ( model_transform * vec4( position, 1.0 ) ).xyz;
+                    place_vertex();
                     // Turn the per-vertex texture coordinate into an interpolated variable.
                     f_tex_coord = texture_coord;
                   } `;
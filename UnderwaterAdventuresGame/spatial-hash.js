@@ -0,0 +1,73 @@
+export class Spatial_Hash {                    // **Spatial_Hash** is a uniform 2D grid over the x-y plane that the game's collision
+                                                // checks go through.  Each frame a spawner clear()s it and insert()s the box of every
+                                                // live entity; query() then returns only the entities whose cells overlap a box, so the
+                                                // submarine or a missile is tested against its neighbours instead of everything on screen.
+    constructor(cell_size) {
+        this.cell_size = cell_size;
+        this.cells = new Map();                 // cell key -> entries overlapping that cell.  The arrays are kept and reused
+        this.used = [];                         // across frames; used lists the ones filled since the last clear().
+        this.entries = [];                      // pool of {item, stamp}, one per insert()
+        this.count = 0;
+        this.stamp = 0;                         // bumped by every query() so an entry spanning several cells is returned once
+        this.found = [];
+    }
+
+    key(cx, cy) {                               // key(): Packs a cell's coordinates into one number (exact for |cx|, |cy| < 2^20).
+        return (cx + 0x100000) * 0x200000 + (cy + 0x100000);
+    }
+
+    clear() {                                   // clear(): Empties the grid, keeping its arrays for the next frame.
+        for (let i = 0; i < this.used.length; i++)
+            this.used[i].length = 0;
+        this.used.length = 0;
+        for (let i = 0; i < this.count; i++)
+            this.entries[i].item = null;
+        this.count = 0;
+    }
+
+    insert(item, x, y, width, height) {         // insert(): Adds item with the box whose lower left corner is (x, y) to every
+                                                // cell the box overlaps.
+        let entry = this.entries[this.count];
+        if (!entry)
+            entry = this.entries[this.count] = {item: null, stamp: 0};
+        this.count++;
+        entry.item = item;
+        entry.stamp = 0;
+
+        const size = this.cell_size;
+        const x0 = Math.floor(x / size), x1 = Math.floor((x + width) / size);
+        const y0 = Math.floor(y / size), y1 = Math.floor((y + height) / size);
+        for (let cx = x0; cx <= x1; cx++)
+            for (let cy = y0; cy <= y1; cy++) {
+                const key = this.key(cx, cy);
+                let cell = this.cells.get(key);
+                if (!cell)
+                    this.cells.set(key, cell = []);
+                if (cell.length == 0)
+                    this.used.push(cell);
+                cell.push(entry);
+            }
+    }
+
+    query(x, y, width, height) {                // query(): Returns the items sharing a cell with the box whose lower left corner is
+                                                // (x, y).  These are only candidates; the caller still makes the exact test.  The
+                                                // array is reused by the next query(), so copy it if it has to outlive that.
+        this.found.length = 0;
+        const stamp = ++this.stamp;
+        const size = this.cell_size;
+        const x0 = Math.floor(x / size), x1 = Math.floor((x + width) / size);
+        const y0 = Math.floor(y / size), y1 = Math.floor((y + height) / size);
+        for (let cx = x0; cx <= x1; cx++)
+            for (let cy = y0; cy <= y1; cy++) {
+                const cell = this.cells.get(this.key(cx, cy));
+                if (!cell)
+                    continue;
+                for (let i = 0; i < cell.length; i++)
+                    if (cell[i].stamp != stamp) {
+                        cell[i].stamp = stamp;
+                        this.found.push(cell[i].item);
+                    }
+            }
+        return this.found;
+    }
+}
@@ -1,4 +1,5 @@
 import {defs, tiny} from './common.js';
+import {asset_loader, Streamed_Texture} from "./asset-loader.js";
 import {Coin_Spawner} from "./coin-spawner.js";
 import {Fish_Obj} from "./fish.js";
 
@@ -11,99 +12,64 @@ export class Shape_From_File extends Shape {                                   /
     constructor(filename) {
         super("position", "normal", "texture_coord");
         // Begin downloading the mesh. Once that completes, return
-        // control to our parse_into_mesh function.
+        // control to our load_mesh function.
         this.load_file(filename);
     }
 
-    load_file(filename) {                             // Request the external file and wait for it to load.
+    load_file(filename) {                             // Have the asset loader's workers fetch the mesh (parsing the
+        // .obj there when there is no prebuilt .mesh) and wait for it to load.
         // Failure mode:  Loads an empty shape.
-        return fetch(filename)
-            .then(response => {
-                if (response.ok) return Promise.resolve(response.text())
-                else return Promise.reject(response.status)
-            })
-            .then(obj_file_contents => this.parse_into_mesh(obj_file_contents))
+        return asset_loader.load_mesh(filename)
+            .then(mesh_file_contents => this.load_mesh(mesh_file_contents))
             .catch(error => {
                 this.copy_onto_graphics_card(this.gl);
             })
     }
 
-    parse_into_mesh(data) {                           // Adapted from the "webgl-obj-loader.js" library found online:
-        var verts = [], vertNormals = [], textures = [], unpacked = {};
-
-        unpacked.verts = [];
-        unpacked.norms = [];
-        unpacked.textures = [];
-        unpacked.hashindices = {};
-        unpacked.indices = [];
-        unpacked.index = 0;
-
-        var lines = data.split('\n');
-
-        var VERTEX_RE = /^v\s/;
-        var NORMAL_RE = /^vn\s/;
-        var TEXTURE_RE = /^vt\s/;
-        var FACE_RE = /^f\s/;
-        var WHITESPACE_RE = /\s+/;
-
-        for (var i = 0; i < lines.length; i++) {
-            var line = lines[i].trim();
-            var elements = line.split(WHITESPACE_RE);
-            elements.shift();
-
-            if (VERTEX_RE.test(line)) verts.push.apply(verts, elements);
-            else if (NORMAL_RE.test(line)) vertNormals.push.apply(vertNormals, elements);
-            else if (TEXTURE_RE.test(line)) textures.push.apply(textures, elements);
-            else if (FACE_RE.test(line)) {
-                var quad = false;
-                for (var j = 0, eleLen = elements.length; j < eleLen; j++) {
-                    if (j === 3 && !quad) {
-                        j = 2;
-                        quad = true;
-                    }
-                    if (elements[j] in unpacked.hashindices)
-                        unpacked.indices.push(unpacked.hashindices[elements[j]]);
-                    else {
-                        var vertex = elements[j].split('/');
-
-                        unpacked.verts.push(+verts[(vertex[0] - 1) * 3 + 0]);
-                        unpacked.verts.push(+verts[(vertex[0] - 1) * 3 + 1]);
-                        unpacked.verts.push(+verts[(vertex[0] - 1) * 3 + 2]);
-
-                        if (textures.length) {
-                            unpacked.textures.push(+textures[((vertex[1] - 1) || vertex[0]) * 2 + 0]);
-                            unpacked.textures.push(+textures[((vertex[1] - 1) || vertex[0]) * 2 + 1]);
-                        }
-
-                        unpacked.norms.push(+vertNormals[((vertex[2] - 1) || vertex[0]) * 3 + 0]);
-                        unpacked.norms.push(+vertNormals[((vertex[2] - 1) || vertex[0]) * 3 + 1]);
-                        unpacked.norms.push(+vertNormals[((vertex[2] - 1) || vertex[0]) * 3 + 2]);
-
-                        unpacked.hashindices[elements[j]] = unpacked.index;
-                        unpacked.indices.push(unpacked.index);
-                        unpacked.index += 1;
-                    }
-                    if (j === 3 && quad) unpacked.indices.push(unpacked.hashindices[elements[0]]);
-                }
-            }
-        }
-        {
-            const {verts, norms, textures} = unpacked;
-            for (var j = 0; j < verts.length / 3; j++) {
-                this.arrays.position.push(vec3(verts[3 * j], verts[3 * j + 1], verts[3 * j + 2]));
-                this.arrays.normal.push(vec3(norms[3 * j], norms[3 * j + 1], norms[3 * j + 2]));
-                this.arrays.texture_coord.push(vec(textures[2 * j], textures[2 * j + 1]));
-            }
-            this.indices = unpacked.indices;
-        }
-        this.normalize_positions(false);
+    load_mesh(data) {                                 // Views the arrays laid out in a .mesh file (see build-meshes.py)
+        // as the shape's own, so they go to the graphics card without being parsed or copied.  Positions are
+        // already normalized; normals and texture coordinates are quantized to shorts which the shader reads
+        // back normalized.  Typed arrays use the machine's byte order, which is little-endian like the file.
+        if (new TextDecoder().decode(new Uint8Array(data, 0, 4)) != "MSH1")
+            throw "Not a mesh file";
+        const [vertex_count, index_count, flags] = new Uint32Array(data, 4, 3);
+        const float_texture_coords = flags & 2, uint32_indices = flags & 1;
+        let offset = 16;
+        const view = (type, length) => {
+            const array = new type(data, offset, length);
+            offset += (array.byteLength + 3) & ~3;    // Each section starts on a 4 byte boundary.
+            return array;
+        };
+        this.arrays.position = view(Float32Array, 3 * vertex_count);
+        this.arrays.normal = view(Int16Array, 3 * vertex_count);
+        this.arrays.texture_coord = view(float_texture_coords ? Float32Array : Uint16Array, 2 * vertex_count);
+        this.indices = view(uint32_indices ? Uint32Array : Uint16Array, index_count);
+        this.formats.normal = {type: "SHORT", normalized: true};
+        if (!float_texture_coords)
+            this.formats.texture_coord = {type: "UNSIGNED_SHORT", normalized: true};
         this.ready = true;
     }
 
-    draw(context, program_state, model_transform, material) {               // draw(): Same as always for shapes, but cancel all
-        // attempts to draw the shape before it loads:
+    stand_in() {                                      // The shape to draw until this one loads:  a low-poly
+        // sphere, shared by every model.
+        if (!Shape_From_File.placeholder)
+            Shape_From_File.placeholder = new defs.Subdivision_Sphere(1);
+        return Shape_From_File.placeholder;
+    }
+
+    draw(context, program_state, model_transform, material) {               // draw(): Same as always for shapes, but draw a
+        // placeholder in place of the shape until it loads:
         if (this.ready)
             super.draw(context, program_state, model_transform, material);
+        else
+            this.stand_in().draw(context, program_state, model_transform, material);
+    }
+
+    draw_instances(context, program_state, model_transforms, colors, material) {   // draw_instances(): Likewise.
+        if (this.ready)
+            super.draw_instances(context, program_state, model_transforms, colors, material);
+        else
+            this.stand_in().draw_instances(context, program_state, model_transforms, colors, material);
     }
 }
 
@@ -148,7 +114,7 @@ export class Submarine_Demo extends Scene {
 
         this.army = new Material(new defs.Textured_Phong(1), {
             color: color(.5, .5, .5, 1),
-            ambient: .3, diffusivity: .5, specularity: .5, texture: new Texture("assets/armySkin.png")
+            ambient: .3, diffusivity: .5, specularity: .5, texture: new Streamed_Texture("assets/armySkin.png")
         });
 
         this.materials = {
@@ -163,6 +129,10 @@ export class Submarine_Demo extends Scene {
 
     make_control_panel() {
 
+        this.live_string(box => box.textContent = asset_loader.progress < 1
+            ? "Loading models and textures: " + asset_loader.finished + " of " + asset_loader.requested : "");
+        this.new_line();
+
         this.key_triggered_button("Increase CW propeller speed", ["o"], () => {
             this.propSpeed = this.propSpeed*0.99;
         });
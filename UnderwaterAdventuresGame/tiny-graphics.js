@@ -779,11 +779,14 @@ const Vertex_Buffer = tiny.Vertex_Buffer =
         // you can look up in a vertex; for each field, a whole array will be made here of that data type and
         // it will be indexed per vertex.  Along with those lists is an additional array "indices" describing
         // how vertices are connected to each other into shape primitives.  Primitives could includes
-        // triangles, expressed as triples of vertex indices.
+        // triangles, expressed as triples of vertex indices.  An array (or the indices) may instead be a typed
+        // array that is already laid out for the GPU, such as a mesh loaded from a binary file; it is then sent
+        // as is.  Such an array can be stored in a compact type, named in "formats" along with whether the
+        // shader should see it normalized, e.g. formats.normal = {type: "SHORT", normalized: true}.
         constructor(...array_names) {
             // This superclass constructor expects a list of names of arrays that you plan for.
             super();
-            [this.arrays, this.indices] = [{}, []];
+            [this.arrays, this.indices, this.formats] = [{}, [], {}];
             // Initialize a blank array member of the Shape with each of the names provided:
             for (let name of array_names) this.arrays[name] = [];
         }
@@ -813,23 +816,31 @@ const Vertex_Buffer = tiny.Vertex_Buffer =
                 if (!did_exist)
                     gpu_instance.webGL_buffer_pointers[name] = gl.createBuffer();
                 gl.bindBuffer(gl.ARRAY_BUFFER, gpu_instance.webGL_buffer_pointers[name]);
-                write(gl.ARRAY_BUFFER, Matrix.flatten_2D_to_1D(this.arrays[name]));
+                const data = this.arrays[name];
+                write(gl.ARRAY_BUFFER, ArrayBuffer.isView(data) ? data : Matrix.flatten_2D_to_1D(data));
             }
             if (this.indices.length && write_to_indices) {
                 if (!did_exist)
                     gpu_instance.index_buffer = gl.createBuffer();
                 gl.bindBuffer(gl.ELEMENT_ARRAY_BUFFER, gpu_instance.index_buffer);
-                write(gl.ELEMENT_ARRAY_BUFFER, new Uint32Array(this.indices));
+                write(gl.ELEMENT_ARRAY_BUFFER, ArrayBuffer.isView(this.indices) ? this.indices : new Uint32Array(this.indices));
             }
             return gpu_instance;
         }
 
-        execute_shaders(gl, gpu_instance, type)     // execute_shaders(): Draws this shape's entire vertex buffer.
-        {       // Draw shapes using indices if they exist.  Otherwise, assume the vertices are arranged as triples.
+        execute_shaders(gl, gpu_instance, type, instances)     // execute_shaders(): Draws this shape's entire vertex buffer,
+        {       // "instances" times over if given.  Draw shapes using indices if they exist.  Otherwise, assume the
+                // vertices are arranged as triples.
+            const ext = gpu_instance.instancing;
             if (this.indices.length) {
                 gl.bindBuffer(gl.ELEMENT_ARRAY_BUFFER, gpu_instance.index_buffer);
-                gl.drawElements(gl[type], this.indices.length, gl.UNSIGNED_INT, 0)
-            } else gl.drawArrays(gl[type], 0, Object.values(this.arrays)[0].length);
+                const index_type = this.indices instanceof Uint16Array ? gl.UNSIGNED_SHORT : gl.UNSIGNED_INT;
+                if (instances === undefined)
+                    gl.drawElements(gl[type], this.indices.length, index_type, 0)
+                else ext.drawElementsInstancedANGLE(gl[type], this.indices.length, index_type, 0, instances);
+            } else if (instances === undefined)
+                gl.drawArrays(gl[type], 0, Object.values(this.arrays)[0].length);
+            else ext.drawArraysInstancedANGLE(gl[type], 0, Object.values(this.arrays)[0].length, instances);
         }
 
         draw(webgl_manager, program_state, model_transform, material, type = "TRIANGLES") {
@@ -837,10 +848,88 @@ const Vertex_Buffer = tiny.Vertex_Buffer =
             // which executes the shader programs.  The shaders draw the right shape due to
             // pre-selecting the correct buffer region in the GPU that holds that shape's data.
             const gpu_instance = this.activate(webgl_manager.context);
-            material.shader.activate(webgl_manager.context, gpu_instance.webGL_buffer_pointers, program_state, model_transform, material);
+            material.shader.activate(webgl_manager.context, gpu_instance.webGL_buffer_pointers, program_state, model_transform, material,
+                this.formats);
             // Run the shaders to draw every triangle now:
             this.execute_shaders(webgl_manager.context, gpu_instance, type);
         }
+
+        draw_instances(webgl_manager, program_state, model_transforms, colors, material, type = "TRIANGLES") {
+            // draw_instances():  Draws the shape once for each of the model_transforms, all in a single draw call,
+            // which is far cheaper than one draw() each when there are many.  Instance i is drawn in colors[i], or in
+            // the material's color when colors is left out.  The material's shader has to be an instanced one, from
+            // make_instanced_version(), which reads these two per instance from attributes instead of uniforms:
+            //      attribute vec4 instance_transform_0 ... instance_transform_3;   // columns of the model transform
+            //      attribute vec4 instance_color;
+            const gl = webgl_manager.context, count = model_transforms.length;
+            if (!count)
+                return;
+            const gpu_instance = this.activate(gl);
+            if (gpu_instance.instancing === undefined)
+                gpu_instance.instancing = gl.getExtension("ANGLE_instanced_arrays");
+            if (!gpu_instance.instancing) {                  // Without the extension, fall back to one draw each, still
+                                                             // with the instanced shader: its per-instance attributes have
+                                                             // no buffer, so they read the constant values set here.
+                const attributes = material.shader.activate(gl, gpu_instance.webGL_buffer_pointers, program_state,
+                    Mat4.identity(), material, this.formats).gpu_addresses.shader_attributes;
+                const set = (name, value) => {
+                    const attribute = attributes[name];
+                    if (attribute && attribute.index >= 0)
+                        gl.vertexAttrib4fv(attribute.index, value);
+                };
+                const default_color = material.color || [0, 0, 0, 1];
+                for (let i = 0; i < count; i++) {
+                    const M = model_transforms[i];
+                    for (let column = 0; column < 4; column++)
+                        set("instance_transform_" + column, [M[0][column], M[1][column], M[2][column], M[3][column]]);
+                    set("instance_color", colors ? colors[i] : default_color);
+                    this.execute_shaders(gl, gpu_instance, type);
+                }
+                return;
+            }
+
+            // Pack the instances' data together, the transforms column by column, into an array kept for the next
+            // call, and overwrite the GPU's copy of it:
+            const floats = 20 * count;
+            if (!this.instance_data || this.instance_data.length < floats)
+                this.instance_data = new Float32Array(2 * floats);
+            const data = this.instance_data, default_color = material.color || [0, 0, 0, 1];
+            for (let i = 0; i < count; i++) {
+                const M = model_transforms[i], c = colors ? colors[i] : default_color;
+                for (let column = 0; column < 4; column++)
+                    for (let row = 0; row < 4; row++)
+                        data[20 * i + 4 * column + row] = M[row][column];
+                data.set(c, 20 * i + 16);
+            }
+            if (!gpu_instance.instance_buffer)
+                gpu_instance.instance_buffer = gl.createBuffer();
+            gl.bindBuffer(gl.ARRAY_BUFFER, gpu_instance.instance_buffer);
+            gl.bufferData(gl.ARRAY_BUFFER, data.subarray(0, floats), gl.DYNAMIC_DRAW);
+
+            const shader_instance = material.shader.activate(gl, gpu_instance.webGL_buffer_pointers, program_state,
+                Mat4.identity(), material, this.formats);
+            const attributes = shader_instance.gpu_addresses.shader_attributes, stepped = [];
+            const point = (name, offset) => {                // Step an attribute along once per instance.
+                const attribute = attributes[name];
+                if (!attribute || attribute.index < 0)
+                    return;
+                gl.enableVertexAttribArray(attribute.index);
+                gl.vertexAttribPointer(attribute.index, 4, gl.FLOAT, false, 80, 4 * offset);
+                gpu_instance.instancing.vertexAttribDivisorANGLE(attribute.index, 1);
+                stepped.push(attribute.index);
+            };
+            gl.bindBuffer(gl.ARRAY_BUFFER, gpu_instance.instance_buffer);
+            for (let column = 0; column < 4; column++)
+                point("instance_transform_" + column, 4 * column);
+            point("instance_color", 16);
+
+            this.execute_shaders(gl, gpu_instance, type, count);
+            // The divisors belong to the attribute slots, not the program, so put them back for the next draw:
+            for (let index of stepped) {
+                gpu_instance.instancing.vertexAttribDivisorANGLE(index, 0);
+                gl.disableVertexAttribArray(index);
+            }
+        }
     }
 
 
@@ -1112,8 +1201,9 @@ const Shader = tiny.Shader =
             return gpu_instance;
         }
 
-        activate(context, buffer_pointers, program_state, model_transform, material) {
-            // activate(): Selects this Shader in GPU memory so the next shape draws using it.
+        activate(context, buffer_pointers, program_state, model_transform, material, buffer_formats = {}) {
+            // activate(): Selects this Shader in GPU memory so the next shape draws using it.  buffer_formats
+            // names the type of any buffer that doesn't hold plain floats (see Vertex_Buffer).
             const gpu_instance = super.activate(context);
 
             context.useProgram(gpu_instance.program);
@@ -1122,19 +1212,23 @@ const Shader = tiny.Shader =
             this.update_GPU(context, gpu_instance.gpu_addresses, program_state, model_transform, material);
 
             // --- Turn on all the correct attributes and make sure they're pointing to the correct ranges in GPU memory. ---
+            // Attributes the shape has no buffer for, like the per-instance ones Vertex_Buffer.draw_instances()
+            // points itself, are left off here.
             for (let [attr_name, attribute] of Object.entries(gpu_instance.gpu_addresses.shader_attributes)) {
-                if (!attribute.enabled) {
+                if (!attribute.enabled || !buffer_pointers[attr_name]) {
                     if (attribute.index >= 0) context.disableVertexAttribArray(attribute.index);
                     continue;
                 }
                 context.enableVertexAttribArray(attribute.index);
                 context.bindBuffer(context.ARRAY_BUFFER, buffer_pointers[attr_name]);
                 // Activate the correct buffer.
-                context.vertexAttribPointer(attribute.index, attribute.size, attribute.type,
-                    attribute.normalized, attribute.stride, attribute.pointer);
+                const format = buffer_formats[attr_name];
+                context.vertexAttribPointer(attribute.index, attribute.size, format ? context[format.type] : attribute.type,
+                    format ? format.normalized : attribute.normalized, attribute.stride, attribute.pointer);
                 // Populate each attribute
                 // from the active buffer.
             }
+            return gpu_instance;
         }
 
         // Your custom Shader has to override the following functions:
@@ -1200,6 +1294,12 @@ const Texture = tiny.Texture =
         constructor(filename, min_filter = "LINEAR_MIPMAP_LINEAR") {
             super();
             Object.assign(this, {filename, min_filter});
+            this.load_image(filename);
+        }
+
+        load_image(filename) {
+            // load_image():  Starts loading the image, setting "ready" once it is there.  Override it to
+            // obtain "image" some other way; anything texImage2D() accepts will do.
             // Create a new HTML Image object:
             this.image = new Image();
             this.image.onload = () => this.ready = true;